@@ -0,0 +1,167 @@
+#include "nes/apu.h"
+#include "nes/machine.h"
+#include "nes/pcmwriter.h"
+
+#include <tfm/tinyformat.h>
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace nes;
+
+namespace {
+
+constexpr std::array<const char*, Apu2A03::kChannelCount> kChannelNames = {
+	"pulse1", "pulse2", "triangle", "noise", "dmc",
+};
+
+struct Options {
+	uint32_t sampleRate = 48000;
+	uint8_t channelMask = Apu2A03::kAllChannels;
+	bool stems = false;
+	uint32_t startFrame = 0;
+	uint32_t stopFrame = 600;
+	PcmWriter::Format format = PcmWriter::Format::kWav;
+	std::string outDir; // empty: hash only
+	std::vector<std::string> roms;
+};
+
+std::optional<uint8_t> ParseChannels(const std::string& list) {
+	uint8_t mask = 0;
+	std::stringstream in(list);
+	std::string name;
+	while (std::getline(in, name, ',')) {
+		auto it = std::find(kChannelNames.begin(), kChannelNames.end(), name);
+		if (it == kChannelNames.end()) {
+			return std::nullopt;
+		}
+		mask |= 1 << (it - kChannelNames.begin());
+	}
+	return mask;
+}
+
+void PrintUsage() {
+	tfm::printf("Usage: nes-audio [--rate HZ] [--channels LIST] [--stems] [--start-frame N]\n"
+		    "                 [--stop-frame N] [--raw] [--out DIR] ROM...\n"
+		    "Channels: comma separated pulse1,pulse2,triangle,noise,dmc (default: all)\n"
+		    "Prints a PCM hash per stream; with --out the streams are written there.\n");
+}
+
+std::vector<uint8_t> LoadFile(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	return {std::istreambuf_iterator<char>(in), {}};
+}
+
+// One output stream of a ROM: the main mix or a stem
+struct Stream {
+	std::string name;
+	PcmWriter writer;
+	std::vector<float> samples;
+};
+
+bool RunRom(const Options& options, const std::string& path) {
+	auto machine = std::make_unique<Machine>();
+	if (!machine->LoadRom(LoadFile(path))) {
+		tfm::printf("SKIP %s: not a supported ROM\n", path);
+		return true;
+	}
+	auto& apu = machine->GetApu();
+	apu.SetSampleRate(options.sampleRate);
+	apu.SetChannelMask(options.channelMask);
+	apu.SetStemsEnabled(options.stems);
+
+	std::vector<std::unique_ptr<Stream>> streams;
+	streams.push_back(std::make_unique<Stream>());
+	streams.back()->name = "mix";
+	for (int channel = 0; options.stems && channel < Apu2A03::kChannelCount; ++channel) {
+		streams.push_back(std::make_unique<Stream>());
+		streams.back()->name = kChannelNames[channel];
+	}
+
+	const auto ext = options.format == PcmWriter::Format::kWav ? ".wav" : ".pcm";
+	const auto stem = std::filesystem::path(path).stem().string();
+	for (auto& stream : streams) {
+		// A frame is ~800 samples at 48 kHz, the rest is headroom
+		stream->samples.resize(options.sampleRate / 30);
+		std::string file;
+		if (!options.outDir.empty()) {
+			file = (std::filesystem::path(options.outDir) / (stem + "." + stream->name + ext)).string();
+		}
+		if (!stream->writer.Open(file, options.format, options.sampleRate)) {
+			tfm::format(std::cerr, "ERROR: cannot write %s\n", file);
+			return false;
+		}
+	}
+
+	for (uint32_t frame = 0; frame < options.stopFrame; ++frame) {
+		machine->RunFrame();
+		for (size_t i = 0; i < streams.size(); ++i) {
+			auto& stream = *streams[i];
+			const size_t n = i == 0 ? apu.ReadSamples(stream.samples)
+				: apu.ReadStemSamples((Apu2A03::Channel)(i - 1), stream.samples);
+			if (frame >= options.startFrame) {
+				stream.writer.Write({stream.samples.data(), n});
+			}
+		}
+	}
+
+	bool ok = true;
+	for (auto& stream : streams) {
+		ok &= stream->writer.Close();
+		tfm::printf("%s %s %d samples %016x\n", path, stream->name,
+			    stream->writer.GetSampleCount(), stream->writer.GetHash());
+	}
+	return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	Options options;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--rate" && i + 1 < argc) {
+			options.sampleRate = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--channels" && i + 1 < argc) {
+			auto mask = ParseChannels(argv[++i]);
+			if (!mask) {
+				PrintUsage();
+				return 1;
+			}
+			options.channelMask = *mask;
+		} else if (arg == "--stems") {
+			options.stems = true;
+		} else if (arg == "--start-frame" && i + 1 < argc) {
+			options.startFrame = std::atoi(argv[++i]);
+		} else if (arg == "--stop-frame" && i + 1 < argc) {
+			options.stopFrame = std::atoi(argv[++i]);
+		} else if (arg == "--raw") {
+			options.format = PcmWriter::Format::kRaw;
+		} else if (arg == "--out" && i + 1 < argc) {
+			options.outDir = argv[++i];
+		} else if (!arg.empty() && arg[0] != '-') {
+			options.roms.push_back(arg);
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (options.roms.empty()) {
+		PrintUsage();
+		return 1;
+	}
+
+	int failures = 0;
+	for (const auto& rom : options.roms) {
+		failures += !RunRom(options, rom);
+	}
+	return failures ? 2 : 0;
+}
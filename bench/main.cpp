@@ -0,0 +1,309 @@
+#include "nes/machine.h"
+#include "nes/jit.h"
+#include "nes/types.h"
+
+#include "programs.h"
+#include "romimage.h"
+
+#include <tfm/tinyformat.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace nes;
+using namespace nes::testing;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// One repetition: units of work done and the wall time it took
+struct Sample {
+	double work = 0.0;
+	double seconds = 0.0;
+};
+
+struct Benchmark {
+	std::string name;
+	std::string unit;
+	std::function<Sample()> run;
+};
+
+struct RomFile {
+	std::string path;
+	std::vector<uint8_t> image;
+};
+
+struct Options {
+	int repetitions = 10;
+	std::string filter;
+	std::vector<RomFile> roms;
+};
+
+template <typename Fn>
+Sample Measure(double work, Fn&& fn) {
+	const auto start = Clock::now();
+	fn();
+	const std::chrono::duration<double> elapsed = Clock::now() - start;
+	return {work, elapsed.count()};
+}
+
+// Keeps results alive so loops are not optimized away
+volatile uint32_t gSink = 0;
+
+std::vector<uint8_t> LoadFile(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	return {std::istreambuf_iterator<char>(in), {}};
+}
+
+// Reads the image and checks a machine accepts it, so a bad path fails the
+// run instead of timing an empty cartridge
+bool LoadRomFile(const std::string& path, RomFile& rom) {
+	rom.path = path;
+	rom.image = LoadFile(path);
+	if (rom.image.empty()) {
+		tfm::format(std::cerr, "ERROR: cannot read ROM %s\n", path);
+		return false;
+	}
+	auto machine = std::make_unique<Machine>();
+	if (!machine->LoadRom(rom.image)) {
+		tfm::format(std::cerr, "ERROR: unsupported ROM %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+// The same image behind MMC1, which powers up with the 32KB of PRG mapped
+// like NROM
+std::vector<uint8_t> AsMmc1(std::vector<uint8_t> rom) {
+	rom[6] = (rom[6] & 0x0F) | 0x10;
+	return rom;
+}
+
+// ---------------------------------------------------------------------------
+// Benchmarks
+
+constexpr uint64_t kCpuCycles = 2'000'000;
+
+// Instructions the interpreter retires in kCpuCycles. Native blocks retire
+// several instructions per boundary, so JIT runs reuse this count; both
+// backends are cycle exact.
+uint64_t CountInstructions(const std::vector<uint8_t>& rom) {
+	auto machine = std::make_unique<Machine>();
+	machine->LoadRom(rom);
+	auto& cpu = machine->GetCpu();
+	uint64_t instructions = 0;
+	for (uint64_t i = 0; i < kCpuCycles; ++i) {
+		instructions += cpu.GetCyclesLeft() == 0;
+		cpu.Tick();
+	}
+	return instructions;
+}
+
+// CPU alone, the PPU is not ticked
+Benchmark CpuBenchmark(const std::string& name, std::vector<uint8_t> rom, bool jit) {
+	const double instructions = CountInstructions(rom);
+	return {"cpu/" + name + (jit ? "/jit" : ""), "instr/s", [rom, jit, instructions] {
+		auto machine = std::make_unique<Machine>();
+		machine->LoadRom(rom);
+		auto& cpu = machine->GetCpu();
+		cpu.SetJitEnabled(jit);
+		return Measure(instructions, [&] {
+			for (uint64_t i = 0; i < kCpuCycles; ++i) {
+				cpu.Tick();
+			}
+		});
+	}};
+}
+
+Benchmark BusReadBenchmark(const std::string& name, uint16_t begin, uint16_t end, bool silent,
+			   std::vector<uint8_t> rom = AluProgram()) {
+	return {"bus_read/" + name, "reads/s", [begin, end, silent, rom] {
+		auto machine = std::make_unique<Machine>();
+		machine->LoadRom(rom);
+		auto& bus = machine->GetBus();
+		constexpr int kPasses = 64;
+		const uint32_t span = (uint32_t)end - begin + 1;
+		uint32_t sum = 0;
+		auto sample = Measure((double)kPasses * span, [&] {
+			for (int pass = 0; pass < kPasses; ++pass) {
+				for (uint32_t addr = begin; addr <= end; ++addr) {
+					sum += bus.Read(addr, silent);
+				}
+			}
+		});
+		gSink = sum;
+		return sample;
+	}};
+}
+
+Benchmark TileBenchmark() {
+	return {"tile/from_data", "tiles/s", [] {
+		RomImage rom;
+		rom.FillChr(0xBEEF);
+		auto image = rom.Build();
+		std::vector<uint8_t> chr(image.end() - 0x2000, image.end());
+		constexpr int kPasses = 2000;
+		Tile tile;
+		uint32_t sum = 0;
+		auto sample = Measure((double)kPasses * 512, [&] {
+			for (int pass = 0; pass < kPasses; ++pass) {
+				for (size_t i = 0; i < 512; ++i) {
+					tile.FromData(std::span<uint8_t>(chr.data() + i * 16, 16));
+					sum += tile.data[i % 64];
+				}
+			}
+		});
+		gSink = sum;
+		return sample;
+	}};
+}
+
+// Fixed VRAM/OAM contents written through the PPU ports, PPU ticked alone
+Benchmark PpuBenchmark() {
+	return {"ppu/frames", "frames/s", [] {
+		auto machine = std::make_unique<Machine>();
+		machine->LoadRom(PpuFixtureProgram());
+		auto& ppu = machine->GetPpu();
+		WritePpuFixture(machine->GetBus());
+
+		constexpr int kFrames = 30;
+		return Measure(kFrames, [&] {
+			for (int f = 0; f < kFrames; ++f) {
+				for (uint32_t dot = 0; dot < kScanlineRowCount * kScanlineColCount; ++dot) {
+					ppu.Tick();
+				}
+			}
+		});
+	}};
+}
+
+Benchmark SystemBenchmark(const std::string& name, std::vector<uint8_t> rom, bool skipIdle) {
+	return {"system/" + name + (skipIdle ? "" : "/no_idle_skip"), "frames/s", [rom, skipIdle] {
+		auto machine = std::make_unique<Machine>();
+		machine->LoadRom(rom);
+		machine->SetIdleLoopSkipping(skipIdle);
+		constexpr int kFrames = 60;
+		return Measure(kFrames, [&] {
+			for (int f = 0; f < kFrames; ++f) {
+				machine->RunFrame();
+			}
+		});
+	}};
+}
+
+std::vector<Benchmark> MakeBenchmarks(const Options& options) {
+	std::vector<Benchmark> res;
+	for (bool jit : {false, true}) {
+		if (jit && !Jit::IsSupported()) {
+			continue;
+		}
+		res.push_back(CpuBenchmark("alu", AluProgram(), jit));
+		res.push_back(CpuBenchmark("memory", MemoryProgram(), jit));
+		res.push_back(CpuBenchmark("call", CallProgram(), jit));
+	}
+	res.push_back(BusReadBenchmark("ram", 0x0000, 0x07FF, false));
+	res.push_back(BusReadBenchmark("ram_mirror", 0x0800, 0x1FFF, false));
+	res.push_back(BusReadBenchmark("ppu_silent", 0x2000, 0x3FFF, true));
+	res.push_back(BusReadBenchmark("prg", 0x8000, 0xFFFF, false));
+	res.push_back(BusReadBenchmark("prg_mmc1", 0x8000, 0xFFFF, false, AsMmc1(AluProgram())));
+	res.push_back(TileBenchmark());
+	res.push_back(PpuBenchmark());
+	res.push_back(SystemBenchmark("game", GameProgram(), true));
+	res.push_back(SystemBenchmark("game", GameProgram(), false));
+	res.push_back(SystemBenchmark("game_mmc1", AsMmc1(GameProgram()), false));
+	for (const auto& rom : options.roms) {
+		res.push_back(SystemBenchmark(rom.path, rom.image, true));
+	}
+	return res;
+}
+
+std::string EscapeJson(const std::string& str) {
+	std::string res;
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			res += '\\';
+		}
+		res += c;
+	}
+	return res;
+}
+
+void PrintUsage() {
+	tfm::printf("Usage: nes-bench [--reps N] [--filter SUBSTR] [--rom PATH]...\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	Options options;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--reps" && i + 1 < argc) {
+			options.repetitions = std::max(2, std::atoi(argv[++i]));
+		} else if (arg == "--filter" && i + 1 < argc) {
+			options.filter = argv[++i];
+		} else if (arg == "--rom" && i + 1 < argc) {
+			if (!LoadRomFile(argv[++i], options.roms.emplace_back())) {
+				return 1;
+			}
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+
+#ifdef NES_BUILD_TYPE
+	const std::string buildType = NES_BUILD_TYPE;
+#else
+	const std::string buildType;
+#endif
+	if (buildType != "Release" && buildType != "RelWithDebInfo") {
+		tfm::format(std::cerr, "WARNING: unoptimized build, configure with -DCMAKE_BUILD_TYPE=Release\n");
+	}
+
+	tfm::printf("{\n  \"build_type\": \"%s\",\n  \"repetitions\": %d,\n  \"jit_supported\": %s,\n  \"benchmarks\": [",
+		    EscapeJson(buildType), options.repetitions, Jit::IsSupported() ? "true" : "false");
+	bool first = true;
+	for (const auto& bench : MakeBenchmarks(options)) {
+		if (bench.name.find(options.filter) == std::string::npos) {
+			continue;
+		}
+
+		bench.run(); // warm up
+		std::vector<double> rates;
+		for (int rep = 0; rep < options.repetitions; ++rep) {
+			const auto sample = bench.run();
+			rates.push_back(sample.work / sample.seconds);
+		}
+
+		double mean = 0.0;
+		for (auto r : rates) {
+			mean += r;
+		}
+		mean /= rates.size();
+		double variance = 0.0;
+		for (auto r : rates) {
+			variance += (r - mean) * (r - mean);
+		}
+		variance /= rates.size() - 1;
+		const double stddev = std::sqrt(variance);
+		const auto [min, max] = std::minmax_element(rates.begin(), rates.end());
+
+		tfm::printf("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"mean\": %.6g, \"stddev\": %.6g, "
+			    "\"cv\": %.4f, \"min\": %.6g, \"max\": %.6g}",
+			    first ? "" : ",", EscapeJson(bench.name), bench.unit, mean, stddev,
+			    mean > 0 ? stddev / mean : 0.0, *min, *max);
+		first = false;
+		std::fflush(stdout);
+	}
+	tfm::printf("\n  ]\n}\n");
+	return 0;
+}
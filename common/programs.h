@@ -0,0 +1,166 @@
+#pragma once
+
+#include "nes/bus.h"
+#include "romimage.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace nes::testing {
+
+// Synthetic programs shared by nes-bench and nes-tests, all loop forever
+// from $8000.
+
+inline std::vector<uint8_t> AluProgram() {
+	RomImage rom;
+	const uint16_t start = rom.Here();
+	rom.Emit({0xA2, 0x00});                         // LDX #0
+	const uint16_t loop = rom.Here();
+	rom.Emit({0x8A, 0x18, 0x69, 0x13, 0x49, 0x5A}); // TXA CLC ADC EOR
+	rom.Emit({0x29, 0xF0, 0x09, 0x01, 0xA8, 0xC8}); // AND ORA TAY INY
+	rom.Emit({0x88, 0x0A, 0x4A, 0xE8, 0xE0, 0x80}); // DEY ASL LSR INX CPX
+	rom.Branch(0xD0, loop);                         // BNE
+	rom.Abs(0x4C, start);                           // JMP
+	return rom.Build();
+}
+
+inline std::vector<uint8_t> MemoryProgram() {
+	RomImage rom;
+	const uint16_t start = rom.Here();
+	rom.Emit({0xA9, 0x00, 0x85, 0x30, 0xA9, 0x04, 0x85, 0x31}); // ($30) = $0400
+	rom.Emit({0xA2, 0x00, 0xA0, 0x05});                         // LDX #0 LDY #5
+	const uint16_t loop = rom.Here();
+	rom.Emit({0xB5, 0x10});       // LDA $10,X
+	rom.Abs(0x9D, 0x0300);        // STA $0300,X
+	rom.Emit({0xE6, 0x20});       // INC $20
+	rom.Emit({0xB1, 0x30});       // LDA ($30),Y
+	rom.Abs(0x99, 0x0400);        // STA $0400,Y
+	rom.Abs(0xAD, 0x0200);        // LDA $0200
+	rom.Abs(0x8D, 0x0201);        // STA $0201
+	rom.Emit({0xE8});             // INX
+	rom.Branch(0xD0, loop);       // BNE
+	rom.Abs(0x4C, start);         // JMP
+	return rom.Build();
+}
+
+inline std::vector<uint8_t> CallProgram() {
+	RomImage rom;
+	const uint16_t sub = 0x8100;
+	const uint16_t start = rom.Here();
+	rom.Emit({0xA2, 0x00});       // LDX #0
+	const uint16_t loop = rom.Here();
+	rom.Abs(0x20, sub);           // JSR sub
+	rom.Emit({0x48, 0x68, 0xE8}); // PHA PLA INX
+	rom.Branch(0xD0, loop);       // BNE
+	rom.Abs(0x4C, start);         // JMP
+	rom.Org(sub).Emit({0xA5, 0x00, 0x69, 0x01, 0x85, 0x00, 0x60}); // LDA ADC STA RTS
+	return rom.Build();
+}
+
+// Game-like frame: fill OAM once, then per frame a block of work, wait for
+// the NMI flag; the NMI handler does OAM DMA and scrolls.
+inline std::vector<uint8_t> GameProgram() {
+	RomImage rom;
+	rom.FillChr(0x1234);
+	const uint16_t nmi = 0x8200;
+
+	rom.Emit({0xA9, 0x00, 0x85, 0x00, 0x85, 0x01}); // clear flags
+	rom.Emit({0xA2, 0x00});                         // LDX #0
+	const uint16_t fill = rom.Here();
+	rom.Emit({0x8A});                               // TXA
+	rom.Abs(0x9D, 0x0200);                          // STA $0200,X
+	rom.Emit({0xE8});                               // INX
+	rom.Branch(0xD0, fill);                         // BNE
+	rom.Emit({0xA9, 0x80}).Abs(0x8D, 0x2000);       // NMI on
+	rom.Emit({0xA9, 0x1E}).Abs(0x8D, 0x2001);       // show background and sprites
+
+	const uint16_t main = rom.Here();
+	rom.Emit({0xA0, 0x00});                         // LDY #0
+	const uint16_t work = rom.Here();
+	rom.Emit({0x98, 0x18, 0x69, 0x07, 0x45, 0x01}); // TYA CLC ADC EOR
+	rom.Abs(0x99, 0x0300);                          // STA $0300,Y
+	rom.Emit({0xC8});                               // INY
+	rom.Branch(0xD0, work);                         // BNE
+	const uint16_t wait = rom.Here();
+	rom.Emit({0xA5, 0x00});                         // LDA $00
+	rom.Branch(0xF0, wait);                         // BEQ
+	rom.Emit({0xA9, 0x00, 0x85, 0x00});             // clear flag
+	rom.Abs(0x4C, main);                            // JMP
+
+	rom.Org(nmi);
+	rom.Emit({0xE6, 0x00});                         // INC $00
+	rom.Emit({0xA9, 0x02}).Abs(0x8D, 0x4014);       // OAM DMA
+	rom.Emit({0xA5, 0x01}).Abs(0x8D, 0x2005).Abs(0x8D, 0x2005);
+	rom.Emit({0xE6, 0x01, 0x40});                   // INC $01 RTI
+	rom.SetVectors(nmi, RomImage::kPrgBase, RomImage::kPrgBase);
+	return rom.Build();
+}
+
+// Frame counter and DMC IRQs: a block of work that masks IRQs around a
+// RAM update, then a wait for the next IRQ. The handler acknowledges both
+// and restarts the one byte sample.
+inline std::vector<uint8_t> IrqProgram() {
+	RomImage rom;
+	const uint16_t irq = 0x8200;
+
+	rom.Emit({0x78});                               // SEI
+	rom.Emit({0xA9, 0x00}).Abs(0x8D, 0x4017);       // 4-step, frame IRQ on
+	rom.Emit({0xA9, 0x8F}).Abs(0x8D, 0x4010);       // DMC IRQ on, fastest rate
+	rom.Emit({0xA9, 0x10}).Abs(0x8D, 0x4015);       // start the sample
+	rom.Emit({0x58});                               // CLI
+
+	const uint16_t main = rom.Here();
+	rom.Emit({0xA0, 0x00});                         // LDY #0
+	const uint16_t work = rom.Here();
+	rom.Emit({0x98, 0x69, 0x05, 0x85, 0x03});       // TYA ADC STA $03
+	rom.Emit({0x78, 0xE6, 0x04, 0x58});             // SEI INC $04 CLI
+	rom.Emit({0xC8});                               // INY
+	rom.Branch(0xD0, work);                         // BNE
+	rom.Emit({0xA5, 0x02, 0x85, 0x05});             // remember the IRQ count
+	const uint16_t wait = rom.Here();
+	rom.Emit({0xA5, 0x02, 0xC5, 0x05});             // LDA $02 CMP $05
+	rom.Branch(0xF0, wait);                         // BEQ
+	rom.Abs(0x4C, main);                            // JMP
+
+	rom.Org(irq);
+	rom.Emit({0x48}).Abs(0xAD, 0x4015);             // PHA, acknowledge frame IRQ
+	rom.Emit({0xA9, 0x10}).Abs(0x8D, 0x4015);       // acknowledge DMC IRQ, restart
+	rom.Emit({0xE6, 0x02, 0x68, 0x40});             // INC $02 PLA RTI
+	rom.SetVectors(RomImage::kPrgBase, RomImage::kPrgBase, irq);
+	return rom.Build();
+}
+
+// Idle CPU with random tiles; pair with WritePpuFixture()
+inline std::vector<uint8_t> PpuFixtureProgram() {
+	RomImage rom;
+	rom.FillChr(0xC0DE);
+	const uint16_t self = rom.Here();
+	rom.Abs(0x4C, self); // JMP *
+	return rom.Build();
+}
+
+// Fixed nametable, palette and OAM contents written through the PPU ports,
+// rendering enabled
+inline void WritePpuFixture(Bus& bus) {
+	bus.Write(0x2006, 0x20);
+	bus.Write(0x2006, 0x00);
+	for (int i = 0; i < 0x800; ++i) {
+		bus.Write(0x2007, (i * 7) & 0xFF);
+	}
+	bus.Write(0x2006, 0x3F);
+	bus.Write(0x2006, 0x00);
+	for (int i = 0; i < 32; ++i) {
+		bus.Write(0x2007, (i * 5 + 1) & 0x3F);
+	}
+	bus.Write(0x2003, 0x00);
+	for (int i = 0; i < 64; ++i) {
+		bus.Write(0x2004, (i * 13) % 232); // Y
+		bus.Write(0x2004, i * 3);          // tile
+		bus.Write(0x2004, i & 0x23);       // attributes
+		bus.Write(0x2004, (i * 29) & 0xFF); // X
+	}
+	bus.Write(0x2000, 0x00);
+	bus.Write(0x2001, 0x1E);
+}
+
+} // namespace nes::testing
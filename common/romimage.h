@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+namespace nes::testing {
+
+// Synthetic NROM-256 image for benchmarks and tests: 32KB PRG mapped at
+// $8000, 8KB CHR ROM and a tiny cursor based emitter for 6502 code.
+class RomImage {
+public:
+	static constexpr uint16_t kPrgBase = 0x8000;
+
+	RomImage() {
+		prg_.fill(0xEA); // NOP
+		chr_.fill(0x00);
+		SetVectors(kPrgBase, kPrgBase, kPrgBase);
+	}
+
+	RomImage& Org(uint16_t addr) {
+		pc_ = addr;
+		return *this;
+	}
+
+	uint16_t Here() const {
+		return pc_;
+	}
+
+	RomImage& Emit(std::initializer_list<uint8_t> bytes) {
+		for (auto b : bytes) {
+			prg_[(pc_++ - kPrgBase) % prg_.size()] = b;
+		}
+		return *this;
+	}
+
+	// Relative branch opcode to an absolute target
+	RomImage& Branch(uint8_t opCode, uint16_t target) {
+		const int offset = (int)target - (int)(pc_ + 2);
+		return Emit({opCode, (uint8_t)(int8_t)offset});
+	}
+
+	RomImage& Abs(uint8_t opCode, uint16_t addr) {
+		return Emit({opCode, (uint8_t)(addr & 0xFF), (uint8_t)(addr >> 8)});
+	}
+
+	RomImage& SetVectors(uint16_t nmi, uint16_t reset, uint16_t irq) {
+		const uint16_t vectors[] = {nmi, reset, irq};
+		for (int i = 0; i < 3; ++i) {
+			prg_[0x7FFA + i * 2] = vectors[i] & 0xFF;
+			prg_[0x7FFB + i * 2] = vectors[i] >> 8;
+		}
+		return *this;
+	}
+
+	// Deterministic pseudo random tile data
+	RomImage& FillChr(uint32_t seed) {
+		for (auto& b : chr_) {
+			seed = seed * 1664525u + 1013904223u;
+			b = seed >> 24;
+		}
+		return *this;
+	}
+
+	std::vector<uint8_t> Build(bool verticalMirroring = false) const {
+		std::vector<uint8_t> rom = {'N', 'E', 'S', 0x1A, 2, 1,
+					    (uint8_t)(verticalMirroring ? 0x01 : 0x00), 0,
+					    0, 0, 0, 0, 0, 0, 0, 0};
+		rom.insert(rom.end(), prg_.begin(), prg_.end());
+		rom.insert(rom.end(), chr_.begin(), chr_.end());
+		return rom;
+	}
+
+private:
+	std::array<uint8_t, 0x8000> prg_;
+	std::array<uint8_t, 0x2000> chr_;
+	uint16_t pc_ = kPrgBase;
+};
+
+} // namespace nes::testing
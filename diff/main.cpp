@@ -0,0 +1,91 @@
+#include "nes/differential.h"
+#include "nes/jit.h"
+
+#include <tfm/tinyformat.h>
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace nes;
+
+namespace {
+
+std::optional<DifferentialRunner::Backend> ParseBackend(const std::string& name) {
+	if (name == "interpreter") {
+		return DifferentialRunner::Backend{name};
+	}
+	if (name == "jit") {
+		return DifferentialRunner::Backend{name, true};
+	}
+	if (name == "idle") {
+		return DifferentialRunner::Backend{name, false, true};
+	}
+	if (name == "jit-idle") {
+		return DifferentialRunner::Backend{name, true, true};
+	}
+	return std::nullopt;
+}
+
+void PrintUsage() {
+	tfm::printf("Usage: nes-diff [--a BACKEND] [--b BACKEND] [--frames N] [--per-frame]\n"
+		    "                [--jobs N] [--context N] ROM...\n"
+		    "Backends: interpreter, jit, idle, jit-idle (default: interpreter vs jit)\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	DifferentialRunner::Options options;
+	size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::string> roms;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if ((arg == "--a" || arg == "--b") && i + 1 < argc) {
+			auto backend = ParseBackend(argv[++i]);
+			if (!backend) {
+				PrintUsage();
+				return 1;
+			}
+			(arg == "--a" ? options.a : options.b) = *backend;
+		} else if (arg == "--frames" && i + 1 < argc) {
+			options.frames = std::atoi(argv[++i]);
+		} else if (arg == "--per-frame") {
+			options.granularity = DifferentialRunner::Granularity::kFrame;
+		} else if (arg == "--jobs" && i + 1 < argc) {
+			jobs = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--context" && i + 1 < argc) {
+			options.contextLength = std::atoi(argv[++i]);
+		} else if (!arg.empty() && arg[0] != '-') {
+			roms.push_back(arg);
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+	if (roms.empty()) {
+		PrintUsage();
+		return 1;
+	}
+	if ((options.a.jit || options.b.jit) && !Jit::IsSupported()) {
+		tfm::format(std::cerr, "WARNING: JIT not supported on this host, running the interpreter\n");
+	}
+
+	const DifferentialRunner runner(options);
+	int failures = 0;
+	for (const auto& res : runner.RunCorpus(roms, jobs)) {
+		if (!res.loaded) {
+			tfm::printf("SKIP %s: %s\n", res.name, res.report);
+			continue;
+		}
+		if (res.diverged) {
+			++failures;
+			tfm::printf("DIVERGED %s after %d frames\n%s", res.name, res.frames, res.report);
+			continue;
+		}
+		tfm::printf("OK %s: %d frames, %d comparisons\n", res.name, res.frames, res.comparisons);
+	}
+	return failures ? 2 : 0;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "nes/stepbuffer.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace nes {
+
+class Bus;
+
+// 2A03 audio: two pulse channels, triangle, noise, DMC and the frame
+// counter. The APU is not ticked with the CPU; it catches up to the
+// current CPU cycle when one of its registers is accessed or samples are
+// requested, jumping from one channel timer event to the next. Level
+// changes are mixed and handed to a StepBuffer as amplitude steps.
+class Apu2A03 {
+public:
+	static constexpr double kCpuClockRate = 1789773.0; // NTSC, Hz
+
+	enum Channel {
+		kPulse1,
+		kPulse2,
+		kTriangle,
+		kNoise,
+		kDmc,
+		kChannelCount,
+	};
+	static constexpr uint8_t kAllChannels = (1 << kChannelCount) - 1;
+
+	explicit Apu2A03(Bus* bus, uint32_t sampleRate = 44100);
+
+	// Power-up state, the timeline restarts at the bus' CPU cycle
+	void Reset();
+
+	// $4015 status, reading clears the frame interrupt unless silent
+	uint8_t Read(uint16_t addr, bool silent);
+	// $4000-$4013, $4015 and $4017
+	void Write(uint16_t addr, uint8_t val);
+
+	void SetSampleRate(uint32_t sampleRate);
+	uint32_t GetSampleRate() const;
+	// Output samples per nominal sample, slightly above 1 stretches the
+	// audio to refill a draining output queue
+	void SetResampleRatio(double ratio);
+	// Catches up to the current CPU cycle and takes the finished samples
+	size_t ReadSamples(std::span<float> out);
+	size_t GetSamplesAvailable();
+
+	// Channels mixed into the main output, bit n for Channel n
+	void SetChannelMask(uint8_t mask);
+	uint8_t GetChannelMask() const;
+
+	// Stems are extra outputs with one channel each, mixed as if the
+	// others were silent. They follow the main output's rate.
+	void SetStemsEnabled(bool enabled);
+	bool AreStemsEnabled() const;
+	size_t ReadStemSamples(Channel channel, std::span<float> out);
+
+	// Both catch up first
+	bool IsFrameIrqPending();
+	bool IsDmcIrqPending();
+	// Catches up, which publishes both IRQs to the bus. The bus calls this
+	// once the cycle the APU predicted for its next IRQ has come.
+	void SyncIrq();
+
+	// DMC sample fetches steal CPU cycles. The APU schedules its next
+	// fetch on the bus, which catches it up to cycle through this and
+	// charges the CPU for the fetches made since the last call.
+	uint32_t TakeDmcFetches(uint64_t cycle);
+
+private:
+	struct Envelope {
+		bool start = false;
+		bool loop = false;
+		bool constant = false;
+		uint8_t volume = 0; // also the divider period
+		uint8_t divider = 0;
+		uint8_t decay = 0;
+
+		void Clock();
+		uint8_t GetVolume() const;
+	};
+
+	struct Pulse {
+		bool enabled = false;
+		bool isFirst = false; // pulse 1 negates in one's complement
+		uint8_t duty = 0;
+		uint8_t step = 0;
+		uint16_t period = 0;
+		uint32_t timer = 2; // CPU cycles until the next sequencer step
+		uint8_t length = 0;
+		bool halt = false;
+		Envelope envelope;
+
+		bool sweepEnabled = false;
+		bool sweepNegate = false;
+		bool sweepReload = false;
+		uint8_t sweepPeriod = 0;
+		uint8_t sweepShift = 0;
+		uint8_t sweepDivider = 0;
+
+		uint16_t GetSweepTarget() const;
+		bool IsMuted() const;
+		bool IsAudible() const;
+		void ClockSweep();
+		uint8_t GetOutput() const;
+	};
+
+	struct Triangle {
+		bool enabled = false;
+		uint8_t step = 0;
+		uint16_t period = 0;
+		uint32_t timer = 1;
+		uint8_t length = 0;
+		bool control = false; // length counter halt and linear reload hold
+		uint8_t linearReload = 0;
+		uint8_t linearCounter = 0;
+		bool linearReloadFlag = false;
+
+		bool IsRunning() const;
+		void ClockLinear();
+		uint8_t GetOutput() const;
+	};
+
+	struct Noise {
+		bool enabled = false;
+		bool shortMode = false;
+		uint8_t periodIdx = 0;
+		uint16_t shift = 1;
+		uint32_t timer = 4;
+		uint8_t length = 0;
+		bool halt = false;
+		Envelope envelope;
+
+		bool IsAudible() const;
+		void Clock();
+		uint8_t GetOutput() const;
+	};
+
+	struct Dmc {
+		bool irqEnabled = false;
+		bool loop = false;
+		uint8_t rateIdx = 0;
+		uint32_t timer = 428;
+		uint8_t level = 0;
+
+		uint16_t sampleAddress = 0xC000;
+		uint16_t sampleLength = 1;
+		uint16_t currentAddress = 0xC000;
+		uint16_t bytesRemaining = 0;
+
+		uint8_t buffer = 0;
+		bool bufferFull = false;
+		uint8_t shift = 0;
+		uint8_t bitsRemaining = 8;
+		bool silence = true;
+		bool irq = false;
+		uint32_t fetches = 0; // not yet taken by the bus
+	};
+
+	Bus* bus_ = nullptr;
+
+	uint64_t now_ = 0; // CPU cycle the channels are at
+	Pulse pulse_[2];
+	Triangle triangle_;
+	Noise noise_;
+	Dmc dmc_;
+
+	bool fiveStep_ = false;
+	bool frameIrqInhibit_ = false;
+	bool frameIrq_ = false;
+	uint8_t frameStep_ = 0;
+	uint64_t frameStart_ = 0;
+	uint64_t nextFrameEvent_ = 0;
+
+	struct Output {
+		uint8_t mask = kAllChannels;
+		float level = 0.f;
+		StepBuffer buffer;
+	};
+	// Main output first, then the stems in channel order
+	std::vector<Output> outputs_;
+
+	// Channel levels at every change, mixed into all outputs a block at a
+	// time
+	static constexpr size_t kMixBlockSize = 64;
+	struct LevelBlock {
+		std::array<uint64_t, kMixBlockSize> time = {};
+		std::array<std::array<uint8_t, kMixBlockSize>, kChannelCount> level = {};
+		size_t count = 0;
+	};
+	LevelBlock levels_;
+	uint64_t lastLevels_ = UINT64_MAX; // packed, repeats are not recorded
+
+	void CatchUp();
+	void CatchUp(uint64_t target);
+	void RunChannels(uint64_t until);
+	void Advance(uint32_t cycles);
+	void ClockFrameCounter();
+	void ClockQuarterFrame();
+	void ClockHalfFrame();
+	void ScheduleFrameEvent();
+	bool IsDmcActive() const;
+	void ClockDmc();
+	void FillDmcBuffer();
+	void RestartDmc();
+	uint64_t GetNextDmcFetchCycle() const;
+	void ScheduleDmcFetch();
+	void ScheduleIrq();
+	void EndFrame();
+	void RecordLevels();
+	void MixBlock();
+	// After the outputs' masks changed
+	void Remix();
+};
+
+} // namespace nes
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <array>
+#include <optional>
 #include <span>
 
 #include "nes/cartridge.h"
@@ -9,6 +10,8 @@
 
 namespace nes {
 
+class Apu2A03;
+class Cpu6502;
 class Ppu2C02;
 
 class Bus {
@@ -17,25 +20,106 @@ public:
 	std::span<uint8_t> ReadN(uint16_t addr, uint16_t count);
 	void Write(uint16_t addr, uint8_t val);
 
-	uint8_t ReadChr(uint16_t addr);
-	std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count);
+	uint8_t ReadChr(uint16_t addr) {
+		return cartridge_->ReadChar(addr);
+	}
+	std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) {
+		return cartridge_->ReadChrN(addr, count);
+	}
+	// Reaches CHR RAM, CHR ROM ignores it
+	void WriteChr(uint16_t addr, uint8_t val) {
+		cartridge_->WriteChar(addr, val);
+	}
+	// Called by the PPU at the predicted A12 rise of each rendered line
+	void ClockScanlineCounter();
+	bool IsCartridgeIrqPending() const;
+	// Whether the cartridge raises its IRQ at the next scanline clock
+	bool IsCartridgeIrqDueNextScanline() const;
 
+	// Power-up state: clears RAM, interrupts and DMA, keeps the attached
+	// components
+	void Reset();
 	void InsertCartridge(Cartridge* cart);
 	void AttachPPU(Ppu2C02* ppu);
+	void AttachAPU(Apu2A03* apu);
+	void AttachCPU(Cpu6502* cpu);
 	void AttachController(Controller* con, bool playerOne);
 	void TriggerNMI();
-	void TriggerDMA();
 	bool CheckNMI();
-	bool CheckDMA();
+	bool IsNMIPending() const;
+
+	// The IRQ line is wired-OR: asserted while any source holds it
+	enum IrqSource : uint8_t {
+		kIrqApuFrame = 1 << 0,
+		kIrqApuDmc = 1 << 1,
+		kIrqCartridge = 1 << 2,
+	};
+	void SetIrq(IrqSource source, bool asserted);
+	// The APU catches up lazily, so it also publishes the earliest cycle
+	// it could assert the line at (UINT64_MAX for never)
+	void ScheduleApuIrq(uint64_t cycle);
+	// Catches the APU up when its deadline has passed
+	bool IsIrqAsserted();
+	// First cycle the CPU has to look at its interrupt inputs: 0 while an
+	// NMI is pending or the IRQ line is asserted, otherwise the APU
+	// deadline. With irqMasked only an NMI counts. The references stay
+	// valid, so one compare per instruction covers all inputs.
+	const uint64_t& GetInterruptCycle(bool irqMasked = false) const;
+
+	// DMA units take the bus from the CPU at scheduled cycles. An OAM DMA
+	// starts with the next instruction, a DMC sample fetch at the cycle
+	// the APU predicts (UINT64_MAX for none).
+	void ScheduleOamDma(uint8_t page);
+	void ScheduleDmcDma(uint64_t cycle);
+	uint64_t GetNextDmaCycle() const;
+	// Performs the transfers due by the time the CPU would start its next
+	// instruction at cycle, returns the cycles they steal from it
+	uint32_t RunDma(uint64_t cycle);
+
+	// Support for the CPU decoded block cache: writes to a page holding
+	// decoded code, or to mapper registers, bump the code generation
+	uint32_t GetPrgBankId(uint16_t addr);
+	void MarkCodePage(uint16_t addr);
+	uint32_t GetCodeGeneration() const;
+
+	// CPU cycles that can run ahead of the PPU without missing an NMI or
+	// a cartridge IRQ
+	uint32_t GetCyclesUntilPpuEvent() const;
+	uint8_t* GetRamData();
+	uint32_t GetPpuDotIndex() const;
+	// Clock for components that catch up lazily, e.g. the APU
+	uint64_t GetCpuCycle() const;
+
+	// Order independent fingerprint of internal RAM kept up to date by
+	// Write(), so comparing two machines costs O(1). Changes made through
+	// GetRamData() are not tracked.
+	uint64_t GetRamHash() const;
 private:
 	Cartridge* cartridge_ = nullptr;
 	Ppu2C02* ppu_ = nullptr;
+	Apu2A03* apu_ = nullptr;
+	Cpu6502* cpu_ = nullptr;
 	Controller* controller1_ = nullptr;
 	Controller* controller2_ = nullptr;
 	bool triggerNMI_ = false;
-	bool triggerDMA_ = false;
+	uint8_t irqLine_ = 0; // IrqSource bits
+	uint64_t apuIrqCycle_ = UINT64_MAX;
+	uint64_t interruptCycle_ = UINT64_MAX;
+	uint64_t nmiCycle_ = UINT64_MAX;
+
+	void UpdateInterruptCycle();
+
+	std::optional<uint8_t> oamDmaPage_;
+	uint64_t dmcDmaCycle_ = UINT64_MAX;
+	uint64_t nextDmaCycle_ = UINT64_MAX;
+
+	void CopyOamPage(uint8_t page);
+
+	std::array<bool, 256> codePages_ = {};
+	uint32_t codeGeneration_ = 0;
 
-	std::array<uint8_t, 2048> memory_;
+	std::array<uint8_t, 2048> memory_ = {};
+	uint64_t ramHash_ = 0;
 };
 
 } // namespace nes
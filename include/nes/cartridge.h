@@ -1,32 +1,75 @@
 #pragma once
 
-#include "nes/mappers/mapperbase.h"
+#include "nes/mappers/mapperfactory.h"
 
 #include <string>
 #include <memory>
 #include <cstdint>
+#include <span>
+#include <type_traits>
+#include <variant>
 
 namespace nes {
 
 class Cartridge {
 public:
 	bool LoadFile(const std::string& filePath);
+	bool LoadData(std::span<const uint8_t> data);
+	// Power-up mapper state for the loaded image
+	void Reset();
 
-	uint8_t ReadPrg(uint16_t addr);
-	std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count);
-	void WritePrg(uint16_t addr, uint8_t val);
-	uint8_t ReadChar(uint16_t addr);
-	std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count);
-	void WriteChar(uint16_t addr, uint8_t val);
+	// Defined here so the mapper's reads inline into the callers
+	uint8_t ReadPrg(uint16_t addr) {
+		return Dispatch<uint8_t>(mapper_, [&](auto& m) { return m.ReadPrg(addr); });
+	}
+	std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count) {
+		return Dispatch<std::span<uint8_t>>(mapper_, [&](auto& m) { return m.ReadPrgN(addr, count); });
+	}
+	void WritePrg(uint16_t addr, uint8_t val) {
+		Dispatch<void>(mapper_, [&](auto& m) { m.WritePrg(addr, val); });
+	}
+	uint32_t GetPrgBankId(uint16_t addr) {
+		return Dispatch<uint32_t>(mapper_, [&](auto& m) { return m.GetPrgBankId(addr); });
+	}
+	uint8_t ReadChar(uint16_t addr) {
+		return Dispatch<uint8_t>(mapper_, [&](auto& m) { return m.ReadChar(addr); });
+	}
+	std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) {
+		return Dispatch<std::span<uint8_t>>(mapper_, [&](auto& m) { return m.ReadChrN(addr, count); });
+	}
+	void WriteChar(uint16_t addr, uint8_t val) {
+		Dispatch<void>(mapper_, [&](auto& m) { m.WriteChar(addr, val); });
+	}
+	void ClockScanline() {
+		Dispatch<void>(mapper_, [](auto& m) { m.ClockScanline(); });
+	}
+	bool IsIrqPending() const {
+		return Dispatch<bool>(mapper_, [](const auto& m) { return m.IsIrqPending(); });
+	}
+	bool IsIrqDueNextScanline() const {
+		return Dispatch<bool>(mapper_, [](const auto& m) { return m.IsIrqDueNextScanline(); });
+	}
 private:
 
 	std::unique_ptr<uint8_t[]> buffer_;
 	size_t bufferSize_ = 0;
 
 	RomDescriptor descriptor_;
-	std::unique_ptr<mapper::MapperBase> mapper_;
+	mapper::AnyMapper mapper_;
 
 	bool Init();
+
+	// Calls f with the loaded mapper, returns R() while there is none
+	template<typename R, typename Mapper, typename F>
+	static R Dispatch(Mapper& mapper, F&& f) {
+		return std::visit([&](auto& m) -> R {
+			if constexpr (std::is_same_v<std::decay_t<decltype(m)>, std::monostate>) {
+				return R();
+			} else {
+				return f(m);
+			}
+		}, mapper);
+	}
 };
 
 } // namespace nes
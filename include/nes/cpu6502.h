@@ -1,7 +1,16 @@
 #pragma once
 
 #include "nes/bus.h"
+#include "nes/cputrace.h"
 #include "nes/instructions.h"
+#include "nes/jit.h"
+#include "nes/profiler.h"
+#include "nes/seqlock.h"
+
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 namespace nes {
 
@@ -21,10 +30,37 @@ class Cpu6502 {
 public:
 	Cpu6502(Bus* bus);
 
+	// Power-up registers, PC from the reset vector
 	void Reset();
 	void Tick();
 
-	const CpuState& GetState() const;
+	// Registers as of the last instruction boundary, taken on demand
+	CpuState GetState() const;
+
+	// Publishes the state after every instruction for readers on other
+	// threads; nullptr detaches. Nothing is copied while detached.
+	void SetStateSnapshot(SeqLock<CpuState>* snapshot);
+
+	// Feeds every interpreted instruction to the profiler; nullptr detaches.
+	// The JIT is bypassed while a profiler is attached.
+	void SetProfiler(CpuProfiler* profiler);
+
+#ifdef NES_CPU_TRACE
+	// Last executed instructions in nestest.log format, oldest first
+	void DumpTrace(std::ostream& out) const;
+	CpuTrace& GetTrace();
+#endif
+
+	// Register transfer for external cores, valid between instructions
+	CpuState CaptureState() const;
+	void SetState(const CpuState& state, uint16_t cyclesLeft = 0);
+	uint16_t GetCyclesLeft() const;
+	uint64_t GetCycle() const;
+
+	// Runs hot ROM blocks as native code where the host supports it. Off by
+	// default; the interpreter remains the reference.
+	void SetJitEnabled(bool enabled);
+	bool IsJitEnabled() const;
 
 private:
 	enum Flag {
@@ -44,28 +80,100 @@ private:
 		bool boundaryCrossed = false;
 	};
 
-	uint16_t pc_;
-	uint8_t acc_;
-	uint8_t x_;
-	uint8_t y_;
-	uint8_t stackPtr_;
-	uint8_t status_;
+	using Handler = void (Cpu6502::*)(Operation, Operand);
+
+	// Instruction with its operand bytes already fetched from PRG
+	struct DecodedOp {
+		Handler handler = nullptr;
+		Operation op;
+		uint16_t pc = 0;
+		uint8_t LL = 0;
+		uint8_t HH = 0;
+		uint8_t size = 0;
+		uint8_t opCode = 0;
+		bool readsMemory = false; // value at the effective address is needed
+	};
+
+	// Straight-line run of instructions ending at the first branch or jump
+	struct Block {
+		std::vector<DecodedOp> ops;
+		bool inRam = false;
+		uint32_t generation = 0; // Bus code generation at decode time
+
+		bool mayUnmaskIrq = false; // holds CLI, PLP or RTI
+
+		uint32_t hits = 0;
+		bool jitFailed = false;
+		Jit::Translation native;
+	};
+
+	uint16_t pc_ = 0;
+	uint8_t acc_ = 0;
+	uint8_t x_ = 0;
+	uint8_t y_ = 0;
+	uint8_t stackPtr_ = 0;
+	uint8_t status_ = 0; // I, D, B, X; N, V, Z, C bits are stale
+
+	// N, Z, C and V are evaluated lazily: N is bit 7 of nSource_, Z is set
+	// when zSource_ is zero. GetStatus() composes the architectural P.
+	uint8_t nSource_ = 0;
+	uint8_t zSource_ = 1;
+	bool carry_ = false;
+	bool overflow_ = false;
 
 	uint64_t cycle_ = 0;
-	uint8_t cycleLeft_ = 0;
+	uint16_t cycleLeft_ = 0;
+
+	// CLI, SEI and PLP change I after the interrupt poll of the next
+	// instruction boundary; that poll still sees the old flag
+	uint64_t irqMaskDelayEnd_ = 0;
+	bool irqMaskBefore_ = true;
+	// Bus deadline Tick() compares against, the NMI one while masked
+	const uint64_t* interruptCycle_ = nullptr;
 
 	Bus* bus_ = nullptr;
 
-	CpuState cpuState_;
+	SeqLock<CpuState>* stateSnapshot_ = nullptr;
+	CpuProfiler* profiler_ = nullptr;
+
+#ifdef NES_CPU_TRACE
+	CpuTrace trace_;
+#endif
+
+	// Decoded blocks keyed by PRG bank id and start PC
+	std::unordered_map<uint64_t, Block> blocks_;
+	Block uncachedBlock_;
+	Block* block_ = nullptr;
+	size_t blockPos_ = 0;
+	uint32_t blockGeneration_ = 0;
 
-	Operand FetchOperand(AddressMode m);
+	const DecodedOp& NextOp();
+	Block& LookupBlock(uint16_t pc);
+	void DecodeBlock(Block& block, uint16_t pc, size_t maxOps);
+	static Handler GetHandler(Instruction instr);
+
+	std::unique_ptr<Jit> jit_;
+	Jit::Context jitContext_;
+
+	bool RunNative();
+	void Profile(const DecodedOp& decoded);
+
+	// Returns true when an IRQ sequence took this instruction's cycle
+	bool PollInterrupts();
+	void DelayIrqMask(bool before);
+	void SetIrqMasked(bool masked);
+
+	// Effective address and page crossing; the memory value is only read by
+	// Tick() for instructions that consume it
+	Operand ResolveOperand(AddressMode m, uint8_t opLL, uint8_t opHH);
 	bool IsSet(Flag f) const;
 	void SetFlag(Flag f, bool active);
+	uint8_t GetStatus() const;
+	void SetStatus(uint8_t status);
+	void SetNZ(uint8_t val);
 	void PushStack(uint8_t val);
 	uint8_t PopStack();
 
-	void UpdateState();
-
 	void ADC(Operation op, Cpu6502::Operand operand);
 	void AND(Operation op, Cpu6502::Operand operand);
 	void ASL(Operation op, Cpu6502::Operand operand);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+namespace nes {
+
+// One executed instruction as seen before it ran. Timing is packed into 48
+// bits: the low 31 bits of the CPU cycle and the PPU dot within the frame
+// (scanline * 341 + dot), so an entry is written with a single 16 byte store.
+struct alignas(16) TraceEntry {
+	uint16_t pc = 0;
+	uint8_t code[3] = {};
+	uint8_t acc = 0;
+	uint8_t x = 0;
+	uint8_t y = 0;
+	uint8_t stackPtr = 0;
+	uint8_t status = 0;
+	uint16_t timing[3] = {};
+
+	static constexpr uint32_t kCycleBits = 31;
+	static constexpr uint32_t kDotBits = 17;
+
+	void SetTiming(uint64_t cycle, uint32_t dot) {
+		const uint64_t packed = (cycle & ((1ull << kCycleBits) - 1)) << kDotBits | dot;
+		timing[0] = packed;
+		timing[1] = packed >> 16;
+		timing[2] = packed >> 32;
+	}
+	uint32_t GetCycleLow() const {
+		return (timing[0] | (uint64_t)timing[1] << 16 | (uint64_t)timing[2] << 32) >> kDotBits;
+	}
+	uint32_t GetDot() const {
+		return (timing[0] | (uint32_t)timing[1] << 16) & ((1u << kDotBits) - 1);
+	}
+};
+static_assert(sizeof(TraceEntry) == 16);
+
+// Ring buffer of the most recent instructions, filled by Cpu6502::Tick()
+// when built with NES_CPU_TRACE.
+class CpuTrace {
+public:
+	// Capacity is rounded up to a power of two
+	explicit CpuTrace(size_t capacity = 1 << 16);
+
+	void Record(const TraceEntry& entry) {
+		entries_[head_++ & mask_] = entry;
+	}
+	void Clear();
+	size_t GetSize() const;
+
+	// Oldest first in nestest.log layout. currentCycle is the CPU cycle at
+	// export time and restores the full cycle counts.
+	void Export(std::ostream& out, uint64_t currentCycle) const;
+
+private:
+	std::unique_ptr<TraceEntry[]> entries_;
+	size_t mask_ = 0;
+	size_t head_ = 0;
+};
+
+} // namespace nes
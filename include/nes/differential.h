@@ -0,0 +1,89 @@
+#pragma once
+
+#include "nes/cpu6502.h"
+#include "nes/machine.h"
+#include "nes/ppu.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nes {
+
+// Runs the same ROM on two machines configured as different backends and
+// compares them while they run. At instruction granularity CPU registers,
+// the RAM hash and the PPU registers are compared at every instruction
+// boundary both machines share; nametables, OAM, palettes and the picture
+// are compared at every frame.
+class DifferentialRunner {
+public:
+	struct Backend {
+		Backend(std::string name, bool jit = false, bool skipIdleLoops = false)
+		: name(std::move(name)), jit(jit), skipIdleLoops(skipIdleLoops) {}
+
+		std::string name;
+		bool jit = false;
+		bool skipIdleLoops = false;
+		// Runs after the ROM is loaded, e.g. to poke RAM or set input
+		std::function<void(Machine&)> setup;
+	};
+
+	enum class Granularity {
+		kInstruction,
+		kFrame,
+	};
+
+	struct Options {
+		Backend a = {"interpreter"};
+		Backend b = {"jit", true};
+		Granularity granularity = Granularity::kInstruction;
+		uint32_t frames = 600;
+		// Instructions listed per side in reports, only recorded at
+		// instruction granularity
+		size_t contextLength = 16;
+	};
+
+	struct Result {
+		std::string name;
+		bool loaded = false;
+		bool diverged = false;
+		uint32_t frames = 0;       // frames that matched
+		uint64_t comparisons = 0;
+		std::string report;        // first divergence with trace context
+	};
+
+	explicit DifferentialRunner(Options options);
+
+	Result Run(const std::string& name, std::span<const uint8_t> rom) const;
+
+	// Runs every ROM file on its own pair of machines, using up to jobs
+	// threads. Results are in input order.
+	std::vector<Result> RunCorpus(const std::vector<std::string>& paths, size_t jobs) const;
+
+private:
+	// Instruction boundary as seen by one side
+	struct TraceLine {
+		CpuState cpu;
+		uint8_t code[3] = {};
+	};
+
+	struct Side {
+		const Backend* backend = nullptr;
+		std::unique_ptr<Machine> machine;
+		std::deque<TraceLine> trace;
+	};
+
+	Options options_;
+
+	bool Setup(Side& side, std::span<const uint8_t> rom) const;
+	void Advance(Side& side) const;
+	std::string CompareBoundary(Side& a, Side& b) const;
+	std::string CompareFrame(Side& a, Side& b) const;
+	std::string Report(const std::string& what, uint32_t frame, const Side& a, const Side& b) const;
+};
+
+} // namespace nes
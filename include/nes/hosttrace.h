@@ -0,0 +1,111 @@
+#pragma once
+
+// Host side timing zones. Built with NES_HOST_TRACE the macros record
+// begin/end timestamps into per-thread buffers; otherwise they expand to
+// nothing.
+//
+//   NES_TRACE_ZONE("Ppu2C02::DrawSpriteLayer"); // until end of scope
+//   NES_TRACE_FRAME();                          // emulated frame boundary
+
+#ifdef NES_HOST_TRACE
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace nes::trace {
+
+inline uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Zone with end == begin and name == nullptr marks a frame boundary
+struct Event {
+	const char* name = nullptr;
+	uint64_t begin = 0;
+	uint64_t end = 0;
+};
+
+// Single producer ring owned by one thread; exporters read up to the
+// published head and may see overwritten entries only after a wrap.
+class ThreadBuffer {
+public:
+	static constexpr size_t kCapacity = 1 << 20;
+
+	explicit ThreadBuffer(uint32_t threadId);
+
+	void Push(const Event& e) {
+		const auto head = head_.load(std::memory_order_relaxed);
+		events_[head & (kCapacity - 1)] = e;
+		head_.store(head + 1, std::memory_order_release);
+	}
+
+	uint32_t GetThreadId() const;
+	// Readable events are [GetTail(), GetHead())
+	size_t GetHead() const;
+	size_t GetTail() const;
+	const Event& At(size_t idx) const;
+	void Discard();
+
+private:
+	uint32_t threadId_ = 0;
+	std::unique_ptr<Event[]> events_;
+	std::atomic<size_t> head_ = 0;
+	std::atomic<size_t> tail_ = 0;
+};
+
+// Registers the calling thread on first use
+ThreadBuffer& GetThreadBuffer();
+
+class Zone {
+public:
+	explicit Zone(const char* name)
+	: name_(name)
+	, begin_(Now()) {}
+	~Zone() {
+		GetThreadBuffer().Push({name_, begin_, Now()});
+	}
+	Zone(const Zone&) = delete;
+	Zone& operator=(const Zone&) = delete;
+
+private:
+	const char* name_;
+	uint64_t begin_;
+};
+
+inline void MarkFrame() {
+	const auto now = Now();
+	GetThreadBuffer().Push({nullptr, now, now});
+}
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto)
+void WriteChromeTrace(std::ostream& out);
+// Per zone mean and max inclusive time per emulated frame
+void WriteFrameSummary(std::ostream& out);
+// Drops recorded events of all threads
+void Reset();
+
+} // namespace nes::trace
+
+#define NES_TRACE_CONCAT_IMPL(a, b) a##b
+#define NES_TRACE_CONCAT(a, b) NES_TRACE_CONCAT_IMPL(a, b)
+#define NES_TRACE_ZONE(name) ::nes::trace::Zone NES_TRACE_CONCAT(nesTraceZone, __LINE__){name}
+#define NES_TRACE_FRAME() ::nes::trace::MarkFrame()
+
+#else
+
+#define NES_TRACE_ZONE(name) static_cast<void>(0)
+#define NES_TRACE_FRAME() static_cast<void>(0)
+
+#endif // NES_HOST_TRACE
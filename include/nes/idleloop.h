@@ -0,0 +1,66 @@
+#pragma once
+
+#include "nes/cpu6502.h"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace nes {
+
+class Bus;
+class Ppu2C02;
+
+// Detects short side effect free loops (JMP *, LDA $2002 / BPL, waiting on
+// a RAM flag) and fast-forwards them: once an iteration leaves the CPU in
+// the same state it started in, further iterations only tick the PPU until
+// an NMI is pending or a polled PPUSTATUS value changes. The CPU is then
+// handed back at the exact instruction and cycle it would have reached.
+class IdleLoopSkipper {
+public:
+	IdleLoopSkipper(Bus* bus, Cpu6502* cpu, Ppu2C02* ppu);
+
+	// Call at an instruction boundary after the PPU dots of the cycle, in
+	// place of Cpu6502::Tick(). Returns true if the cycle was consumed;
+	// skipping stops at the end of the PPU frame frameId.
+	bool OnBoundary(uint8_t frameId);
+	void Reset();
+
+	uint64_t GetSkippedCycles() const;
+
+private:
+	struct Step {
+		CpuState state;
+		uint32_t duration = 0;
+		std::optional<uint16_t> volatileAddr;
+		uint8_t volatileValue = 0;
+	};
+
+	enum class Mode {
+		kSearching,
+		kRecording,
+		kSkipping,
+	};
+
+	Bus* bus_;
+	Cpu6502* cpu_;
+	Ppu2C02* ppu_;
+
+	Mode mode_ = Mode::kSearching;
+	uint16_t lastPc_ = 0;
+	uint16_t head_ = 0;
+	uint16_t tail_ = 0; // the instruction jumping back to head_
+	uint32_t attempts_ = 0;
+	std::vector<Step> steps_;
+	std::array<uint16_t, 16> rejected_{};
+	uint64_t skippedCycles_ = 0;
+
+	bool Record(const CpuState& state);
+	bool AddStep(const CpuState& state);
+	void Reject(uint16_t pc);
+	bool IsRejected(uint16_t pc) const;
+	bool Skip(uint8_t frameId);
+};
+
+} // namespace nes
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "nes/instructions.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace nes {
+
+class Bus;
+
+// Instruction of a decoded block as handed to the recompiler
+struct JitOp {
+	Operation op;
+	uint16_t pc = 0;
+	uint8_t LL = 0;
+	uint8_t HH = 0;
+	uint8_t size = 0;
+};
+
+// Translates hot decoded blocks into x86-64 code. A translation covers the
+// longest prefix of a block made of supported instructions that only touch
+// internal RAM or cartridge reads; I/O accesses leave through side exits
+// so the interpreter runs them in PPU time. Registers live in host
+// registers for the whole block and N/Z are kept as the last result byte.
+// On other hosts translation always fails and the interpreter runs alone.
+class Jit {
+public:
+	// Register file handed to and returned from translated code. Flags are
+	// split: N is bit 7 of nSource, Z is set when zSource is zero.
+	struct Context {
+		uint8_t* ram = nullptr;
+		Bus* bus = nullptr;
+		uint32_t cycles = 0;  // CPU cycles consumed, including fetch cycles
+		uint32_t opCount = 0; // instructions executed before leaving
+		uint16_t pc = 0;
+		uint8_t acc = 0;
+		uint8_t x = 0;
+		uint8_t y = 0;
+		uint8_t stackPtr = 0;
+		uint8_t status = 0; // I, D, B, X; stale N, V, Z, C
+		uint8_t carry = 0;
+		uint8_t overflow = 0;
+		uint8_t nSource = 0;
+		uint8_t zSource = 0;
+	};
+
+	using BlockFn = void (*)(Context*);
+
+	struct Translation {
+		BlockFn fn = nullptr;
+		uint8_t opCount = 0;
+		uint8_t maxCycles = 0; // upper bound of Context::cycles
+	};
+
+	static bool IsSupported();
+
+	Jit();
+	~Jit();
+	Jit(const Jit&) = delete;
+	Jit& operator=(const Jit&) = delete;
+
+	Translation Translate(std::span<const JitOp> ops);
+
+	// Drops all translations, previously returned functions become invalid
+	void Clear();
+
+private:
+	uint8_t* code_ = nullptr;
+	size_t codeSize_ = 0;
+	size_t codeUsed_ = 0;
+};
+
+} // namespace nes
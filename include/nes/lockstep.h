@@ -0,0 +1,61 @@
+#pragma once
+
+#include "nes/cpu6502.h"
+#include "nes/machine.h"
+
+#include <array>
+#include <cstdint>
+
+namespace nes {
+
+// Experimental multi-lane CPU core for running many instances of the same
+// ROM. Register files of all lanes are held structure-of-arrays; when the
+// lanes sitting at an instruction boundary share PC and code bytes, the
+// instruction is executed for all of them with masked, branch free lane
+// loops. Memory touching instructions and diverged lanes fall back to the
+// lane's own scalar Cpu6502.
+class LockstepCpu {
+public:
+	static constexpr size_t kLaneCount = 8;
+
+	struct Stats {
+		uint64_t vectorInstructions = 0; // counted per lane
+		uint64_t scalarInstructions = 0;
+	};
+
+	LockstepCpu(std::array<Machine*, kLaneCount> lanes);
+
+	// Pulls register files from the lanes' scalar cores
+	void Reset();
+	// One CPU cycle (and three PPU dots) on every lane
+	void Tick();
+	void RunFrame();
+
+	CpuState GetLaneState(size_t lane) const;
+	const Stats& GetStats() const;
+
+private:
+	template<typename T>
+	using Lanes = std::array<T, kLaneCount>;
+	using LaneMask = Lanes<uint8_t>; // 0x00 or 0xFF per lane
+
+	std::array<Machine*, kLaneCount> lanes_;
+
+	alignas(32) Lanes<uint16_t> pc_;
+	alignas(32) Lanes<uint8_t> acc_;
+	alignas(32) Lanes<uint8_t> x_;
+	alignas(32) Lanes<uint8_t> y_;
+	alignas(32) Lanes<uint8_t> stackPtr_;
+	alignas(32) Lanes<uint8_t> status_;
+	alignas(32) Lanes<uint16_t> cycleLeft_;
+	alignas(32) Lanes<uint64_t> cycle_;
+
+	Stats stats_;
+
+	bool ExecuteVector(const LaneMask& mask, uint16_t pc, uint8_t opCode,
+			   uint8_t lo, uint8_t hi);
+	void ExecuteScalar(size_t lane);
+	void LoadLane(size_t lane);
+};
+
+} // namespace nes
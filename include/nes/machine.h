@@ -0,0 +1,66 @@
+#pragma once
+
+#include "nes/apu.h"
+#include "nes/bus.h"
+#include "nes/cartridge.h"
+#include "nes/controller.h"
+#include "nes/cpu6502.h"
+#include "nes/idleloop.h"
+#include "nes/ppu.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+namespace nes {
+
+// Headless console: one cartridge, CPU, PPU, APU and two controllers wired
+// onto a private bus. Not movable, components keep pointers to the bus.
+class Machine {
+public:
+	Machine();
+	Machine(const Machine&) = delete;
+	Machine& operator=(const Machine&) = delete;
+
+	bool LoadRom(std::span<const uint8_t> rom);
+	// Power cycles the console with the loaded cartridge, like a new
+	// Machine loading the same ROM but without allocating. The installed
+	// framebuffers or observation output stay in place.
+	void Reset();
+
+	// Runs until the PPU enters VBlank, i.e. one full picture was written
+	// to the active framebuffer.
+	void RunFrame();
+	// One CPU cycle with its three PPU dots. With idle loop skipping an
+	// instruction boundary may fast-forward up to the end of the frame.
+	void Step();
+
+	// Fast-forwards side effect free polling loops, enabled by default
+	void SetIdleLoopSkipping(bool enabled);
+	const IdleLoopSkipper& GetIdleLoopSkipper() const;
+
+	Bus& GetBus();
+	Cpu6502& GetCpu();
+	Ppu2C02& GetPpu();
+	Apu2A03& GetApu();
+	Controller& GetController(bool playerOne);
+
+	// Framebuffers owned by the machine, installed on construction.
+	std::array<RGBA*, 2> GetOwnFramebuffers();
+
+private:
+	Bus bus_;
+	Cartridge cartridge_;
+	Cpu6502 cpu_;
+	Ppu2C02 ppu_;
+	Apu2A03 apu_;
+	Controller con1_;
+	Controller con2_;
+	IdleLoopSkipper idleLoopSkipper_;
+	bool skipIdleLoops_ = true;
+
+	std::array<std::unique_ptr<RGBA[]>, 2> frameBuffers_;
+};
+
+} // namespace nes
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace nes::mapper {
+
+// An address range split into equally sized windows, each pointing at a
+// bank of ROM or RAM. Reads resolve through the pointers, only bank
+// switches go through mapper logic.
+template<uint32_t WindowSize, size_t WindowCount>
+class BankWindows {
+public:
+	static constexpr uint32_t kWindowSize = WindowSize;
+	static constexpr size_t kWindowCount = WindowCount;
+
+	// Points window at bank, counted in window sized units from data
+	void Map(size_t window, uint8_t* data, uint32_t bank) {
+		pointers_[window] = data + (size_t)bank * kWindowSize;
+		banks_[window] = bank;
+	}
+
+	// offset is relative to the start of the first window
+	uint8_t* Resolve(uint32_t offset) const {
+		return pointers_[offset / kWindowSize] + offset % kWindowSize;
+	}
+
+	uint32_t GetBank(uint32_t offset) const {
+		return banks_[offset / kWindowSize];
+	}
+
+private:
+	std::array<uint8_t*, kWindowCount> pointers_ = {};
+	std::array<uint32_t, kWindowCount> banks_ = {};
+};
+
+} // namespace nes::mapper
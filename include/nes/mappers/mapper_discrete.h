@@ -0,0 +1,112 @@
+#pragma once
+
+#include "nes/mappers/bankwindows.h"
+#include "nes/mappers/mapperbase.h"
+
+#include <assert.h>
+#include <memory>
+
+namespace nes::mapper {
+
+// Bits of a board's bank latch that select a bank: (latch >> shift) & mask
+struct LatchField {
+	uint8_t shift = 0;
+	uint8_t mask = 0;
+
+	constexpr uint32_t Decode(uint8_t latch) const {
+		return (latch >> shift) & mask;
+	}
+};
+
+// Boards built from discrete logic: one latch written anywhere in
+// $8000-$FFFF selects the PRG bank of the first window and the 8KB CHR
+// bank. Further PRG windows are fixed to the last banks. Board supplies
+// kId, kName, kPrgWindowSize, kPrg, kChr and kBusConflicts.
+template<typename Board>
+class Mapper_Discrete: public MapperBase {
+public:
+	Mapper_Discrete(uint8_t* buffer, size_t bufSize, RomDescriptor desc);
+	const std::string& GetName();
+	uint16_t GetId();
+	uint8_t ReadPrg(uint16_t addr) {
+		if (addr >= 0x8000) {
+			return *prg_.Resolve(addr - 0x8000);
+		}
+		return 0; // no PRG RAM, open bus
+	}
+	std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count);
+	void WritePrg(uint16_t addr, uint8_t val);
+	uint32_t GetPrgBankId(uint16_t addr);
+	uint8_t ReadChar(uint16_t addr) {
+		return *chr_.Resolve(addr);
+	}
+	std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) {
+		assert(addr + count <= chr_.kWindowSize);
+		return {chr_.Resolve(addr), count};
+	}
+	void WriteChar(uint16_t addr, uint8_t val);
+private:
+	BankWindows<Board::kPrgWindowSize, 0x8000 / Board::kPrgWindowSize> prg_;
+	BankWindows<0x2000, 1> chr_;
+	uint32_t prgBankCount_;
+	uint32_t chrBankCount_;
+	uint8_t* chrData_;
+	std::unique_ptr<uint8_t[]> chrRAM_; // boards without CHR ROM
+
+	uint8_t latch_ = 0;
+
+	void UpdateBanks();
+};
+
+struct UxROM {
+	static constexpr uint16_t kId = 2;
+	static constexpr const char* kName = "UxROM";
+	static constexpr uint32_t kPrgWindowSize = 0x4000;
+	static constexpr LatchField kPrg = {0, 0x0F};
+	static constexpr LatchField kChr = {0, 0x00};
+	static constexpr bool kBusConflicts = true;
+};
+
+struct CNROM {
+	static constexpr uint16_t kId = 3;
+	static constexpr const char* kName = "CNROM";
+	static constexpr uint32_t kPrgWindowSize = 0x4000; // 16KB images mirror
+	static constexpr LatchField kPrg = {0, 0x00};
+	static constexpr LatchField kChr = {0, 0x03};
+	static constexpr bool kBusConflicts = true;
+};
+
+struct AxROM {
+	static constexpr uint16_t kId = 7;
+	static constexpr const char* kName = "AxROM";
+	static constexpr uint32_t kPrgWindowSize = 0x8000;
+	static constexpr LatchField kPrg = {0, 0x07}; // bit 4 selects a nametable
+	static constexpr LatchField kChr = {0, 0x00};
+	static constexpr bool kBusConflicts = true;
+};
+
+struct ColorDreams {
+	static constexpr uint16_t kId = 11;
+	static constexpr const char* kName = "Color Dreams";
+	static constexpr uint32_t kPrgWindowSize = 0x8000;
+	static constexpr LatchField kPrg = {0, 0x03};
+	static constexpr LatchField kChr = {4, 0x0F};
+	static constexpr bool kBusConflicts = false;
+};
+
+struct GxROM {
+	static constexpr uint16_t kId = 66;
+	static constexpr const char* kName = "GxROM";
+	static constexpr uint32_t kPrgWindowSize = 0x8000;
+	static constexpr LatchField kPrg = {4, 0x03};
+	static constexpr LatchField kChr = {0, 0x03};
+	static constexpr bool kBusConflicts = true;
+};
+
+using Mapper_UxROM = Mapper_Discrete<UxROM>;
+using Mapper_CNROM = Mapper_Discrete<CNROM>;
+using Mapper_AxROM = Mapper_Discrete<AxROM>;
+using Mapper_ColorDreams = Mapper_Discrete<ColorDreams>;
+using Mapper_GxROM = Mapper_Discrete<GxROM>;
+
+} // namespace nes::mapper
@@ -1,35 +1,61 @@
 #pragma once
 
+#include "nes/mappers/bankwindows.h"
 #include "nes/mappers/mapperbase.h"
+#include "nes/utils.h"
+
 #include <array>
+#include <assert.h>
+#include <memory>
 
 namespace nes::mapper {
 
 class Mapper_MMC1: public MapperBase {
 public:
 	Mapper_MMC1(uint8_t* buffer, size_t bufSize, RomDescriptor desc);
-	virtual const std::string& GetName() override;
-	virtual uint16_t GetId() override;
-	virtual uint8_t ReadPrg(uint16_t addr) override;
-	virtual std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count) override;
-	virtual void WritePrg(uint16_t addr, uint8_t val) override;
-	virtual uint8_t ReadChar(uint16_t addr) override;
-	virtual std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) override;
-	virtual void WriteChar(uint16_t addr, uint8_t val) override;
+	const std::string& GetName();
+	uint16_t GetId();
+	uint8_t ReadPrg(uint16_t addr) {
+		if (addr >= 0x8000) { // $8000 and $C000 banks
+			return buffer_[descriptor_.prgRomStart + prgBankAddressOffsets_[(addr >> 14) & 1] + (addr & 0x3FFF)];
+		}
+		if (IsInRange(0x6000, 0x7FFF, addr) && ramEnabled_) { // PRG RAM
+			return prgRAM_[addr - 0x6000];
+		}
+		return InvalidPrgRead(addr);
+	}
+	std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count);
+	void WritePrg(uint16_t addr, uint8_t val);
+	uint32_t GetPrgBankId(uint16_t addr);
+	uint8_t ReadChar(uint16_t addr) {
+		return *chr_.Resolve(addr);
+	}
+	std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) {
+		assert(addr % chr_.kWindowSize + count <= chr_.kWindowSize);
+		return {chr_.Resolve(addr), count};
+	}
+	void WriteChar(uint16_t addr, uint8_t val);
 private:
 	bool ramEnabled_ = true;
 	std::array<uint8_t, 0x2000> prgRAM_;
 	uint8_t shiftRegister_ = 0;
 	uint8_t writeCount_ = 0;
 
-	uint8_t prgRomBankMode_ = 0;
+	uint8_t prgRomBankMode_ = 3;
 	uint8_t chrRomBankMode_ = 0;
 
+	uint8_t prgBank_ = 0;
 	const int prgBankCount_;
 	std::array<size_t, 2> prgBankAddressOffsets_;
-	std::array<size_t, 2> chrBankAddressOffsets_ = {0x0000, 0x1000};
+	std::array<uint8_t, 2> chrBanks_ = {};
+	BankWindows<0x1000, 2> chr_;
+	uint32_t chrBankCount_;
+	uint8_t* chrData_;
+	std::unique_ptr<uint8_t[]> chrRAM_; // boards without CHR ROM
 
 	void HandleControlMsg(uint16_t addr, uint8_t msg);
+	void UpdatePrgBanks();
+	void UpdateChrBanks();
 	void Reset();
 };
 
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "nes/mappers/bankwindows.h"
+#include "nes/mappers/mapperbase.h"
+#include "nes/utils.h"
+
+#include <array>
+#include <assert.h>
+#include <memory>
+
+namespace nes::mapper {
+
+// MMC3 (TxROM): four 8KB PRG windows, eight 1KB CHR windows, 8KB PRG RAM
+// and a scanline counter raising an IRQ
+class Mapper_MMC3: public MapperBase {
+public:
+	Mapper_MMC3(uint8_t* buffer, size_t bufSize, RomDescriptor desc);
+	const std::string& GetName();
+	uint16_t GetId();
+	uint8_t ReadPrg(uint16_t addr) {
+		if (addr >= 0x8000) {
+			return *prg_.Resolve(addr - 0x8000);
+		}
+		if (IsInRange(0x6000, 0x7FFF, addr)) { // PRG RAM, open bus while disabled
+			return ramEnabled_ ? prgRAM_[addr - 0x6000] : 0;
+		}
+		return InvalidPrgRead(addr);
+	}
+	std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count);
+	void WritePrg(uint16_t addr, uint8_t val);
+	uint32_t GetPrgBankId(uint16_t addr);
+	uint8_t ReadChar(uint16_t addr) {
+		return *chr_.Resolve(addr);
+	}
+	std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) {
+		assert(addr % chr_.kWindowSize + count <= chr_.kWindowSize);
+		return {chr_.Resolve(addr), count};
+	}
+	void WriteChar(uint16_t addr, uint8_t val);
+	void ClockScanline();
+	bool IsIrqPending() const;
+	bool IsIrqDueNextScanline() const;
+private:
+	BankWindows<0x2000, 4> prg_;
+	BankWindows<0x0400, 8> chr_;
+	uint32_t prgBankCount_;
+	uint32_t chrBankCount_;
+	uint8_t* chrData_;
+
+	std::array<uint8_t, 0x2000> prgRAM_ = {};
+	bool ramEnabled_ = true;
+	bool ramWritable_ = true;
+	std::unique_ptr<uint8_t[]> chrRAM_; // boards without CHR ROM
+
+	uint8_t bankSelect_ = 0;
+	std::array<uint8_t, 8> bankRegisters_ = {0, 2, 4, 5, 6, 7, 0, 1};
+
+	uint8_t irqLatch_ = 0;
+	uint8_t irqCounter_ = 0;
+	bool irqReload_ = false;
+	bool irqEnabled_ = false;
+	bool irqPending_ = false;
+
+	void UpdateBanks();
+};
+
+} // namespace nes::mapper
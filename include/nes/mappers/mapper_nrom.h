@@ -2,20 +2,36 @@
 
 #include "nes/mappers/mapperbase.h"
 
+#include <memory>
+
 namespace nes::mapper {
 
 class Mapper_NROM: public MapperBase {
 public:
 	Mapper_NROM(uint8_t* buffer, size_t bufSize, RomDescriptor desc);
-	virtual const std::string& GetName() override;
-	virtual uint16_t GetId() override;
-	virtual uint8_t ReadPrg(uint16_t addr) override;
-	virtual std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count) override;
-	virtual void WritePrg(uint16_t addr, uint8_t val) override;
-	virtual uint8_t ReadChar(uint16_t addr) override;
-	virtual std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) override;
-	virtual void WriteChar(uint16_t addr, uint8_t val) override;
+	const std::string& GetName();
+	uint16_t GetId();
+	uint8_t ReadPrg(uint16_t addr) {
+		if (addr >= 0x8000) {
+			return prgData_[addr & prgMask_];
+		}
+		return InvalidPrgRead(addr);
+	}
+	std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count);
+	void WritePrg(uint16_t addr, uint8_t val);
+	uint32_t GetPrgBankId(uint16_t addr);
+	uint8_t ReadChar(uint16_t addr) {
+		return chrData_[addr];
+	}
+	std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) {
+		return {chrData_ + addr, count};
+	}
+	void WriteChar(uint16_t addr, uint8_t val);
 private:
+	uint8_t* prgData_;
+	uint16_t prgMask_; // 16KB images are mirrored at $C000
+	uint8_t* chrData_;
+	std::unique_ptr<uint8_t[]> chrRAM_; // boards without CHR ROM
 };
 
 } // namespace nes::mapper
@@ -8,24 +8,32 @@
 
 namespace nes::mapper {
 
+// State shared by all mappers. Mappers are held by value in AnyMapper and
+// called without virtual dispatch, so each one provides GetName, GetId,
+// ReadPrg, ReadPrgN, WritePrg, GetPrgBankId, ReadChar, ReadChrN and
+// WriteChar, and may hide the scanline counter defaults below. The reads
+// are defined in the mapper headers to inline into the CPU and PPU.
 class MapperBase {
 public:
 	MapperBase(uint8_t* buffer, size_t bufSize, RomDescriptor desc);
-	virtual ~MapperBase() = default;
 
-	virtual const std::string& GetName() = 0;
-	virtual uint16_t GetId() = 0;
-	virtual uint8_t ReadPrg(uint16_t addr) = 0;
-	virtual std::span<uint8_t> ReadPrgN(uint16_t addr, uint16_t count) = 0;
-	virtual void WritePrg(uint16_t addr, uint8_t val) = 0;
-	virtual uint8_t ReadChar(uint16_t addr) = 0;
-	virtual std::span<uint8_t> ReadChrN(uint16_t addr, uint16_t count) = 0;
-	virtual void WriteChar(uint16_t addr, uint8_t val) = 0;
+	// Bank id returned for addresses backed by writable memory
+	static constexpr uint32_t kPrgRamBank = 0xFFFFFFFF;
+
+	// Scanline counters are clocked by the PPU once per rendered line, at
+	// the predicted rise of PPU address line A12
+	void ClockScanline() {}
+	bool IsIrqPending() const { return false; }
+	// Lets the CPU cores bound how far they run ahead of the PPU
+	bool IsIrqDueNextScanline() const { return false; }
 
 protected:
 	uint8_t* buffer_ = nullptr;
 	size_t bufSize_ = 0;
 	RomDescriptor descriptor_;
+
+	// Reports a read from an address the mapper does not decode
+	static uint8_t InvalidPrgRead(uint16_t addr);
 };
 
 } // namespace nes::mapper
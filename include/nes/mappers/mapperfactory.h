@@ -1,13 +1,24 @@
-
 #pragma once
 
-#include "nes/mappers/mapperbase.h"
+#include "nes/mappers/mapper_discrete.h"
+#include "nes/mappers/mapper_mmc1.h"
+#include "nes/mappers/mapper_mmc3.h"
+#include "nes/mappers/mapper_nrom.h"
+
+#include <variant>
 
 namespace nes::mapper {
 
+// Every supported mapper, held by value so accesses dispatch through a
+// switch the compiler can inline instead of a virtual call
+using AnyMapper = std::variant<std::monostate, Mapper_NROM, Mapper_MMC1, Mapper_MMC3,
+			       Mapper_UxROM, Mapper_CNROM, Mapper_AxROM,
+			       Mapper_ColorDreams, Mapper_GxROM>;
+
 class MapperFactory {
 public:
-	static MapperBase* CreateMapper(uint8_t* buffer, size_t bufSize, RomDescriptor desc);
+	// Constructs the mapper desc asks for in place, false if unsupported
+	static bool CreateMapper(AnyMapper& mapper, uint8_t* buffer, size_t bufSize, RomDescriptor desc);
 };
 
 } // namespace nes::mapper
@@ -73,4 +73,17 @@ constexpr std::array<RGBA, 0x40> kColorPalette = {
 	RGBA{0, 0, 0, 255},
 	RGBA{0, 0, 0, 255}
 };
+
+// ITU-R BT.601 luma of kColorPalette
+constexpr std::array<uint8_t, 0x40> kLumaPalette = [] {
+	std::array<uint8_t, 0x40> luma{};
+	for (size_t i = 0; i < kColorPalette.size(); ++i) {
+		auto c = kColorPalette[i];
+		luma[i] = (299 * c.r + 587 * c.g + 114 * c.b + 500) / 1000;
+	}
+	return luma;
+}();
+
+// Shown where nothing was drawn
+constexpr uint8_t kBlankColorIdx = 0x0F;
 } // namespace nes
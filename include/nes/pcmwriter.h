@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nes {
+
+// Streams mono 16 bit PCM to a WAV or headerless raw file. Samples are
+// converted into one block while a writer thread puts the other one on
+// disk with a single pwrite, so the emulation thread never waits on the
+// file unless the disk falls a whole block behind. The WAV header is
+// written with the final sizes on Close(). Data is in host byte order,
+// i.e. little endian on the hosts we build for.
+class PcmWriter {
+public:
+	enum class Format {
+		kWav,
+		kRaw,
+	};
+
+	static constexpr size_t kBlockSamples = 1 << 16;
+
+	PcmWriter() = default;
+	PcmWriter(const PcmWriter&) = delete;
+	PcmWriter& operator=(const PcmWriter&) = delete;
+	~PcmWriter();
+
+	// An empty path only counts and hashes the samples
+	bool Open(const std::string& path, Format format, uint32_t sampleRate);
+	// Samples in [-1, 1], clipped outside
+	void Write(std::span<const float> samples);
+	// Returns false if any write failed
+	bool Close();
+
+	bool IsOpen() const;
+	uint64_t GetSampleCount() const;
+	// FNV-1a over the PCM data, for regression checks without the file
+	uint64_t GetHash() const;
+
+private:
+	bool open_ = false;
+	int fd_ = -1;
+	Format format_ = Format::kWav;
+	uint32_t sampleRate_ = 0;
+	uint64_t sampleCount_ = 0;
+	uint64_t hash_ = 0;
+
+	std::vector<int16_t> front_; // filled by Write()
+	std::vector<int16_t> back_;  // owned by the writer thread while pending
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool pending_ = false;
+	bool stopping_ = false;
+	bool failed_ = false;
+	uint64_t offset_ = 0; // file offset of the next block
+
+	void Submit();
+	void Run();
+	bool WriteAt(const void* data, size_t size, uint64_t offset);
+};
+
+} // namespace nes
@@ -15,25 +15,69 @@ class Ppu2C02 {
 public:
 	using Palette = std::array<uint8_t, 4>;
 
+	// Output stage used instead of full resolution RGBA framebuffers
+	enum class ObservationFormat {
+		kRGBA,             // 256x240 RGBA, see SetFramebuffers
+		kLumaHalf,         // 128x120 luminance, 2x2 box filtered
+		kLuma84,           // 84x84 luminance, area filtered
+		kPaletteIndexHalf, // 128x120 NES colour indices, point sampled
+	};
+
 	Ppu2C02(Bus* bus);
 
+	// Power-up state; framebuffers and observation output are kept
+	void Reset();
+
 	uint8_t Read(uint16_t addr, bool silent);
 	std::span<uint8_t> ReadN(uint16_t addr, uint16_t count);
 	void Write(uint16_t addr, uint8_t val);
+	// The 256 bytes of an OAM DMA, run by the bus
+	void WriteOamDma(std::span<const uint8_t> data);
 
 	void SetFramebuffers(std::array<RGBA*, 2> buffers);
+	// Buffers must hold GetObservationSize(format) bytes. Switching back to
+	// kRGBA renders into the framebuffers again.
+	void SetObservationOutput(ObservationFormat format, std::array<uint8_t*, 2> buffers);
+	static size_t GetObservationSize(ObservationFormat format);
 	uint8_t GetActiveFramebufferId() const;
+	// Lower bound of Tick() calls until VBlank starts (NMI and frame flip).
+	// Zero while VBlank started within the last CPU cycle's dots.
+	uint32_t GetDotsUntilVBlank() const;
+	// Lower bound of Tick() calls until the scanline counter is clocked,
+	// UINT32_MAX while no clock is scheduled
+	uint32_t GetDotsUntilScanlineEvent() const;
+	// Position in the frame, scanline * 341 + dot
+	uint32_t GetDotIndex() const;
 
 	const std::array<Palette, 8>& GetFramePalette() const;
 	const std::array<RGBA, 8*8>& GetSpriteZero() const;
 
+	// Register level state, cheap enough to compare every instruction
+	struct RegisterState {
+		uint32_t dotIdx = 0;
+		uint16_t vramAddress = 0;
+		uint8_t vramBuffer = 0;
+		uint8_t status = 0;
+		uint8_t oamAddress = 0;
+		uint8_t scrollX = 0;
+		uint8_t scrollY = 0;
+		uint8_t scrollSetIndex = 0;
+		bool oddFrame = false;
+
+		bool operator==(const RegisterState&) const = default;
+	};
+	RegisterState GetRegisterState() const;
+	// Hash of nametable RAM, OAM and palettes
+	uint64_t HashMemory() const;
+
 	void Tick();
 private:
 	struct BufferDot {
-		RGBA color;
+		RGBA color = {};
 		bool isOpaque = true;
 		bool isBehind = false;
 		bool isSprite0 = false;
+		uint8_t colorIdx = 0;
 	};
 	using BackingBuffer = std::array<BufferDot, kScreenColCount * kScreenRowCount>;
 
@@ -42,20 +86,26 @@ private:
 	uint8_t activeFrameBufferId_ = 0;
 	std::array<RGBA*, 2> frameBuffers_;
 
+	ObservationFormat observationFormat_ = ObservationFormat::kRGBA;
+	std::array<uint8_t*, 2> observationBuffers_;
+	std::array<uint8_t, kScreenColCount> lineBuffer_;
+	std::array<uint8_t, kScreenColCount> prevLineBuffer_;
+	std::array<uint32_t, 84> lumaAccumulator_;
+
 	std::array<BackingBuffer, 4> backgroundBuffers_;
 	BackingBuffer spriteBuffer_;
 	bool spriteZeroReported_ = false;
 
 	uint8_t oamAddress_ = 0;
-	std::array<uint8_t, 0xFF> oamStorage_;
+	std::array<uint8_t, 0x100> oamStorage_ = {};
 
 	uint16_t vramAddress_ = 0;
 	uint8_t vramBuffer_ = 0;
 	std::array<uint8_t, 0x0800> vramStorage_;
 
-	std::array<Palette, 8> framePalette_;
+	std::array<Palette, 8> framePalette_ = {};
 
-	std::array<uint8_t, 16> rawTileBuffer_;
+	std::array<uint8_t, 16> rawTileBuffer_ = {};
 
 	uint8_t scrollSetIndex_ = 0;
 	std::array<uint8_t, 2> scrollBuffer_{0, 0}; // X, Y
@@ -63,20 +113,21 @@ private:
 
 	uint32_t dotIdx_ = 0;
 	bool oddFrame_ = false;
+	uint32_t scanlineEventDot_ = UINT32_MAX; // next A12 rise, see ScheduleScanlineEvent
 
 	struct ControlState {
 		uint16_t nameTableId = 0;
-		uint16_t spriteTableAddr;
+		uint16_t spriteTableAddr = 0;
 		uint16_t backgroundTableIdx = 0;
 		uint16_t addressIncrement = 0;
 		enum SpriteSize {
 			k8x8,
 			k8x16,
-		} spriteSize;
+		} spriteSize = k8x8;
 		enum Select {
 			kInput,
 			kOutput,
-		} select;
+		} select = kInput;
 		bool generateNMI = false;
 	} controlState_;
 
@@ -91,16 +142,18 @@ private:
 		bool emphasizeBlue : 1 = false;
 	} maskState_;
 
-	std::array<RGBA, 8 * 8> spriteZeroData_;
+	std::array<RGBA, 8 * 8> spriteZeroData_ = {};
 
 	void ParseControlMessage(uint8_t val);
 	void ParseMaskMessage(uint8_t val);
+	void ScheduleScanlineEvent();
 	uint8_t HandleDataRead(bool silent);
 	void HandleDataWrite(uint8_t val);
 
 	uint8_t GetPaletteIdx(uint16_t attrTableBase, uint8_t row, uint8_t col);
 	void DrawBackgroundLayers();
 	void DrawSpriteLayer();
+	void EmitObservationLine(uint32_t row);
 };
 
 } // namespace nes
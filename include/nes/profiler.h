@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nes {
+
+// Guest code profiler fed by Cpu6502 at every executed instruction.
+// Counts instructions and cycles per opcode and per PRG bank + PC, and
+// attributes cycles to call stacks rebuilt from JSR/BRK/NMI and RTS/RTI.
+class CpuProfiler {
+public:
+	struct Hotspot {
+		uint32_t bankId = 0; // Bus::GetPrgBankId, kPrgRamBank outside PRG ROM
+		uint16_t pc = 0;
+		uint64_t count = 0;
+		uint64_t cycles = 0;
+	};
+
+	CpuProfiler();
+
+	void Record(uint32_t bankId, uint16_t pc, uint8_t opCode, uint32_t cycles) {
+		const size_t idx = (size_t)(uint32_t)(bankId + 1) << 16 | pc;
+		if (idx >= pcCounters_.size()) {
+			pcCounters_.resize((idx | 0xFFFF) + 1);
+		}
+		auto& counter = pcCounters_[idx];
+		counter.count += 1;
+		counter.cycles += cycles;
+		opCounts_[opCode] += 1;
+		opCycles_[opCode] += cycles;
+		stacks_[stack_].cycles += cycles;
+	}
+
+	// Call stack tracking, routine is identified by its entry point
+	void EnterRoutine(uint32_t bankId, uint16_t pc);
+	void LeaveRoutine();
+
+	void Reset();
+
+	// Executed addresses, most cycles first
+	std::vector<Hotspot> GetHotspots() const;
+	uint64_t GetTotalCycles() const;
+
+	// Opcode table followed by the top PCs
+	void WriteReport(std::ostream& out, size_t maxHotspots = 50) const;
+	// One "frame;frame;frame cycles" line per stack, for flamegraph.pl and
+	// compatible viewers
+	void WriteFoldedStacks(std::ostream& out) const;
+
+private:
+	struct Counter {
+		uint64_t count = 0;
+		uint64_t cycles = 0;
+	};
+
+	struct StackNode {
+		uint32_t parent = 0;
+		uint32_t bankId = 0;
+		uint16_t pc = 0;
+		uint32_t depth = 0;
+		uint64_t cycles = 0;
+	};
+
+	static constexpr uint32_t kMaxDepth = 64;
+
+	// Indexed by (bankId + 1) << 16 | pc, RAM code lands in slot 0
+	std::vector<Counter> pcCounters_;
+	std::array<uint64_t, 256> opCounts_ = {};
+	std::array<uint64_t, 256> opCycles_ = {};
+
+	// Interned call stacks, node 0 is the reset entry
+	std::vector<StackNode> stacks_;
+	std::unordered_map<uint64_t, uint32_t> children_;
+	uint32_t stack_ = 0;
+
+	std::string FrameName(const StackNode& node) const;
+};
+
+} // namespace nes
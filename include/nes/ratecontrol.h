@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+namespace nes {
+
+// Dynamic rate control for audio paced emulation: nudges the resampling
+// ratio so the output queue hovers around a target fill instead of
+// slowly draining or overflowing when the emulated and the audio clocks
+// disagree. Deviations of half a percent are not heard as pitch changes.
+class RateControl {
+public:
+	explicit RateControl(size_t targetFill, double maxDeviation = 0.005);
+
+	// Ratio for the next block of samples given the current queue fill
+	double Update(size_t fill);
+
+	size_t GetTargetFill() const;
+	double GetRatio() const;
+
+private:
+	size_t targetFill_;
+	double maxDeviation_;
+	double smoothedFill_; // filters out the block sized jitter of the fill
+	double ratio_ = 1.0;
+};
+
+} // namespace nes
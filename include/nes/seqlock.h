@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace nes {
+
+// Single writer, many reader snapshot of a trivially copyable value. The
+// writer never blocks; readers retry while a store is in progress. The
+// payload is kept in relaxed atomic words so torn reads are detected
+// rather than being data races.
+template <typename T>
+class SeqLock {
+	static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+	void Store(const T& value) {
+		std::array<uint64_t, kWords> words{};
+		std::memcpy(words.data(), &value, sizeof(T));
+
+		const auto seq = seq_.load(std::memory_order_relaxed);
+		seq_.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < kWords; ++i) {
+			words_[i].store(words[i], std::memory_order_relaxed);
+		}
+		seq_.store(seq + 2, std::memory_order_release);
+	}
+
+	T Load() const {
+		std::array<uint64_t, kWords> words;
+		uint32_t before = 0;
+		uint32_t after = 0;
+		do {
+			before = seq_.load(std::memory_order_acquire);
+			for (size_t i = 0; i < kWords; ++i) {
+				words[i] = words_[i].load(std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = seq_.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+
+		T value;
+		std::memcpy(&value, words.data(), sizeof(T));
+		return value;
+	}
+
+	// Number of completed stores
+	uint32_t GetVersion() const {
+		return seq_.load(std::memory_order_acquire) / 2;
+	}
+
+private:
+	static constexpr size_t kWords = (sizeof(T) + 7) / 8;
+
+	std::atomic<uint32_t> seq_ = 0;
+	std::array<std::atomic<uint64_t>, kWords> words_{};
+};
+
+} // namespace nes
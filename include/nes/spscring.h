@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace nes {
+
+// Wait-free single producer, single consumer ring of trivially copyable
+// values, e.g. audio samples handed from the emulation thread to an audio
+// callback. Push and Pop move as much as fits and never block. Indices
+// grow monotonically and are masked on access, the capacity is rounded up
+// to a power of two.
+template <typename T>
+class SpscRing {
+	static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+	explicit SpscRing(size_t capacity)
+	: buffer_(std::bit_ceil(std::max<size_t>(capacity, 2)))
+	, mask_(buffer_.size() - 1) {}
+
+	size_t GetCapacity() const {
+		return buffer_.size();
+	}
+
+	// Approximate from either side, exact on the calling side's end
+	size_t GetSize() const {
+		return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+	}
+
+	// Producer side, returns how many values were queued
+	size_t Push(std::span<const T> values) {
+		const uint64_t tail = tail_.load(std::memory_order_relaxed);
+		const uint64_t head = head_.load(std::memory_order_acquire);
+		const size_t n = std::min<size_t>(values.size(), buffer_.size() - (tail - head));
+		for (size_t i = 0; i < n; ++i) {
+			buffer_[(tail + i) & mask_] = values[i];
+		}
+		tail_.store(tail + n, std::memory_order_release);
+		return n;
+	}
+
+	// Consumer side, returns how many values were taken
+	size_t Pop(std::span<T> out) {
+		const uint64_t head = head_.load(std::memory_order_relaxed);
+		const uint64_t tail = tail_.load(std::memory_order_acquire);
+		const size_t n = std::min<size_t>(out.size(), tail - head);
+		for (size_t i = 0; i < n; ++i) {
+			out[i] = buffer_[(head + i) & mask_];
+		}
+		head_.store(head + n, std::memory_order_release);
+		return n;
+	}
+
+private:
+	std::vector<T> buffer_;
+	const size_t mask_;
+
+	// Separate cache lines, each index is written by one side only
+	alignas(64) std::atomic<uint64_t> head_ = 0;
+	alignas(64) std::atomic<uint64_t> tail_ = 0;
+};
+
+} // namespace nes
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace nes {
+
+// Turns a piecewise constant signal, given as amplitude steps at clock
+// timestamps, into PCM samples. Every step is written as a band-limited
+// step from a precomputed windowed sinc table, so the cost is per step and
+// per sample rather than per clock, and nothing aliases. Output lags the
+// input by kHalfWidth samples. Steps past the end of the buffer keep the
+// level right but lose their timing.
+class StepBuffer {
+public:
+	static constexpr int kHalfWidth = 8;  // kernel taps on each side
+	static constexpr int kPhaseBits = 5;  // sub-sample step positions
+
+	StepBuffer(double clockRate, uint32_t sampleRate, size_t capacity = 1 << 14);
+
+	// Drops buffered samples, the level carries over
+	void SetSampleRate(uint32_t sampleRate);
+	uint32_t GetSampleRate() const;
+	// Retunes the input clock without a discontinuity, for small pitch
+	// adjustments while running
+	void SetClockRate(double clockRate);
+
+	// Steps must come in non-decreasing time order
+	void AddDelta(uint64_t time, float delta);
+	// Completes all samples up to time
+	void EndFrame(uint64_t time);
+
+	size_t GetSamplesAvailable() const;
+	size_t ReadSamples(std::span<float> out);
+	uint64_t GetDroppedSamples() const;
+	// Drops buffered samples and restarts the timeline at time from silence
+	void Clear(uint64_t time);
+
+private:
+	double clockRate_;
+	uint32_t sampleRate_;
+	double samplesPerClock_;
+
+	// Clock time of deltas_[0], fractional after reads
+	double startTime_ = 0.0;
+	uint64_t lastTime_ = 0;
+	float level_ = 0.f; // running sum of the deltas read so far
+
+	// DC blocking high pass, the mix is unipolar
+	float highPassPole_ = 0.f;
+	float prevIn_ = 0.f;
+	float prevOut_ = 0.f;
+
+	std::vector<float> deltas_; // capacity plus the kernel width
+	size_t capacity_;
+	size_t used_ = 0;      // deltas_ past this are zero
+	size_t available_ = 0;
+	uint64_t dropped_ = 0;
+};
+
+} // namespace nes
@@ -1,9 +1,16 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace nes {
 
-bool IsInRange(uint16_t beg, uint16_t end, uint16_t val);
+constexpr bool IsInRange(uint16_t beg, uint16_t end, uint16_t val) {
+	return (beg <= val) && (val <= end);
+}
+
+// 64 bit FNV-1a, pass the previous result as seed to hash in pieces
+constexpr uint64_t kHashSeed = 0xCBF29CE484222325ull;
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = kHashSeed);
 
 } // namespace nes
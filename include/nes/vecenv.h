@@ -0,0 +1,102 @@
+#pragma once
+
+#include "nes/machine.h"
+#include "nes/types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nes {
+
+// Batched environment running N independent machines of the same ROM.
+// Observations are written straight into a caller-provided contiguous
+// buffer of N frames, each GetObservationSize() bytes.
+class VecEnv {
+public:
+	// reward += scale * (RAM[addr] after step - RAM[addr] before step)
+	struct RamReward {
+		uint16_t addr = 0;
+		float scale = 1.f;
+	};
+
+	// Episode ends once (RAM[addr] & mask) == value
+	struct RamDone {
+		uint16_t addr = 0;
+		uint8_t mask = 0xFF;
+		uint8_t value = 0;
+	};
+
+	struct Config {
+		std::string romPath;
+		size_t envCount = 1;
+		uint32_t frameSkip = 4;
+		bool maxPool = true; // max over the last two skipped frames
+		uint32_t maxNoopFrames = 30; // random idle frames on reset
+		uint32_t maxEpisodeFrames = 0; // 0 - unlimited
+		std::vector<RamReward> rewards;
+		std::optional<RamDone> done;
+		size_t threadCount = 0; // 0 - hardware concurrency
+		// Max pooling is skipped for kPaletteIndexHalf
+		Ppu2C02::ObservationFormat observation = Ppu2C02::ObservationFormat::kRGBA;
+	};
+
+	VecEnv(Config config);
+	~VecEnv();
+
+	bool Load();
+	size_t GetEnvCount() const;
+	size_t GetObservationSize() const;
+
+	// seeds: envCount entries, frames: envCount * GetObservationSize() bytes
+	void Reset(std::span<const uint64_t> seeds, uint8_t* frames);
+
+	// actions: Controller::Button bitmask per env, rewards and dones are
+	// envCount long. Environments reported done are reset on the next step.
+	void Step(std::span<const uint8_t> actions, uint8_t* frames,
+		  float* rewards, uint8_t* dones);
+
+private:
+	struct Env {
+		std::unique_ptr<Machine> machine;
+		std::vector<uint8_t> watched;
+		std::mt19937_64 rng;
+		uint32_t episodeFrames = 0;
+		bool done = false;
+	};
+
+	Config config_;
+	size_t observationSize_ = 0;
+	std::vector<Env> envs_;
+
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable startCv_;
+	std::condition_variable doneCv_;
+	const std::function<void(size_t)>* job_ = nullptr;
+	std::atomic<size_t> nextJob_ = 0;
+	uint64_t generation_ = 0;
+	size_t busyWorkers_ = 0;
+	bool stopping_ = false;
+
+	void SetOutput(Env& env, std::array<uint8_t*, 2> buffers);
+	void ResetEnv(Env& env, uint8_t* frame);
+	void StepEnv(Env& env, uint8_t action, uint8_t* frame, float& reward, uint8_t& done);
+	bool RunFrames(Env& env, uint32_t count, uint8_t* frame, bool maxPool);
+	bool IsDone(Env& env);
+
+	void ParallelFor(const std::function<void(size_t)>& job);
+	void RunJobs();
+	void WorkerLoop();
+};
+
+} // namespace nes
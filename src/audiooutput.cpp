@@ -0,0 +1,55 @@
+#include "audiooutput.h"
+
+#include <array>
+#include <chrono>
+
+AudioOutput::AudioOutput(uint32_t sampleRate, size_t capacity)
+: sampleRate_(sampleRate)
+, queue_(capacity) {
+}
+
+AudioOutput::~AudioOutput() {
+	Stop();
+}
+
+void AudioOutput::Start() {
+	if (running_.exchange(true)) {
+		return;
+	}
+	thread_ = std::thread(&AudioOutput::Run, this);
+}
+
+void AudioOutput::Stop() {
+	if (!running_.exchange(false)) {
+		return;
+	}
+	thread_.join();
+}
+
+nes::SpscRing<float>& AudioOutput::GetQueue() {
+	return queue_;
+}
+
+uint32_t AudioOutput::GetSampleRate() const {
+	return sampleRate_;
+}
+
+uint64_t AudioOutput::GetUnderruns() const {
+	return underruns_.load(std::memory_order_relaxed);
+}
+
+void AudioOutput::Run() {
+	using Clock = std::chrono::steady_clock;
+	const auto blockDuration = std::chrono::duration_cast<Clock::duration>(
+		std::chrono::duration<double>((double)kBlockSize / sampleRate_));
+
+	std::array<float, kBlockSize> block;
+	auto next = Clock::now();
+	while (running_.load(std::memory_order_relaxed)) {
+		if (queue_.Pop(block) < block.size()) {
+			underruns_.fetch_add(1, std::memory_order_relaxed);
+		}
+		next += blockDuration;
+		std::this_thread::sleep_until(next);
+	}
+}
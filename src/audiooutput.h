@@ -0,0 +1,36 @@
+#pragma once
+
+#include "nes/spscring.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Audio device end of the sample queue. No host audio API is linked, so
+// the device is emulated: a thread takes fixed blocks from the queue at
+// the sample rate by the steady clock, the way a device callback would.
+// That thread is the clock the frontend paces emulation by.
+class AudioOutput {
+public:
+	static constexpr size_t kBlockSize = 256;
+
+	AudioOutput(uint32_t sampleRate, size_t capacity);
+	~AudioOutput();
+
+	void Start();
+	void Stop();
+
+	nes::SpscRing<float>& GetQueue();
+	uint32_t GetSampleRate() const;
+	// Blocks the device had to pad with silence
+	uint64_t GetUnderruns() const;
+
+private:
+	uint32_t sampleRate_;
+	nes::SpscRing<float> queue_;
+	std::thread thread_;
+	std::atomic<bool> running_ = false;
+	std::atomic<uint64_t> underruns_ = 0;
+
+	void Run();
+};
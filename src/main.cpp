@@ -3,6 +3,12 @@
 
 #include "nesapp.h"
 #include "nes/cartridge.h"
+#include "nes/hosttrace.h"
+
+#ifdef NES_HOST_TRACE
+#include <fstream>
+#include <iostream>
+#endif
 
 int main(int argc, char** argv) {
 	NesApp app;
@@ -22,5 +28,11 @@ int main(int argc, char** argv) {
 		app.Start();
 	}
 
+#ifdef NES_HOST_TRACE
+	std::ofstream trace("nes-trace.json");
+	nes::trace::WriteChromeTrace(trace);
+	nes::trace::WriteFrameSummary(std::cout);
+#endif
+
     return 0;
 }
@@ -0,0 +1,752 @@
+#include "nes/apu.h"
+
+#include "nes/bus.h"
+#include "nes/hosttrace.h"
+
+#include <algorithm>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace nes {
+
+namespace {
+
+constexpr uint16_t kSTATUS = 0x4015;
+constexpr uint16_t kFRAMECOUNTER = 0x4017;
+
+constexpr std::array<uint8_t, 32> kLengthTable = {
+	10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+	12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+constexpr uint8_t kDutyTable[4][8] = {
+	{0, 1, 0, 0, 0, 0, 0, 0},
+	{0, 1, 1, 0, 0, 0, 0, 0},
+	{0, 1, 1, 1, 1, 0, 0, 0},
+	{1, 0, 0, 1, 1, 1, 1, 1},
+};
+
+constexpr std::array<uint8_t, 32> kTriangleTable = {
+	15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+// NTSC, in CPU cycles
+constexpr std::array<uint16_t, 16> kNoisePeriods = {
+	4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+
+constexpr std::array<uint16_t, 16> kDmcPeriods = {
+	428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+};
+
+// Frame counter steps in CPU cycles after the $4017 write. The last entry
+// is the sequence length.
+constexpr std::array<uint32_t, 5> kFourStepSequence = {7457, 14913, 22371, 29829, 29830};
+constexpr std::array<uint32_t, 6> kFiveStepSequence = {7457, 14913, 22371, 29829, 37281, 37282};
+
+// Nonlinear DAC lookup tables from the NESdev wiki, indexed by
+// pulse1 + pulse2 and 3 * triangle + 2 * noise + dmc
+constexpr std::array<float, 31> kPulseTable = [] {
+	std::array<float, 31> table = {};
+	for (size_t i = 1; i < table.size(); ++i) {
+		table[i] = 95.52f / (8128.f / i + 100.f);
+	}
+	return table;
+}();
+
+constexpr std::array<float, 203> kTndTable = [] {
+	std::array<float, 203> table = {};
+	for (size_t i = 1; i < table.size(); ++i) {
+		table[i] = 163.67f / (24329.f / i + 100.f);
+	}
+	return table;
+}();
+
+// Mixer table indices for count entries of per-channel levels, with the
+// channels outside mask silenced. Reads whole 16 byte groups.
+void MixIndices(const uint8_t* const levels[], uint8_t mask, size_t count,
+		uint8_t* pulseIdx, uint8_t* tndIdx) {
+	auto keep = [mask](int channel) -> uint8_t {
+		return mask & (1 << channel) ? 0xFF : 0;
+	};
+#if defined(__SSE2__)
+	__m128i keeps[5];
+	for (int channel = 0; channel < 5; ++channel) {
+		keeps[channel] = _mm_set1_epi8(keep(channel));
+	}
+	for (size_t i = 0; i < count; i += 16) {
+		__m128i l[5];
+		for (int channel = 0; channel < 5; ++channel) {
+			l[channel] = _mm_and_si128(keeps[channel],
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(levels[channel] + i)));
+		}
+		const auto pulse = _mm_add_epi8(l[0], l[1]);
+		const auto triangle = _mm_add_epi8(_mm_add_epi8(l[2], l[2]), l[2]);
+		const auto tnd = _mm_add_epi8(_mm_add_epi8(triangle, _mm_add_epi8(l[3], l[3])), l[4]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pulseIdx + i), pulse);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(tndIdx + i), tnd);
+	}
+#else
+	uint8_t keeps[5];
+	for (int channel = 0; channel < 5; ++channel) {
+		keeps[channel] = keep(channel);
+	}
+	for (size_t i = 0; i < count; ++i) {
+		pulseIdx[i] = (levels[0][i] & keeps[0]) + (levels[1][i] & keeps[1]);
+		tndIdx[i] = 3 * (levels[2][i] & keeps[2]) + 2 * (levels[3][i] & keeps[3])
+			+ (levels[4][i] & keeps[4]);
+	}
+#endif
+}
+
+// Counts a timer down by cycles and returns how many times it expired,
+// reloading it with period each time
+uint32_t AdvanceTimer(uint32_t& timer, uint32_t period, uint32_t cycles) {
+	if (cycles < timer) {
+		timer -= cycles;
+		return 0;
+	}
+	cycles -= timer;
+	timer = period - cycles % period;
+	return 1 + cycles / period;
+}
+
+} // namespace
+
+void Apu2A03::Envelope::Clock() {
+	if (start) {
+		start = false;
+		decay = 15;
+		divider = volume;
+		return;
+	}
+	if (divider > 0) {
+		--divider;
+		return;
+	}
+	divider = volume;
+	if (decay > 0) {
+		--decay;
+	} else if (loop) {
+		decay = 15;
+	}
+}
+
+uint8_t Apu2A03::Envelope::GetVolume() const {
+	return constant ? volume : decay;
+}
+
+uint16_t Apu2A03::Pulse::GetSweepTarget() const {
+	const uint16_t change = period >> sweepShift;
+	if (!sweepNegate) {
+		return period + change;
+	}
+	const uint16_t sub = change + (isFirst ? 1 : 0);
+	return period > sub ? period - sub : 0;
+}
+
+bool Apu2A03::Pulse::IsMuted() const {
+	return period < 8 || GetSweepTarget() > 0x7FF;
+}
+
+bool Apu2A03::Pulse::IsAudible() const {
+	return length > 0 && !IsMuted() && envelope.GetVolume() > 0;
+}
+
+void Apu2A03::Pulse::ClockSweep() {
+	if (sweepDivider == 0 && sweepEnabled && sweepShift > 0 && !IsMuted()) {
+		period = GetSweepTarget();
+	}
+	if (sweepDivider == 0 || sweepReload) {
+		sweepDivider = sweepPeriod;
+		sweepReload = false;
+	} else {
+		--sweepDivider;
+	}
+}
+
+uint8_t Apu2A03::Pulse::GetOutput() const {
+	if (!IsAudible() || !kDutyTable[duty][step]) {
+		return 0;
+	}
+	return envelope.GetVolume();
+}
+
+bool Apu2A03::Triangle::IsRunning() const {
+	// Periods below 2 are ultrasonic, games use them to silence the channel
+	return length > 0 && linearCounter > 0 && period >= 2;
+}
+
+void Apu2A03::Triangle::ClockLinear() {
+	if (linearReloadFlag) {
+		linearCounter = linearReload;
+	} else if (linearCounter > 0) {
+		--linearCounter;
+	}
+	if (!control) {
+		linearReloadFlag = false;
+	}
+}
+
+uint8_t Apu2A03::Triangle::GetOutput() const {
+	return kTriangleTable[step];
+}
+
+bool Apu2A03::Noise::IsAudible() const {
+	return length > 0 && envelope.GetVolume() > 0;
+}
+
+void Apu2A03::Noise::Clock() {
+	const uint16_t feedback = (shift ^ (shift >> (shortMode ? 6 : 1))) & 1;
+	shift = (shift >> 1) | (feedback << 14);
+}
+
+uint8_t Apu2A03::Noise::GetOutput() const {
+	if (length == 0 || (shift & 1)) {
+		return 0;
+	}
+	return envelope.GetVolume();
+}
+
+Apu2A03::Apu2A03(Bus* bus, uint32_t sampleRate)
+: bus_(bus) {
+	assert(bus_ != nullptr);
+	outputs_.push_back({kAllChannels, 0.f, StepBuffer(kCpuClockRate, sampleRate)});
+	bus_->AttachAPU(this);
+	Reset();
+}
+
+void Apu2A03::Reset() {
+	now_ = bus_->GetCpuCycle();
+	pulse_[0] = {};
+	pulse_[0].isFirst = true;
+	pulse_[1] = {};
+	triangle_ = {};
+	noise_ = {};
+	dmc_ = {};
+
+	fiveStep_ = false;
+	frameIrqInhibit_ = false;
+	frameIrq_ = false;
+	frameStep_ = 0;
+	frameStart_ = now_;
+	ScheduleFrameEvent();
+
+	for (auto& output : outputs_) {
+		output.level = 0.f;
+		output.buffer.Clear(now_);
+	}
+	levels_.count = 0;
+	lastLevels_ = UINT64_MAX;
+	ScheduleDmcFetch();
+	ScheduleIrq();
+}
+
+uint8_t Apu2A03::Read(uint16_t addr, bool silent) {
+	if (addr != kSTATUS) {
+		return 0;
+	}
+	CatchUp();
+	uint8_t val = (pulse_[0].length > 0 ? 0x01 : 0)
+		| (pulse_[1].length > 0 ? 0x02 : 0)
+		| (triangle_.length > 0 ? 0x04 : 0)
+		| (noise_.length > 0 ? 0x08 : 0)
+		| (dmc_.bytesRemaining > 0 ? 0x10 : 0)
+		| (frameIrq_ ? 0x40 : 0)
+		| (dmc_.irq ? 0x80 : 0);
+	if (!silent) {
+		frameIrq_ = false;
+		ScheduleIrq();
+	}
+	return val;
+}
+
+void Apu2A03::Write(uint16_t addr, uint8_t val) {
+	CatchUp();
+	if (addr <= 0x4007) { // pulse
+		auto& pulse = pulse_[(addr - 0x4000) / 4];
+		switch (addr % 4) {
+			case 0:
+				pulse.duty = val >> 6;
+				pulse.halt = val & 0x20;
+				pulse.envelope.loop = val & 0x20;
+				pulse.envelope.constant = val & 0x10;
+				pulse.envelope.volume = val & 0x0F;
+				break;
+			case 1:
+				pulse.sweepEnabled = val & 0x80;
+				pulse.sweepPeriod = (val >> 4) & 0x07;
+				pulse.sweepNegate = val & 0x08;
+				pulse.sweepShift = val & 0x07;
+				pulse.sweepReload = true;
+				break;
+			case 2:
+				pulse.period = (pulse.period & 0x700) | val;
+				break;
+			case 3:
+				pulse.period = (pulse.period & 0xFF) | (uint16_t)(val & 0x07) << 8;
+				if (pulse.enabled) {
+					pulse.length = kLengthTable[val >> 3];
+				}
+				pulse.step = 0;
+				pulse.envelope.start = true;
+				break;
+		}
+	} else if (addr <= 0x400B) { // triangle
+		switch (addr) {
+			case 0x4008:
+				triangle_.control = val & 0x80;
+				triangle_.linearReload = val & 0x7F;
+				break;
+			case 0x400A:
+				triangle_.period = (triangle_.period & 0x700) | val;
+				break;
+			case 0x400B:
+				triangle_.period = (triangle_.period & 0xFF) | (uint16_t)(val & 0x07) << 8;
+				if (triangle_.enabled) {
+					triangle_.length = kLengthTable[val >> 3];
+				}
+				triangle_.linearReloadFlag = true;
+				break;
+		}
+	} else if (addr <= 0x400F) { // noise
+		switch (addr) {
+			case 0x400C:
+				noise_.halt = val & 0x20;
+				noise_.envelope.loop = val & 0x20;
+				noise_.envelope.constant = val & 0x10;
+				noise_.envelope.volume = val & 0x0F;
+				break;
+			case 0x400E:
+				noise_.shortMode = val & 0x80;
+				noise_.periodIdx = val & 0x0F;
+				break;
+			case 0x400F:
+				if (noise_.enabled) {
+					noise_.length = kLengthTable[val >> 3];
+				}
+				noise_.envelope.start = true;
+				break;
+		}
+	} else if (addr <= 0x4013) { // DMC
+		switch (addr) {
+			case 0x4010:
+				dmc_.irqEnabled = val & 0x80;
+				dmc_.loop = val & 0x40;
+				dmc_.rateIdx = val & 0x0F;
+				if (!dmc_.irqEnabled) {
+					dmc_.irq = false;
+				}
+				break;
+			case 0x4011:
+				dmc_.level = val & 0x7F;
+				break;
+			case 0x4012:
+				dmc_.sampleAddress = 0xC000 + (uint16_t)val * 64;
+				break;
+			case 0x4013:
+				dmc_.sampleLength = (uint16_t)val * 16 + 1;
+				break;
+		}
+	} else if (addr == kSTATUS) {
+		pulse_[0].enabled = val & 0x01;
+		pulse_[1].enabled = val & 0x02;
+		triangle_.enabled = val & 0x04;
+		noise_.enabled = val & 0x08;
+		for (auto& pulse : pulse_) {
+			if (!pulse.enabled) {
+				pulse.length = 0;
+			}
+		}
+		if (!triangle_.enabled) {
+			triangle_.length = 0;
+		}
+		if (!noise_.enabled) {
+			noise_.length = 0;
+		}
+		dmc_.irq = false;
+		if (!(val & 0x10)) {
+			dmc_.bytesRemaining = 0;
+		} else if (dmc_.bytesRemaining == 0) {
+			RestartDmc();
+			FillDmcBuffer();
+		}
+	} else if (addr == kFRAMECOUNTER) {
+		fiveStep_ = val & 0x80;
+		frameIrqInhibit_ = val & 0x40;
+		if (frameIrqInhibit_) {
+			frameIrq_ = false;
+		}
+		frameStep_ = 0;
+		frameStart_ = now_;
+		ScheduleFrameEvent();
+		if (fiveStep_) {
+			ClockQuarterFrame();
+			ClockHalfFrame();
+		}
+	}
+	RecordLevels();
+	ScheduleDmcFetch();
+	ScheduleIrq();
+}
+
+void Apu2A03::SetSampleRate(uint32_t sampleRate) {
+	EndFrame();
+	for (auto& output : outputs_) {
+		output.buffer.SetSampleRate(sampleRate);
+	}
+}
+
+uint32_t Apu2A03::GetSampleRate() const {
+	return outputs_[0].buffer.GetSampleRate();
+}
+
+void Apu2A03::SetResampleRatio(double ratio) {
+	EndFrame();
+	for (auto& output : outputs_) {
+		output.buffer.SetClockRate(kCpuClockRate / ratio);
+	}
+}
+
+size_t Apu2A03::ReadSamples(std::span<float> out) {
+	EndFrame();
+	return outputs_[0].buffer.ReadSamples(out);
+}
+
+size_t Apu2A03::GetSamplesAvailable() {
+	EndFrame();
+	return outputs_[0].buffer.GetSamplesAvailable();
+}
+
+void Apu2A03::SetChannelMask(uint8_t mask) {
+	CatchUp();
+	outputs_[0].mask = mask & kAllChannels;
+	Remix();
+}
+
+uint8_t Apu2A03::GetChannelMask() const {
+	return outputs_[0].mask;
+}
+
+void Apu2A03::SetStemsEnabled(bool enabled) {
+	EndFrame();
+	outputs_.erase(outputs_.begin() + 1, outputs_.end());
+	if (!enabled) {
+		return;
+	}
+	for (int channel = 0; channel < kChannelCount; ++channel) {
+		auto buffer = outputs_[0].buffer; // same rates
+		buffer.Clear(now_);
+		outputs_.push_back({(uint8_t)(1 << channel), 0.f, std::move(buffer)});
+	}
+	Remix();
+}
+
+bool Apu2A03::AreStemsEnabled() const {
+	return outputs_.size() > 1;
+}
+
+size_t Apu2A03::ReadStemSamples(Channel channel, std::span<float> out) {
+	assert(AreStemsEnabled());
+	EndFrame();
+	return outputs_[1 + channel].buffer.ReadSamples(out);
+}
+
+bool Apu2A03::IsFrameIrqPending() {
+	CatchUp();
+	return frameIrq_;
+}
+
+bool Apu2A03::IsDmcIrqPending() {
+	CatchUp();
+	return dmc_.irq;
+}
+
+void Apu2A03::SyncIrq() {
+	CatchUp();
+}
+
+uint32_t Apu2A03::TakeDmcFetches(uint64_t cycle) {
+	CatchUp(cycle);
+	const auto fetches = dmc_.fetches;
+	dmc_.fetches = 0;
+	ScheduleDmcFetch();
+	return fetches;
+}
+
+void Apu2A03::CatchUp() {
+	CatchUp(bus_->GetCpuCycle());
+}
+
+void Apu2A03::CatchUp(uint64_t target) {
+	if (target > now_) {
+		NES_TRACE_ZONE("Apu2A03::CatchUp");
+		while (nextFrameEvent_ <= target) {
+			RunChannels(nextFrameEvent_);
+			ClockFrameCounter();
+		}
+		RunChannels(target);
+	}
+	MixBlock();
+	ScheduleDmcFetch();
+	ScheduleIrq();
+}
+
+// Jumps from one audible timer event to the next; silent channels only
+// have their timers advanced
+void Apu2A03::RunChannels(uint64_t until) {
+	while (now_ < until) {
+		uint32_t cycles = (uint32_t)std::min<uint64_t>(until - now_, UINT32_MAX);
+		for (const auto& pulse : pulse_) {
+			if (pulse.IsAudible()) {
+				cycles = std::min(cycles, pulse.timer);
+			}
+		}
+		if (triangle_.IsRunning()) {
+			cycles = std::min(cycles, triangle_.timer);
+		}
+		if (noise_.IsAudible()) {
+			cycles = std::min(cycles, noise_.timer);
+		}
+		if (IsDmcActive()) {
+			cycles = std::min(cycles, dmc_.timer);
+		}
+		Advance(cycles);
+		now_ += cycles;
+		RecordLevels();
+	}
+}
+
+void Apu2A03::Advance(uint32_t cycles) {
+	for (auto& pulse : pulse_) {
+		const auto steps = AdvanceTimer(pulse.timer, (pulse.period + 1) * 2, cycles);
+		pulse.step = (pulse.step + steps) % 8;
+	}
+
+	const auto triangleSteps = AdvanceTimer(triangle_.timer, triangle_.period + 1, cycles);
+	if (triangle_.IsRunning()) {
+		triangle_.step = (triangle_.step + triangleSteps) % 32;
+	}
+
+	// The noise sequence has no audible phase while silent
+	const bool noiseAudible = noise_.IsAudible();
+	if (AdvanceTimer(noise_.timer, kNoisePeriods[noise_.periodIdx], cycles) && noiseAudible) {
+		noise_.Clock();
+	}
+
+	// An idle DMC only cycles its bit counter
+	const bool dmcActive = IsDmcActive();
+	const auto dmcSteps = AdvanceTimer(dmc_.timer, kDmcPeriods[dmc_.rateIdx], cycles);
+	for (uint32_t i = 0; i < (dmcActive ? dmcSteps : dmcSteps % 8); ++i) {
+		ClockDmc();
+	}
+}
+
+void Apu2A03::ClockFrameCounter() {
+	const auto step = frameStep_;
+	if (fiveStep_) {
+		if (step == 0 || step == 2) {
+			ClockQuarterFrame();
+		} else if (step == 1 || step == 4) {
+			ClockQuarterFrame();
+			ClockHalfFrame();
+		}
+	} else {
+		if (step == 0 || step == 2) {
+			ClockQuarterFrame();
+		} else if (step == 1 || step == 3) {
+			ClockQuarterFrame();
+			ClockHalfFrame();
+		}
+		if (step >= 3 && !frameIrqInhibit_) {
+			frameIrq_ = true;
+		}
+	}
+
+	const size_t sequenceLength = fiveStep_ ? kFiveStepSequence.size() : kFourStepSequence.size();
+	if (++frameStep_ == sequenceLength) {
+		frameStart_ += fiveStep_ ? kFiveStepSequence.back() : kFourStepSequence.back();
+		frameStep_ = 0;
+	}
+	ScheduleFrameEvent();
+	RecordLevels();
+}
+
+void Apu2A03::ClockQuarterFrame() {
+	for (auto& pulse : pulse_) {
+		pulse.envelope.Clock();
+	}
+	noise_.envelope.Clock();
+	triangle_.ClockLinear();
+}
+
+void Apu2A03::ClockHalfFrame() {
+	for (auto& pulse : pulse_) {
+		if (pulse.length > 0 && !pulse.halt) {
+			--pulse.length;
+		}
+		pulse.ClockSweep();
+	}
+	if (triangle_.length > 0 && !triangle_.control) {
+		--triangle_.length;
+	}
+	if (noise_.length > 0 && !noise_.halt) {
+		--noise_.length;
+	}
+}
+
+void Apu2A03::ScheduleFrameEvent() {
+	const auto offset = fiveStep_ ? kFiveStepSequence[frameStep_] : kFourStepSequence[frameStep_];
+	nextFrameEvent_ = frameStart_ + offset;
+}
+
+bool Apu2A03::IsDmcActive() const {
+	return !dmc_.silence || dmc_.bufferFull || dmc_.bytesRemaining > 0;
+}
+
+void Apu2A03::ClockDmc() {
+	if (!dmc_.silence) {
+		if (dmc_.shift & 1) {
+			if (dmc_.level <= 125) {
+				dmc_.level += 2;
+			}
+		} else if (dmc_.level >= 2) {
+			dmc_.level -= 2;
+		}
+		dmc_.shift >>= 1;
+	}
+	if (--dmc_.bitsRemaining > 0) {
+		return;
+	}
+	dmc_.bitsRemaining = 8;
+	dmc_.silence = !dmc_.bufferFull;
+	if (dmc_.bufferFull) {
+		dmc_.shift = dmc_.buffer;
+		dmc_.bufferFull = false;
+		FillDmcBuffer();
+	}
+}
+
+void Apu2A03::FillDmcBuffer() {
+	if (dmc_.bufferFull || dmc_.bytesRemaining == 0) {
+		return;
+	}
+	dmc_.buffer = bus_->Read(dmc_.currentAddress, true);
+	dmc_.bufferFull = true;
+	++dmc_.fetches;
+	dmc_.currentAddress = dmc_.currentAddress == 0xFFFF ? 0x8000 : dmc_.currentAddress + 1;
+	if (--dmc_.bytesRemaining > 0) {
+		return;
+	}
+	if (dmc_.loop) {
+		RestartDmc();
+	} else if (dmc_.irqEnabled) {
+		dmc_.irq = true;
+	}
+}
+
+void Apu2A03::RestartDmc() {
+	dmc_.currentAddress = dmc_.sampleAddress;
+	dmc_.bytesRemaining = dmc_.sampleLength;
+}
+
+// A fetch refills the buffer as the shift register takes it, which happens
+// when the current byte's last bit has been clocked out
+uint64_t Apu2A03::GetNextDmcFetchCycle() const {
+	return now_ + dmc_.timer + (uint64_t)(dmc_.bitsRemaining - 1) * kDmcPeriods[dmc_.rateIdx];
+}
+
+void Apu2A03::ScheduleDmcFetch() {
+	uint64_t cycle = UINT64_MAX;
+	if (dmc_.fetches > 0) {
+		cycle = now_;
+	} else if (dmc_.bytesRemaining > 0) {
+		cycle = GetNextDmcFetchCycle();
+	}
+	bus_->ScheduleDmcDma(cycle);
+}
+
+// Publishes the IRQ flags and the earliest cycle either could be set at
+// without a register write: the frame IRQ at the end of a 4-step
+// sequence, the DMC IRQ with the fetch of a sample's last byte
+void Apu2A03::ScheduleIrq() {
+	bus_->SetIrq(Bus::kIrqApuFrame, frameIrq_);
+	bus_->SetIrq(Bus::kIrqApuDmc, dmc_.irq);
+
+	uint64_t cycle = UINT64_MAX;
+	if (!fiveStep_ && !frameIrqInhibit_ && !frameIrq_) {
+		cycle = frameStart_ + kFourStepSequence[std::max<size_t>(frameStep_, 3)];
+	}
+	if (dmc_.irqEnabled && !dmc_.loop && !dmc_.irq && dmc_.bytesRemaining > 0) {
+		const uint64_t bytePeriod = 8 * kDmcPeriods[dmc_.rateIdx];
+		cycle = std::min(cycle, GetNextDmcFetchCycle() + (dmc_.bytesRemaining - 1) * bytePeriod);
+	}
+	bus_->ScheduleApuIrq(cycle);
+}
+
+void Apu2A03::EndFrame() {
+	CatchUp();
+	for (auto& output : outputs_) {
+		output.buffer.EndFrame(now_);
+	}
+}
+
+void Apu2A03::RecordLevels() {
+	const uint8_t levels[kChannelCount] = {
+		pulse_[0].GetOutput(), pulse_[1].GetOutput(), triangle_.GetOutput(),
+		noise_.GetOutput(), dmc_.level,
+	};
+	uint64_t packed = 0;
+	for (int channel = 0; channel < kChannelCount; ++channel) {
+		packed |= (uint64_t)levels[channel] << (channel * 8);
+	}
+	if (packed == lastLevels_) {
+		return;
+	}
+	lastLevels_ = packed;
+
+	const auto idx = levels_.count++;
+	levels_.time[idx] = now_;
+	for (int channel = 0; channel < kChannelCount; ++channel) {
+		levels_.level[channel][idx] = levels[channel];
+	}
+	if (levels_.count == kMixBlockSize) {
+		MixBlock();
+	}
+}
+
+void Apu2A03::MixBlock() {
+	static_assert(kMixBlockSize % 16 == 0, "MixIndices reads 16 byte groups");
+	if (levels_.count == 0) {
+		return;
+	}
+	const uint8_t* levels[kChannelCount];
+	for (int channel = 0; channel < kChannelCount; ++channel) {
+		levels[channel] = levels_.level[channel].data();
+	}
+	std::array<uint8_t, kMixBlockSize> pulseIdx;
+	std::array<uint8_t, kMixBlockSize> tndIdx;
+	for (auto& output : outputs_) {
+		MixIndices(levels, output.mask, levels_.count, pulseIdx.data(), tndIdx.data());
+		for (size_t i = 0; i < levels_.count; ++i) {
+			const float level = kPulseTable[pulseIdx[i]] + kTndTable[tndIdx[i]];
+			if (level != output.level) {
+				output.buffer.AddDelta(levels_.time[i], level - output.level);
+				output.level = level;
+			}
+		}
+	}
+	levels_.count = 0;
+}
+
+void Apu2A03::Remix() {
+	lastLevels_ = UINT64_MAX;
+	RecordLevels();
+	MixBlock();
+}
+
+} // namespace nes
@@ -1,13 +1,39 @@
 #include "nes/bus.h"
 
+#include "nes/apu.h"
+#include "nes/cpu6502.h"
 #include "nes/ppu.h"
 #include "nes/utils.h"
 #include "nes/types.h"
 
+#include <algorithm>
 #include <assert.h>
 
 namespace nes {
 
+namespace {
+
+uint8_t CodePage(uint16_t addr) {
+	if (addr < 0x2000) {
+		return (addr % 0x0800) >> 8; // fold mirrors
+	}
+	return addr >> 8;
+}
+
+// Contribution of one RAM cell to the RAM hash, zero for zero bytes so
+// that cleared RAM hashes to 0
+uint64_t RamHashTerm(uint16_t idx, uint8_t val) {
+	if (val == 0) {
+		return 0;
+	}
+	uint64_t x = (uint64_t)idx << 8 | val;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+} // namespace
+
 uint8_t Bus::Read(uint16_t addr, bool silent) {
 	if (IsInRange(0x0000, 0x1FFF, addr)) { // internal memory
 		return memory_[addr % 0x0800];
@@ -16,6 +42,9 @@ uint8_t Bus::Read(uint16_t addr, bool silent) {
 		return ppu_->Read(0x2000 + ((addr - 0x2000) % 0x008), silent);
 	}
 	if (IsInRange(0x4000, 0x4017, addr)) { // APU and I/O registers
+		if (addr == 0x4015 && apu_) {
+			return apu_->Read(addr, silent);
+		}
 		if (addr == 0x4016 && controller1_) {
 			return controller1_->Read();
 		}
@@ -55,15 +84,25 @@ std::span<uint8_t> Bus::ReadN(uint16_t addr, uint16_t count) {
 }
 
 void Bus::Write(uint16_t addr, uint8_t val) {
+	auto& codePage = codePages_[CodePage(addr)];
+	if (codePage) {
+		codePage = false;
+		++codeGeneration_;
+	}
+
 	if (IsInRange(0x0000, 0x17FF, addr)) { // internal memory
-		memory_[addr % 0x0800] = val;
+		const uint16_t idx = addr % 0x0800;
+		ramHash_ += RamHashTerm(idx, val) - RamHashTerm(idx, memory_[idx]);
+		memory_[idx] = val;
 	}
 	if (IsInRange(0x2000, 0x3FFF, addr)) { // PPU registers
 		ppu_->Write(0x2000 + ((addr - 0x2000) % 0x008), val);
 	}
 	if (IsInRange(0x4000, 0x4017, addr)) { // APU and I/O registers
 		if (addr == kOAMDMA) {
-			ppu_->Write(addr, val);
+			ScheduleOamDma(val);
+		} else if (addr != 0x4016 && apu_) {
+			apu_->Write(addr, val);
 		}
 
 		if (addr == 0x4016) {
@@ -79,26 +118,62 @@ void Bus::Write(uint16_t addr, uint8_t val) {
 
 	}
 	if (IsInRange(0x4020, 0xFFFF, addr)) { // Cartridge
-		// TODO
+		if (addr >= 0x8000) { // mapper registers may swap PRG banks
+			++codeGeneration_;
+		}
+		if (cartridge_) {
+			cartridge_->WritePrg(addr, val);
+			SetIrq(kIrqCartridge, cartridge_->IsIrqPending());
+		}
 	}
 }
 
-uint8_t Bus::ReadChr(uint16_t addr) {
-	return cartridge_->ReadChar(addr);
+void Bus::ClockScanlineCounter() {
+	if (cartridge_) {
+		cartridge_->ClockScanline();
+		SetIrq(kIrqCartridge, cartridge_->IsIrqPending());
+	}
 }
 
-std::span<uint8_t> Bus::ReadChrN(uint16_t addr, uint16_t count) {
-	return cartridge_->ReadChrN(addr, count);
+bool Bus::IsCartridgeIrqPending() const {
+	return cartridge_ && cartridge_->IsIrqPending();
+}
+
+bool Bus::IsCartridgeIrqDueNextScanline() const {
+	return cartridge_ && cartridge_->IsIrqDueNextScanline();
+}
+
+void Bus::Reset() {
+	triggerNMI_ = false;
+	irqLine_ = 0;
+	apuIrqCycle_ = UINT64_MAX;
+	UpdateInterruptCycle();
+	oamDmaPage_.reset();
+	dmcDmaCycle_ = UINT64_MAX;
+	nextDmaCycle_ = UINT64_MAX;
+	codePages_ = {};
+	++codeGeneration_;
+	memory_ = {};
+	ramHash_ = 0;
 }
 
 void Bus::InsertCartridge(Cartridge* cart) {
 	cartridge_ = cart;
+	SetIrq(kIrqCartridge, false);
 }
 
 void Bus::AttachPPU(Ppu2C02* ppu) {
 	ppu_ = ppu;
 }
 
+void Bus::AttachAPU(Apu2A03* apu) {
+	apu_ = apu;
+}
+
+void Bus::AttachCPU(Cpu6502* cpu) {
+	cpu_ = cpu;
+}
+
 void Bus::AttachController(Controller* con, bool playerOne) {
 	if (playerOne) {
 		controller1_ = con;
@@ -109,22 +184,138 @@ void Bus::AttachController(Controller* con, bool playerOne) {
 
 void Bus::TriggerNMI() {
 	triggerNMI_ = true;
-}
-
-void Bus::TriggerDMA() {
-	triggerDMA_ = true;
+	UpdateInterruptCycle();
 }
 
 bool Bus::CheckNMI() {
 	auto tmp = triggerNMI_;
 	triggerNMI_ = false;
+	UpdateInterruptCycle();
 	return tmp;
 }
 
-bool Bus::CheckDMA() {
-	auto tmp = triggerDMA_;
-	triggerDMA_ = false;
-	return tmp;
+bool Bus::IsNMIPending() const {
+	return triggerNMI_;
+}
+
+void Bus::SetIrq(IrqSource source, bool asserted) {
+	irqLine_ = asserted ? irqLine_ | source : irqLine_ & ~source;
+	UpdateInterruptCycle();
+}
+
+void Bus::ScheduleApuIrq(uint64_t cycle) {
+	apuIrqCycle_ = cycle;
+	UpdateInterruptCycle();
+}
+
+bool Bus::IsIrqAsserted() {
+	if (apu_ && GetCpuCycle() >= apuIrqCycle_) {
+		apu_->SyncIrq();
+	}
+	return irqLine_ != 0;
+}
+
+const uint64_t& Bus::GetInterruptCycle(bool irqMasked) const {
+	return irqMasked ? nmiCycle_ : interruptCycle_;
+}
+
+void Bus::UpdateInterruptCycle() {
+	nmiCycle_ = triggerNMI_ ? 0 : UINT64_MAX;
+	interruptCycle_ = (triggerNMI_ || irqLine_) ? 0 : apuIrqCycle_;
+}
+
+void Bus::ScheduleOamDma(uint8_t page) {
+	oamDmaPage_ = page;
+	nextDmaCycle_ = 0;
+}
+
+void Bus::ScheduleDmcDma(uint64_t cycle) {
+	dmcDmaCycle_ = cycle;
+	nextDmaCycle_ = oamDmaPage_ ? 0 : cycle;
+}
+
+uint64_t Bus::GetNextDmaCycle() const {
+	return nextDmaCycle_;
+}
+
+uint32_t Bus::RunDma(uint64_t cycle) {
+	if (cycle < nextDmaCycle_) {
+		return 0;
+	}
+
+	uint32_t stolen = 0;
+	if (oamDmaPage_) {
+		// A halt cycle, an alignment cycle when that lands on an odd
+		// cycle, then 256 read/write pairs
+		stolen += 513 + (cycle & 1);
+		CopyOamPage(*oamDmaPage_);
+		oamDmaPage_.reset();
+	}
+	if (cycle >= dmcDmaCycle_ && apu_) {
+		// Halt, dummy, alignment and read cycle for every fetch. The
+		// shorter stalls on CPU write cycles or inside an OAM DMA are not
+		// told apart, stalls start at instruction boundaries.
+		stolen += 4 * apu_->TakeDmcFetches(cycle);
+	}
+	nextDmaCycle_ = dmcDmaCycle_;
+	return stolen;
+}
+
+// RAM and PRG ROM pages go to OAM straight from their storage, other pages
+// are read a byte at a time with their side effects
+void Bus::CopyOamPage(uint8_t page) {
+	const uint16_t addr = page << 8;
+	if (addr < 0x2000 || (addr >= 0x8000 && cartridge_)) {
+		ppu_->WriteOamDma(ReadN(addr, 256));
+		return;
+	}
+	std::array<uint8_t, 256> data;
+	for (size_t i = 0; i < data.size(); ++i) {
+		data[i] = Read(addr + i);
+	}
+	ppu_->WriteOamDma(data);
+}
+
+uint32_t Bus::GetPrgBankId(uint16_t addr) {
+	if (IsInRange(0x4020, 0xFFFF, addr) && cartridge_) {
+		return cartridge_->GetPrgBankId(addr);
+	}
+	return mapper::MapperBase::kPrgRamBank;
+}
+
+void Bus::MarkCodePage(uint16_t addr) {
+	codePages_[CodePage(addr)] = true;
+}
+
+uint32_t Bus::GetCodeGeneration() const {
+	return codeGeneration_;
+}
+
+uint32_t Bus::GetCyclesUntilPpuEvent() const {
+	if (!ppu_) {
+		return UINT32_MAX;
+	}
+	uint32_t dots = ppu_->GetDotsUntilVBlank();
+	if (IsCartridgeIrqDueNextScanline()) {
+		dots = std::min(dots, ppu_->GetDotsUntilScanlineEvent());
+	}
+	return dots / 3;
+}
+
+uint32_t Bus::GetPpuDotIndex() const {
+	return ppu_ ? ppu_->GetDotIndex() : 0;
+}
+
+uint64_t Bus::GetCpuCycle() const {
+	return cpu_ ? cpu_->GetCycle() : 0;
+}
+
+uint8_t* Bus::GetRamData() {
+	return memory_.data();
+}
+
+uint64_t Bus::GetRamHash() const {
+	return ramHash_;
 }
 
 } // namespace nes
@@ -1,8 +1,9 @@
 #include "nes/cartridge.h"
 #include "tfm/tinyformat.h"
-#include "nes/mappers/mapperfactory.h"
 
 #include <array>
+#include <assert.h>
+#include <cstring>
 #include <fstream>
 
 namespace nes {
@@ -47,28 +48,27 @@ bool Cartridge::LoadFile(const std::string& filePath) {
 	return true;
 }
 
-uint8_t Cartridge::ReadPrg(uint16_t addr) {
-	return mapper_->ReadPrg(addr);
-}
-
-std::span<uint8_t> Cartridge::ReadPrgN(uint16_t addr, uint16_t count){
-	return mapper_->ReadPrgN(addr, count);
-}
+bool Cartridge::LoadData(std::span<const uint8_t> data) {
+	bufferSize_ = data.size();
+	if (bufferSize_ < kHeaderSize) {
+		tfm::printf("ERROR: invalid rom data size: %d bytes\n", bufferSize_);
+		return false;
+	}
 
-void Cartridge::WritePrg(uint16_t addr, uint8_t val) {
-	mapper_->WritePrg(addr, val);
-}
+	buffer_ = std::make_unique<uint8_t[]>(bufferSize_);
+	memcpy(buffer_.get(), data.data(), bufferSize_);
 
-uint8_t Cartridge::ReadChar(uint16_t addr) {
-	return mapper_->ReadChar(addr);
-}
+	if (!Init()) {
+		buffer_.reset();
+		return false;
+	}
 
-std::span<uint8_t> Cartridge::ReadChrN(uint16_t addr, uint16_t count){
-	return mapper_->ReadChrN(addr, count);
+	return true;
 }
 
-void Cartridge::WriteChar(uint16_t addr, uint8_t val) {
-	mapper_->WriteChar(addr, val);
+void Cartridge::Reset() {
+	assert(buffer_);
+	mapper::MapperFactory::CreateMapper(mapper_, buffer_.get(), bufferSize_, descriptor_);
 }
 
 bool Cartridge::Init() {
@@ -107,8 +107,7 @@ bool Cartridge::Init() {
 		return false;
 	}
 
-	mapper_.reset(mapper::MapperFactory::CreateMapper(buffer_.get(), bufferSize_, descriptor_));
-	if (!mapper_) {
+	if (!mapper::MapperFactory::CreateMapper(mapper_, buffer_.get(), bufferSize_, descriptor_)) {
 		tfm::printf("ERROR: failed to create mapper\n");
 		return false;
 	}
@@ -1,5 +1,7 @@
 #include "nes/cpu6502.h"
+#include "nes/hosttrace.h"
 #include "nes/instructions.h"
+#include "nes/utils.h"
 
 #include <tfm/tinyformat.h>
 #include <optional>
@@ -19,24 +21,92 @@ constexpr uint16_t kResetVectorLo = 0xFFFC;
 constexpr uint16_t kResetVectorHi = 0xFFFD;
 constexpr uint16_t kInterruptVectorLo = 0xFFFE;
 constexpr uint16_t kInterruptVectorHi = 0xFFFF;
+
+constexpr size_t kMaxBlockOps = 32;
+constexpr uint32_t kJitThreshold = 32;
+
+bool EndsBlock(Instruction instr) {
+	switch (instr) {
+		case Instruction::kBCC:
+		case Instruction::kBCS:
+		case Instruction::kBEQ:
+		case Instruction::kBMI:
+		case Instruction::kBNE:
+		case Instruction::kBPL:
+		case Instruction::kBVC:
+		case Instruction::kBVS:
+		case Instruction::kBRK:
+		case Instruction::kJMP:
+		case Instruction::kJSR:
+		case Instruction::kRTI:
+		case Instruction::kRTS:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Whether the instruction consumes the value at its effective address.
+// Stores and jumps only need the address; NOP's dummy read is skipped.
+bool ReadsMemory(const Operation& op) {
+	switch (op.addrMode) {
+		case AddressMode::kACC:
+		case AddressMode::kIMM:
+		case AddressMode::kIMP:
+		case AddressMode::kREL:
+			return false;
+		default:
+			break;
+	}
+
+	switch (op.instr) {
+		case Instruction::kSTA:
+		case Instruction::kSTX:
+		case Instruction::kSTY:
+		case Instruction::kSAX:
+		case Instruction::kJMP:
+		case Instruction::kJSR:
+		case Instruction::kNOP:
+			return false;
+		default:
+			return true;
+	}
+}
 } // namespace
 
 Cpu6502::Cpu6502(Bus* bus): bus_(bus) {
 	assert(bus_ != nullptr);
+	bus_->AttachCPU(this);
 	Reset();
 }
 
 void Cpu6502::Reset() {
 	cycle_ = 7; // startup sequence
+	cycleLeft_ = 0;
+	acc_ = 0;
+	x_ = 0;
+	y_ = 0;
+	status_ = 0;
+	nSource_ = 0;
+	zSource_ = 1;
+	carry_ = false;
+	overflow_ = false;
+	irqMaskDelayEnd_ = 0;
+	irqMaskBefore_ = true;
 	auto LL = bus_->Read(kResetVectorLo);
 	auto HH = bus_->Read(kResetVectorHi);
 	pc_ = Join(LL, HH);
 	stackPtr_ = 0xFF;
+	SetFlag(Flag::I, true); // IRQs stay masked until the program's CLI
+
+	blocks_.clear();
+	block_ = nullptr;
+	if (jit_) {
+		jit_->Clear();
+	}
 }
 
 void Cpu6502::Tick() {
-	UpdateState();
-
 	++cycle_;
     // compensate for multi-cycle instructions
     if (cycleLeft_) {
@@ -44,296 +114,411 @@ void Cpu6502::Tick() {
 		return;
     }
 
-	// Check NMI
-	if (bus_->CheckNMI()) {
-		PushStack(pc_ >> 8); // HH
-		PushStack(pc_ & 0xFF); // LL
-		PushStack(status_);
+	NES_TRACE_ZONE("Cpu6502::Tick");
 
-		auto LL = bus_->Read(kNMIVectorLo);
-		auto HH = bus_->Read(kNMIVectorHi);
-		pc_ = Join(LL, HH);
+	if (cycle_ >= *interruptCycle_ && PollInterrupts()) {
+		return;
 	}
 
-    auto opCode = bus_->Read(pc_);
-    auto op = kOpDecoder.at(opCode);
-    auto operand = FetchOperand(op.addrMode);
-	pc_ += OpSizeByMode(op.addrMode);
-
-    switch (op.instr) {
-		case Instruction::kADC: {
-		    ADC(op, operand);
-		    break;
-		}
-		case Instruction::kAND: {
-			AND(op, operand);
-			break;
-		}
-		case Instruction::kASL: {
-			ASL(op, operand);
-		    break;
-		}
-		case Instruction::kBCC: {
-			BCC(op, operand);
-			break;
-		}
-		case Instruction::kBCS: {
-			BCS(op, operand);
-			break;
-		}
-		case Instruction::kBEQ: {
-			BEQ(op, operand);
-			break;
-		}
-		case Instruction::kBIT: {
-			BIT(op, operand);
-			break;
-		}
-		case Instruction::kBMI: {
-			BMI(op, operand);
-			break;
-		}
-		case Instruction::kBNE: {
-			BNE(op, operand);
-			break;
-		}
-		case Instruction::kBPL: {
-			BPL(op, operand);
-			break;
-		}
-		case Instruction::kBRK: {
-			BRK(op, operand);
-			break;
-		}
-		case Instruction::kBVC: {
-			BVC(op, operand);
-			break;
-		}
-		case Instruction::kBVS: {
-			BVS(op, operand);
-			break;
-		}
-		case Instruction::kCLC: {
-			CLC(op, operand);
-			break;
-		}
-		case Instruction::kCLD: {
-			CLD(op, operand);
-			break;
-		}
-		case Instruction::kCLI: {
-			CLI(op, operand);
-			break;
-		}
-		case Instruction::kCLV: {
-			CLV(op, operand);
-			break;
-		}
-		case Instruction::kCMP: {
-			CMP(op, operand);
-			break;
-		}
-		case Instruction::kCPX: {
-			CPX(op, operand);
-			break;
-		}
-		case Instruction::kCPY: {
-			CPY(op, operand);
-			break;
-		}
-		case Instruction::kDEC: {
-			DEC(op, operand);
-			break;
-		}
-		case Instruction::kDEX: {
-			DEX(op, operand);
-			break;
-		}
-		case Instruction::kDEY: {
-			DEY(op, operand);
-			break;
-		}
-		case Instruction::kEOR: {
-			EOR(op, operand);
-			break;
-		}
-		case Instruction::kINC: {
-			INC(op, operand);
-			break;
-		}
-		case Instruction::kINX: {
-			INX(op, operand);
-			break;
-		}
-		case Instruction::kINY: {
-			INY(op, operand);
-			break;
-		}
-		case Instruction::kJMP: {
-			JMP(op, operand);
-			break;
-		}
-		case Instruction::kJSR: {
-			JSR(op, operand);
-			break;
-		}
-		case Instruction::kLDA: {
-			LDA(op, operand);
-			break;
-		}
-		case Instruction::kLDX: {
-			LDX(op, operand);
-			break;
-		}
-		case Instruction::kLDY: {
-			LDY(op, operand);
-			break;
-		}
-		case Instruction::kLSR: {
-			LSR(op, operand);
-		    break;
-		}
-		case Instruction::kNOP: {
-			NOP(op, operand);
-			break;
-		}
-		case Instruction::kORA: {
-			ORA(op, operand);
-			break;
-		}
-		case Instruction::kPHA: {
-			PHA(op, operand);
-			break;
-		}
-		case Instruction::kPHP: {
-			PHP(op, operand);
-			break;
-		}
-		case Instruction::kPLA: {
-			PLA(op, operand);
-			break;
-		}
-		case Instruction::kPLP: {
-			PLP(op, operand);
-		    break;
-		}
-		case Instruction::kROL: {
-			ROL(op, operand);
-			break;
-		}
-		case Instruction::kROR: {
-			ROR(op, operand);
-			break;
-		}
-		case Instruction::kRTI: {
-			RTI(op, operand);
-			break;
-		}
-		case Instruction::kRTS: {
-			RTS(op, operand);
-			break;
-		}
-		case Instruction::kSBC: {
-			SBC(op, operand);
-			break;
-		}
-		case Instruction::kSEC: {
-			SEC(op, operand);
-			break;
-		}
-		case Instruction::kSED: {
-			SED(op, operand);
-			break;
-		}
-		case Instruction::kSEI: {
-			SEI(op, operand);
-			break;
-		}
-		case Instruction::kSTA: {
-			STA(op, operand);
-			break;
+	if (!jit_ || profiler_ || !RunNative()) {
+		const auto& decoded = NextOp();
+#ifdef NES_CPU_TRACE
+		TraceEntry entry{pc_, {decoded.opCode, decoded.LL, decoded.HH},
+			acc_, x_, y_, stackPtr_, GetStatus()};
+		entry.SetTiming(cycle_ - 1, bus_->GetPpuDotIndex());
+		trace_.Record(entry);
+#endif
+		auto operand = ResolveOperand(decoded.op.addrMode, decoded.LL, decoded.HH);
+		if (decoded.readsMemory) {
+			operand.val = bus_->Read(*operand.addr);
+		}
+		pc_ += decoded.size;
+		(this->*decoded.handler)(decoded.op, operand);
+		if (profiler_) {
+			Profile(decoded);
 		}
-		case Instruction::kSTX: {
-			STX(op, operand);
-			break;
-		}
-		case Instruction::kSTY: {
-			STY(op, operand);
-			break;
-		}
-		case Instruction::kTAX: {
-			TAX(op, operand);
-			break;
-		}
-		case Instruction::kTAY: {
-			TAY(op, operand);
-			break;
-		}
-		case Instruction::kTSX: {
-			TSX(op, operand);
-			break;
+	}
+
+	cycleLeft_ += bus_->RunDma(cycle_ + cycleLeft_);
+
+	if (stateSnapshot_) {
+		stateSnapshot_->Store(CaptureState());
+	}
+}
+
+// Entered at an instruction boundary once the bus reports an interrupt
+// input. NMI entry runs the handler's first instruction in the same cycle,
+// an IRQ takes its 7 cycles before it.
+bool Cpu6502::PollInterrupts() {
+	uint16_t vectorLo = 0;
+	if (bus_->CheckNMI()) {
+		vectorLo = kNMIVectorLo;
+	} else {
+		const bool delayed = cycle_ <= irqMaskDelayEnd_;
+		const bool masked = delayed ? irqMaskBefore_ : IsSet(Flag::I);
+		if (!delayed) {
+			SetIrqMasked(masked);
 		}
-		case Instruction::kTXA: {
-			TXA(op, operand);
-			break;
+		if (masked || !bus_->IsIrqAsserted()) {
+			return false;
 		}
-		case Instruction::kTXS: {
-			TXS(op, operand);
+		vectorLo = kInterruptVectorLo;
+	}
+
+	PushStack(pc_ >> 8); // HH
+	PushStack(pc_ & 0xFF); // LL
+	PushStack((GetStatus() & ~Flag::B) | Flag::X);
+	SetFlag(Flag::I, true);
+
+	auto LL = bus_->Read(vectorLo);
+	auto HH = bus_->Read(vectorLo + 1);
+	pc_ = Join(LL, HH);
+	if (profiler_) {
+		profiler_->EnterRoutine(bus_->GetPrgBankId(pc_), pc_);
+	}
+
+	if (vectorLo == kNMIVectorLo) {
+		return false;
+	}
+	cycleLeft_ += 6;
+	return true;
+}
+
+// Called by CLI, SEI and PLP after their cost is added: the next boundary
+// is polled at cycle_ + cycleLeft_ + 1, unless a DMA stalls in between.
+// IRQs count until that poll if either flag lets them through.
+void Cpu6502::DelayIrqMask(bool before) {
+	irqMaskDelayEnd_ = cycle_ + cycleLeft_ + 1;
+	irqMaskBefore_ = before;
+	SetIrqMasked(before && IsSet(Flag::I));
+}
+
+void Cpu6502::SetIrqMasked(bool masked) {
+	interruptCycle_ = &bus_->GetInterruptCycle(masked);
+}
+
+Cpu6502::Handler Cpu6502::GetHandler(Instruction instr) {
+	switch (instr) {
+		case Instruction::kADC: return &Cpu6502::ADC;
+		case Instruction::kAND: return &Cpu6502::AND;
+		case Instruction::kASL: return &Cpu6502::ASL;
+		case Instruction::kBCC: return &Cpu6502::BCC;
+		case Instruction::kBCS: return &Cpu6502::BCS;
+		case Instruction::kBEQ: return &Cpu6502::BEQ;
+		case Instruction::kBIT: return &Cpu6502::BIT;
+		case Instruction::kBMI: return &Cpu6502::BMI;
+		case Instruction::kBNE: return &Cpu6502::BNE;
+		case Instruction::kBPL: return &Cpu6502::BPL;
+		case Instruction::kBRK: return &Cpu6502::BRK;
+		case Instruction::kBVC: return &Cpu6502::BVC;
+		case Instruction::kBVS: return &Cpu6502::BVS;
+		case Instruction::kCLC: return &Cpu6502::CLC;
+		case Instruction::kCLD: return &Cpu6502::CLD;
+		case Instruction::kCLI: return &Cpu6502::CLI;
+		case Instruction::kCLV: return &Cpu6502::CLV;
+		case Instruction::kCMP: return &Cpu6502::CMP;
+		case Instruction::kCPX: return &Cpu6502::CPX;
+		case Instruction::kCPY: return &Cpu6502::CPY;
+		case Instruction::kDEC: return &Cpu6502::DEC;
+		case Instruction::kDEX: return &Cpu6502::DEX;
+		case Instruction::kDEY: return &Cpu6502::DEY;
+		case Instruction::kEOR: return &Cpu6502::EOR;
+		case Instruction::kINC: return &Cpu6502::INC;
+		case Instruction::kINX: return &Cpu6502::INX;
+		case Instruction::kINY: return &Cpu6502::INY;
+		case Instruction::kJMP: return &Cpu6502::JMP;
+		case Instruction::kJSR: return &Cpu6502::JSR;
+		case Instruction::kLDA: return &Cpu6502::LDA;
+		case Instruction::kLDX: return &Cpu6502::LDX;
+		case Instruction::kLDY: return &Cpu6502::LDY;
+		case Instruction::kLSR: return &Cpu6502::LSR;
+		case Instruction::kNOP: return &Cpu6502::NOP;
+		case Instruction::kORA: return &Cpu6502::ORA;
+		case Instruction::kPHA: return &Cpu6502::PHA;
+		case Instruction::kPHP: return &Cpu6502::PHP;
+		case Instruction::kPLA: return &Cpu6502::PLA;
+		case Instruction::kPLP: return &Cpu6502::PLP;
+		case Instruction::kROL: return &Cpu6502::ROL;
+		case Instruction::kROR: return &Cpu6502::ROR;
+		case Instruction::kRTI: return &Cpu6502::RTI;
+		case Instruction::kRTS: return &Cpu6502::RTS;
+		case Instruction::kSBC: return &Cpu6502::SBC;
+		case Instruction::kSEC: return &Cpu6502::SEC;
+		case Instruction::kSED: return &Cpu6502::SED;
+		case Instruction::kSEI: return &Cpu6502::SEI;
+		case Instruction::kSTA: return &Cpu6502::STA;
+		case Instruction::kSTX: return &Cpu6502::STX;
+		case Instruction::kSTY: return &Cpu6502::STY;
+		case Instruction::kTAX: return &Cpu6502::TAX;
+		case Instruction::kTAY: return &Cpu6502::TAY;
+		case Instruction::kTSX: return &Cpu6502::TSX;
+		case Instruction::kTXA: return &Cpu6502::TXA;
+		case Instruction::kTXS: return &Cpu6502::TXS;
+		case Instruction::kTYA: return &Cpu6502::TYA;
+		// "Illegal" Opcodes and Undocumented Instructions
+		case Instruction::kLAX: return &Cpu6502::LAX;
+		case Instruction::kSAX: return &Cpu6502::SAX;
+		case Instruction::kUSBC: return &Cpu6502::USBC;
+		case Instruction::kDCP: return &Cpu6502::DCP;
+		case Instruction::kISC: return &Cpu6502::ISC;
+		case Instruction::kSLO: return &Cpu6502::SLO;
+		case Instruction::kRLA: return &Cpu6502::RLA;
+		case Instruction::kSRE: return &Cpu6502::SRE;
+		case Instruction::kRRA: return &Cpu6502::RRA;
+	}
+
+	assert(false);
+	return &Cpu6502::NOP;
+}
+
+CpuState Cpu6502::GetState() const {
+	return CaptureState();
+}
+
+void Cpu6502::SetStateSnapshot(SeqLock<CpuState>* snapshot) {
+	stateSnapshot_ = snapshot;
+	if (stateSnapshot_) {
+		stateSnapshot_->Store(CaptureState());
+	}
+}
+
+CpuState Cpu6502::CaptureState() const {
+	return {pc_, acc_, x_, y_, stackPtr_, GetStatus(), cycle_};
+}
+
+void Cpu6502::SetState(const CpuState& state, uint16_t cyclesLeft) {
+	pc_ = state.pc;
+	acc_ = state.acc;
+	x_ = state.x;
+	y_ = state.y;
+	stackPtr_ = state.stackPtr;
+	SetStatus(state.status);
+	cycle_ = state.cycle;
+	cycleLeft_ = cyclesLeft;
+}
+
+void Cpu6502::SetProfiler(CpuProfiler* profiler) {
+	profiler_ = profiler;
+}
+
+// Called after the handler, cycleLeft_ holds the instruction's cost
+void Cpu6502::Profile(const DecodedOp& decoded) {
+	profiler_->Record(bus_->GetPrgBankId(decoded.pc), decoded.pc, decoded.opCode, cycleLeft_ + 1);
+	switch (decoded.op.instr) {
+		case Instruction::kJSR:
+		case Instruction::kBRK:
+			profiler_->EnterRoutine(bus_->GetPrgBankId(pc_), pc_);
 			break;
-		}
-		case Instruction::kTYA: {
-			TYA(op, operand);
+		case Instruction::kRTS:
+		case Instruction::kRTI:
+			profiler_->LeaveRoutine();
 			break;
-		}
-		// "Illegal" Opcodes and Undocumented Instructions
-		case Instruction::kLAX: {
-			LAX(op, operand);
+		default:
 			break;
-		}
-		case Instruction::kSAX: {
-			SAX(op, operand);
+	}
+}
+
+#ifdef NES_CPU_TRACE
+void Cpu6502::DumpTrace(std::ostream& out) const {
+	trace_.Export(out, cycle_);
+}
+
+CpuTrace& Cpu6502::GetTrace() {
+	return trace_;
+}
+#endif
+
+uint16_t Cpu6502::GetCyclesLeft() const {
+	return cycleLeft_;
+}
+
+uint64_t Cpu6502::GetCycle() const {
+	return cycle_;
+}
+
+const Cpu6502::DecodedOp& Cpu6502::NextOp() {
+	if (block_ == nullptr
+			|| blockGeneration_ != bus_->GetCodeGeneration()
+			|| blockPos_ >= block_->ops.size()
+			|| block_->ops[blockPos_].pc != pc_) {
+		block_ = &LookupBlock(pc_);
+		blockPos_ = 0;
+		blockGeneration_ = bus_->GetCodeGeneration();
+	}
+
+	return block_->ops[blockPos_++];
+}
+
+Cpu6502::Block& Cpu6502::LookupBlock(uint16_t pc) {
+	if (IsInRange(0x2000, 0x401F, pc)) { // executing I/O registers, never cache
+		DecodeBlock(uncachedBlock_, pc, 1);
+		return uncachedBlock_;
+	}
+
+	uint64_t key = (uint64_t)bus_->GetPrgBankId(pc) << 16 | pc;
+	auto& block = blocks_[key];
+	if (block.ops.empty() || (block.inRam && block.generation != bus_->GetCodeGeneration())) {
+		DecodeBlock(block, pc, kMaxBlockOps);
+	}
+
+	return block;
+}
+
+void Cpu6502::DecodeBlock(Block& block, uint16_t pc, size_t maxOps) {
+	const auto bankId = bus_->GetPrgBankId(pc);
+	block.ops.clear();
+	block.mayUnmaskIrq = false;
+	block.inRam = bankId == mapper::MapperBase::kPrgRamBank;
+
+	uint16_t addr = pc;
+	while (block.ops.size() < maxOps) {
+		auto opCode = bus_->Read(addr, true);
+		auto it = kOpDecoder.find(opCode);
+		if (it == kOpDecoder.end()) {
+			if (block.ops.empty()) {
+				kOpDecoder.at(opCode); // unknown opcode at the current PC
+			}
 			break;
 		}
-		case Instruction::kUSBC: {
-			USBC(op, operand);
-			break;
+
+		DecodedOp decoded;
+		decoded.handler = GetHandler(it->second.instr);
+		decoded.op = it->second;
+		decoded.pc = addr;
+		decoded.opCode = opCode;
+		decoded.size = OpSizeByMode(decoded.op.addrMode);
+		decoded.readsMemory = ReadsMemory(decoded.op);
+		if (decoded.size > 1) {
+			decoded.LL = bus_->Read(addr + 1, true);
 		}
-		case Instruction::kDCP: {
-			DCP(op, operand);
-			break;
+		if (decoded.size > 2) {
+			decoded.HH = bus_->Read(addr + 2, true);
 		}
-		case Instruction::kISC: {
-			ISC(op, operand);
-			break;
+		if (block.inRam) {
+			for (uint16_t i = 0; i < decoded.size; ++i) {
+				bus_->MarkCodePage(addr + i);
+			}
 		}
-		case Instruction::kSLO: {
-			SLO(op, operand);
+		block.ops.push_back(decoded);
+		block.mayUnmaskIrq |= decoded.op.instr == Instruction::kCLI ||
+				      decoded.op.instr == Instruction::kPLP ||
+				      decoded.op.instr == Instruction::kRTI;
+
+		addr += decoded.size;
+		if (EndsBlock(decoded.op.instr) || bus_->GetPrgBankId(addr) != bankId) {
 			break;
 		}
-		case Instruction::kRLA: {
-			RLA(op, operand);
-			break;
+	}
+
+	block.generation = bus_->GetCodeGeneration();
+}
+
+void Cpu6502::SetJitEnabled(bool enabled) {
+#ifdef NES_CPU_TRACE
+	enabled = false; // native blocks would bypass the trace
+#endif
+	if (enabled && !jit_ && Jit::IsSupported()) {
+		jit_ = std::make_unique<Jit>();
+	} else if (!enabled) {
+		jit_.reset();
+	}
+
+	for (auto& [key, block] : blocks_) {
+		block.hits = 0;
+		block.jitFailed = false;
+		block.native = {};
+	}
+}
+
+bool Cpu6502::IsJitEnabled() const {
+	return jit_ != nullptr;
+}
+
+// Runs the block starting at pc_ as native code, all of its instructions
+// on this cycle. Refused when an interrupt, frame flip or DMA could fall
+// inside it.
+bool Cpu6502::RunNative() {
+	if (block_ && blockGeneration_ == bus_->GetCodeGeneration() &&
+	    blockPos_ < block_->ops.size() && block_->ops[blockPos_].pc == pc_) {
+		return false; // resume the interpreted block
+	}
+
+	block_ = &LookupBlock(pc_);
+	blockPos_ = 0;
+	blockGeneration_ = bus_->GetCodeGeneration();
+
+	auto& block = *block_;
+	if (block.inRam || block_ == &uncachedBlock_) {
+		return false;
+	}
+	if (!block.native.fn) {
+		if (block.jitFailed || ++block.hits < kJitThreshold) {
+			return false;
 		}
-		case Instruction::kSRE: {
-			SRE(op, operand);
-			break;
+
+		std::vector<JitOp> ops;
+		for (const auto& d : block.ops) {
+			ops.push_back({d.op, d.pc, d.LL, d.HH, d.size});
 		}
-		case Instruction::kRRA: {
-			RRA(op, operand);
-			break;
+		block.native = jit_->Translate(ops);
+		if (!block.native.fn) {
+			block.jitFailed = true;
+			return false;
 		}
-    }
+	}
+	if (bus_->GetCyclesUntilPpuEvent() <= block.native.maxCycles ||
+	    bus_->GetNextDmaCycle() <= cycle_ + block.native.maxCycles) {
+		return false;
+	}
+	// Interrupts are only polled between interpreted instructions; a
+	// masked IRQ line is harmless unless the block clears I
+	const uint64_t blockEnd = cycle_ + block.native.maxCycles;
+	if (*interruptCycle_ <= blockEnd ||
+	    (block.mayUnmaskIrq && bus_->GetInterruptCycle() <= blockEnd)) {
+		return false;
+	}
 
-	if (bus_->CheckDMA()) {
-		cycleLeft_ += 513 + (pc_ % 2);
+	auto& ctx = jitContext_;
+	ctx.ram = bus_->GetRamData();
+	ctx.bus = bus_;
+	ctx.cycles = 0;
+	ctx.opCount = 0;
+	ctx.pc = pc_;
+	ctx.acc = acc_;
+	ctx.x = x_;
+	ctx.y = y_;
+	ctx.stackPtr = stackPtr_;
+	ctx.status = status_;
+	ctx.carry = carry_;
+	ctx.overflow = overflow_;
+	ctx.nSource = nSource_;
+	ctx.zSource = zSource_;
+
+	block.native.fn(&ctx);
+
+	if (ctx.opCount == 0) {
+		return false; // side exit on the first instruction
 	}
-}
 
-const CpuState& Cpu6502::GetState() const {
-	return cpuState_;
+	pc_ = ctx.pc;
+	acc_ = ctx.acc;
+	x_ = ctx.x;
+	y_ = ctx.y;
+	stackPtr_ = ctx.stackPtr;
+	if ((status_ ^ ctx.status) & Flag::I) {
+		SetIrqMasked(ctx.status & Flag::I);
+	}
+	status_ = ctx.status;
+	carry_ = ctx.carry;
+	overflow_ = ctx.overflow;
+	nSource_ = ctx.nSource;
+	zSource_ = ctx.zSource;
+	cycleLeft_ = ctx.cycles - 1;
+	blockPos_ = ctx.opCount;
+	return true;
 }
 
-Cpu6502::Operand Cpu6502::FetchOperand(AddressMode m) {
+Cpu6502::Operand Cpu6502::ResolveOperand(AddressMode m, uint8_t opLL, uint8_t opHH) {
 	Cpu6502::Operand res;
 	uint16_t addr = 0;
 	switch (m) {
@@ -343,37 +528,33 @@ Cpu6502::Operand Cpu6502::FetchOperand(AddressMode m) {
 			break;
 		}
 		case AddressMode::kABS: {
-			auto LL = bus_->Read(pc_ + 1);
-			auto HH = bus_->Read(pc_ + 2);
+			auto LL = opLL;
+			auto HH = opHH;
 			addr = Join(LL, HH);
-
-			res.val = bus_->Read(addr, true);
 			res.addr = addr;
 			res.boundaryCrossed = false;
 			break;
 		}
 		case AddressMode::kABX: {
-			auto LL = bus_->Read(pc_ + 1);
-			auto HH = bus_->Read(pc_ + 2);
+			auto LL = opLL;
+			auto HH = opHH;
 			addr = Join(LL, HH) + x_;
 
-			res.val = bus_->Read(addr);
 			res.addr = addr;
 			res.boundaryCrossed = (uint8_t)(LL + x_) < x_;
 			break;
 		}
 		case AddressMode::kABY: {
-			auto LL = bus_->Read(pc_ + 1);
-			auto HH = bus_->Read(pc_ + 2);
+			auto LL = opLL;
+			auto HH = opHH;
 			auto addr = Join(LL, HH) + y_;
 
-			res.val = bus_->Read(addr);
 			res.addr = addr;
 			res.boundaryCrossed = (uint8_t)(LL + y_) < y_;
 			break;
 		}
 		case AddressMode::kIMM: {
-			res.val = bus_->Read(pc_ + 1);
+			res.val = opLL;
 			res.addr = pc_ + 1;
 			res.boundaryCrossed = false;
 			break;
@@ -384,62 +565,55 @@ Cpu6502::Operand Cpu6502::FetchOperand(AddressMode m) {
 			break;
 		}
 		case AddressMode::kIND: {
-			auto LL = bus_->Read(pc_ + 1);
-			auto HH = bus_->Read(pc_ + 2);
+			auto LL = opLL;
+			auto HH = opHH;
 			addr = Join(LL, HH);
 			LL = bus_->Read(addr);
 			HH = bus_->Read((uint16_t)HH << 8 | ((addr + 1) & 0xFF));
 			addr = Join(LL, HH);
-
-			res.val = bus_->Read(addr);
 			res.addr = addr;
 			res.boundaryCrossed = false;
 			break;
 		}
 		case AddressMode::kINX: {
-			addr = bus_->Read(pc_ + 1) + x_;
+			addr = opLL + x_;
 			auto LL = bus_->Read(addr & 0xFF);
 			auto HH = bus_->Read((addr + 1) & 0xFF);
 			addr = Join(LL, HH);
-			res.val = bus_->Read(addr);
 			res.addr = addr;
 			res.boundaryCrossed = false;
 			break;
 		}
 		case AddressMode::kINY: {
-			addr = bus_->Read(pc_ + 1);
+			addr = opLL;
 			auto LL = bus_->Read(addr & 0xFF);
 			auto HH = bus_->Read((addr + 1) & 0xFF);
 			addr = Join(LL, HH) + y_;
 
-			res.val = bus_->Read(addr);
 			res.addr = addr;
 			res.boundaryCrossed = (uint8_t)(LL + y_) < y_;
 			break;
 		}
 		case AddressMode::kREL: {
-			res.val = bus_->Read(pc_ + 1);
+			res.val = opLL;
 			res.addr = pc_ + 1;
 			res.boundaryCrossed = ((pc_ + (int8_t)res.val) & 0xFF00) != (pc_ & 0xFF00);
 			break;
 		}
 		case AddressMode::kZP: {
-			addr = bus_->Read(pc_ + 1);
-			res.val = bus_->Read(addr);
+			addr = opLL;
 			res.addr = addr;
 			res.boundaryCrossed = false;
 			break;
 		}
 		case AddressMode::kZPX: {
-			addr = (bus_->Read(pc_ + 1) + x_) & 0xFF;
-			res.val = bus_->Read(addr);
+			addr = (opLL + x_) & 0xFF;
 			res.addr = addr;
 			res.boundaryCrossed = false;
 			break;
 		}
 		case AddressMode::kZPY: {
-			addr = (bus_->Read(pc_ + 1) + y_) & 0xFF;
-			res.val = bus_->Read(addr);
+			addr = (opLL + y_) & 0xFF;
 			res.addr = addr;
 			res.boundaryCrossed = false;
 			break;
@@ -459,6 +633,31 @@ void Cpu6502::SetFlag(Flag f, bool active) {
 	} else {
 		status_ &= ~f;
 	}
+	if (f == Flag::I) {
+		SetIrqMasked(active);
+	}
+}
+
+uint8_t Cpu6502::GetStatus() const {
+	return (status_ & ~(Flag::N | Flag::V | Flag::Z | Flag::C)) |
+		(nSource_ & Flag::N) |
+		(overflow_ ? Flag::V : 0) |
+		(zSource_ == 0 ? Flag::Z : 0) |
+		(carry_ ? Flag::C : 0);
+}
+
+void Cpu6502::SetStatus(uint8_t status) {
+	status_ = status;
+	nSource_ = status & Flag::N;
+	zSource_ = !(status & Flag::Z);
+	carry_ = status & Flag::C;
+	overflow_ = status & Flag::V;
+	SetIrqMasked(status & Flag::I);
+}
+
+void Cpu6502::SetNZ(uint8_t val) {
+	nSource_ = val;
+	zSource_ = val;
 }
 
 void Cpu6502::PushStack(uint8_t val) {
@@ -469,25 +668,14 @@ uint8_t Cpu6502::PopStack() {
 	return bus_->Read(0x100 + ++stackPtr_);
 }
 
-void Cpu6502::UpdateState() {
-	cpuState_.pc = pc_;
-	cpuState_.acc = acc_;
-	cpuState_.x = x_;
-	cpuState_.y = y_;
-	cpuState_.stackPtr = stackPtr_;
-	cpuState_.status = status_;
-	cpuState_.cycle = cycle_;
-}
-
 // Official op implementations
 
 void Cpu6502::ADC(Operation op, Cpu6502::Operand operand) {
-	uint16_t sum = acc_ + operand.val + (IsSet(Flag::C) ? 1 : 0);
+	uint16_t sum = acc_ + operand.val + carry_;
 	uint8_t result = sum & 0xFF;
-	SetFlag(Flag::C, sum >> 8);
-	SetFlag(Flag::V, !((acc_ ^ operand.val) & 0x80) && ((acc_ ^ result) & 0x80));
-	SetFlag(Flag::N, result & 0x80);
-	SetFlag(Flag::Z, !result);
+	carry_ = sum >> 8;
+	overflow_ = !((acc_ ^ operand.val) & 0x80) && ((acc_ ^ result) & 0x80);
+	SetNZ(result);
 	acc_ = result;
 
 	switch (op.addrMode) {
@@ -526,8 +714,7 @@ void Cpu6502::ADC(Operation op, Cpu6502::Operand operand) {
 void Cpu6502::AND(Operation op, Cpu6502::Operand operand) {
 	acc_ = acc_ & operand.val;
 
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -565,9 +752,8 @@ void Cpu6502::AND(Operation op, Cpu6502::Operand operand) {
 void Cpu6502::ASL(Operation op, Cpu6502::Operand operand) {
 	uint8_t res = operand.val << 1;
 
-	SetFlag(Flag::C, operand.val & 0x80);
-	SetFlag(Flag::N, res & 0x80);
-	SetFlag(Flag::Z, res == 0);
+	carry_ = operand.val & 0x80;
+	SetNZ(res);
 
 	if (operand.addr) {
 		bus_->Write(operand.addr.value(), res);
@@ -600,7 +786,7 @@ void Cpu6502::ASL(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BCC(Operation op, Cpu6502::Operand operand) {
-	if (!IsSet(Flag::C)) {
+	if (!carry_) {
 		pc_ += (int8_t)operand.val;
 		cycleLeft_ += 3 + (operand.boundaryCrossed ? 1 : 0);
 	} else {
@@ -609,7 +795,7 @@ void Cpu6502::BCC(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BCS(Operation op, Cpu6502::Operand operand) {
-	if (IsSet(Flag::C)) {
+	if (carry_) {
 		pc_ += (int8_t)operand.val;
 		cycleLeft_ += 3 + (operand.boundaryCrossed ? 1 : 0);
 	} else {
@@ -618,7 +804,7 @@ void Cpu6502::BCS(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BEQ(Operation op, Cpu6502::Operand operand) {
-	if (IsSet(Flag::Z)) {
+	if (zSource_ == 0) {
 		pc_ += (int8_t)operand.val;
 		cycleLeft_ += 3 + (operand.boundaryCrossed ? 1 : 0);
 	} else {
@@ -627,9 +813,9 @@ void Cpu6502::BEQ(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BIT(Operation op, Cpu6502::Operand operand) {
-	SetFlag(Flag::N, operand.val & 0x80);
-	SetFlag(Flag::V, operand.val & 0x40);
-	SetFlag(Flag::Z, !(acc_ & operand.val));
+	nSource_ = operand.val;
+	zSource_ = acc_ & operand.val;
+	overflow_ = operand.val & 0x40;
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -647,7 +833,7 @@ void Cpu6502::BIT(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BMI(Operation op, Cpu6502::Operand operand) {
-	if (IsSet(Flag::N)) {
+	if (nSource_ & 0x80) {
 		pc_ += (int8_t)operand.val;
 		cycleLeft_ += 3 + (operand.boundaryCrossed ? 1 : 0);
 	} else {
@@ -656,7 +842,7 @@ void Cpu6502::BMI(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BNE(Operation op, Cpu6502::Operand operand) {
-	if (!IsSet(Flag::Z)) {
+	if (zSource_ != 0) {
 		pc_ += (int8_t)operand.val;
 		cycleLeft_ += 3 + (operand.boundaryCrossed ? 1 : 0);
 	} else {
@@ -665,7 +851,7 @@ void Cpu6502::BNE(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BPL(Operation op, Cpu6502::Operand operand) {
-	if (!IsSet(Flag::N)) {
+	if (!(nSource_ & 0x80)) {
 		pc_ += (int8_t)operand.val;
 		cycleLeft_ += 3 + (operand.boundaryCrossed ? 1 : 0);
 	} else {
@@ -677,7 +863,7 @@ void Cpu6502::BRK(Operation op, Cpu6502::Operand operand) {
 	auto addr = pc_ + 1;
 	PushStack((addr >> 8) & 0xFF);
 	PushStack(addr & 0xFF);
-	PushStack(status_ | Flag::B | Flag::X);
+	PushStack(GetStatus() | Flag::B | Flag::X);
 
 	pc_ = bus_->Read(0xFFFE) | (bus_->Read(0xFFFF) << 8);
 	SetFlag(Flag::I, true);
@@ -686,7 +872,7 @@ void Cpu6502::BRK(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BVC(Operation op, Cpu6502::Operand operand) {
-	if (!IsSet(Flag::V)) {
+	if (!overflow_) {
 		pc_ += (int8_t)operand.val;
 		cycleLeft_ += 3 + (operand.boundaryCrossed ? 1 : 0);
 	} else {
@@ -695,7 +881,7 @@ void Cpu6502::BVC(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::BVS(Operation op, Cpu6502::Operand operand) {
-	if (IsSet(Flag::V)) {
+	if (overflow_) {
 		pc_ += (int8_t)operand.val;
 		cycleLeft_ += 3 + (operand.boundaryCrossed ? 1 : 0);
 	} else {
@@ -704,7 +890,7 @@ void Cpu6502::BVS(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::CLC(Operation op, Cpu6502::Operand operand) {
-	SetFlag(Flag::C, false);
+	carry_ = false;
 	cycleLeft_ += 2;
 }
 
@@ -714,20 +900,21 @@ void Cpu6502::CLD(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::CLI(Operation op, Cpu6502::Operand operand) {
+	const bool before = IsSet(Flag::I);
 	SetFlag(Flag::I, false);
 	cycleLeft_ += 2;
+	DelayIrqMask(before);
 }
 
 void Cpu6502::CLV(Operation op, Cpu6502::Operand operand) {
-	SetFlag(Flag::V, false);
+	overflow_ = false;
 	cycleLeft_ += 2;
 }
 
 void Cpu6502::CMP(Operation op, Cpu6502::Operand operand) {
 	auto res = acc_ - operand.val;
-	SetFlag(Flag::N, res != 0 ? (res & 0x80) : 0);
-	SetFlag(Flag::Z, res == 0);
-	SetFlag(Flag::C, res >= 0);
+	SetNZ((uint8_t)res);
+	carry_ = res >= 0;
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -763,9 +950,8 @@ void Cpu6502::CMP(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::CPX(Operation op, Cpu6502::Operand operand) {
 	auto res = x_ - operand.val;
-	SetFlag(Flag::N, res != 0 ? (res & 0x80) : 0);
-	SetFlag(Flag::Z, res == 0);
-	SetFlag(Flag::C, res >= 0);
+	SetNZ((uint8_t)res);
+	carry_ = res >= 0;
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -787,9 +973,8 @@ void Cpu6502::CPX(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::CPY(Operation op, Cpu6502::Operand operand) {
 	auto res = y_ - operand.val;
-	SetFlag(Flag::N, res != 0 ? (res & 0x80) : 0);
-	SetFlag(Flag::Z, res == 0);
-	SetFlag(Flag::C, res >= 0);
+	SetNZ((uint8_t)res);
+	carry_ = res >= 0;
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -810,8 +995,7 @@ void Cpu6502::CPY(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::DEC(Operation op, Cpu6502::Operand operand) {
 	uint8_t res = operand.val - 1;
-	SetFlag(Flag::N, res & 0x80);
-	SetFlag(Flag::Z, res == 0);
+	SetNZ(res);
 	bus_->Write(operand.addr.value(), res);
 
 	switch (op.addrMode) {
@@ -836,24 +1020,21 @@ void Cpu6502::DEC(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::DEX(Operation op, Cpu6502::Operand operand) {
 	x_--;
-	SetFlag(Flag::N, x_ & 0x80);
-	SetFlag(Flag::Z, x_ == 0);
+	SetNZ(x_);
 
 	cycleLeft_ += 2;
 }
 
 void Cpu6502::DEY(Operation op, Cpu6502::Operand operand) {
 	y_--;
-	SetFlag(Flag::N, y_ & 0x80);
-	SetFlag(Flag::Z, y_ == 0);
+	SetNZ(y_);
 
 	cycleLeft_ += 2;
 }
 
 void Cpu6502::EOR(Operation op, Cpu6502::Operand operand) {
 	acc_ ^= operand.val;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -889,8 +1070,7 @@ void Cpu6502::EOR(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::INC(Operation op, Cpu6502::Operand operand) {
 	uint8_t res = operand.val + 1;
-	SetFlag(Flag::N, res & 0x80);
-	SetFlag(Flag::Z, res == 0);
+	SetNZ(res);
 	bus_->Write(operand.addr.value(), res);
 
 	switch (op.addrMode) {
@@ -915,16 +1095,14 @@ void Cpu6502::INC(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::INX(Operation op, Cpu6502::Operand operand) {
 	x_++;
-	SetFlag(Flag::N, x_ & 0x80);
-	SetFlag(Flag::Z, x_ == 0);
+	SetNZ(x_);
 
 	cycleLeft_ += 2;
 }
 
 void Cpu6502::INY(Operation op, Cpu6502::Operand operand) {
 	y_++;
-	SetFlag(Flag::N, y_ & 0x80);
-	SetFlag(Flag::Z, y_ == 0);
+	SetNZ(y_);
 
 	cycleLeft_ += 2;
 }
@@ -957,8 +1135,7 @@ void Cpu6502::JSR(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::LDA(Operation op, Cpu6502::Operand operand) {
 	acc_ = operand.val;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -995,8 +1172,7 @@ void Cpu6502::LDA(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::LDX(Operation op, Cpu6502::Operand operand) {
 	x_ = operand.val;
-	SetFlag(Flag::N, x_ & 0x80);
-	SetFlag(Flag::Z, x_ == 0);
+	SetNZ(x_);
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -1024,8 +1200,7 @@ void Cpu6502::LDX(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::LDY(Operation op, Cpu6502::Operand operand) {
 	y_ = operand.val;
-	SetFlag(Flag::N, y_ & 0x80);
-	SetFlag(Flag::Z, y_ == 0);
+	SetNZ(y_);
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -1054,9 +1229,8 @@ void Cpu6502::LDY(Operation op, Cpu6502::Operand operand) {
 void Cpu6502::LSR(Operation op, Cpu6502::Operand operand) {
 	uint8_t res = operand.val >> 1;
 
-	SetFlag(Flag::C, operand.val & 0x01);
-	SetFlag(Flag::N, false);
-	SetFlag(Flag::Z, res == 0);
+	carry_ = operand.val & 0x01;
+	SetNZ(res);
 
 	if (operand.addr) {
 		bus_->Write(operand.addr.value(), res);
@@ -1118,8 +1292,7 @@ void Cpu6502::NOP(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::ORA(Operation op, Cpu6502::Operand operand) {
 	acc_ = acc_ | operand.val;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -1161,33 +1334,33 @@ void Cpu6502::PHA(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::PHP(Operation op, Cpu6502::Operand operand) {
-	PushStack(status_ | Flag::X | Flag::B);
+	PushStack(GetStatus() | Flag::X | Flag::B);
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 3;
 }
 
 void Cpu6502::PLA(Operation op, Cpu6502::Operand operand) {
 	acc_ = PopStack();
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 4;
 }
 
 void Cpu6502::PLP(Operation op, Cpu6502::Operand operand) {
-	status_ = (PopStack() & ~Flag::B) | Flag::X;
+	const bool before = IsSet(Flag::I);
+	SetStatus((PopStack() & ~Flag::B) | Flag::X);
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 4;
+	DelayIrqMask(before);
 }
 
 void Cpu6502::ROL(Operation op, Cpu6502::Operand operand) {
 	uint8_t res = operand.val << 1;
-	res |= IsSet(Flag::C) ? 0x01 : 0x00;
+	res |= carry_ ? 0x01 : 0x00;
 
-	SetFlag(Flag::C, operand.val & 0x80);
-	SetFlag(Flag::N, res & 0x80);
-	SetFlag(Flag::Z, res == 0);
+	carry_ = operand.val & 0x80;
+	SetNZ(res);
 
 	if (operand.addr) {
 		bus_->Write(operand.addr.value(), res);
@@ -1221,11 +1394,10 @@ void Cpu6502::ROL(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::ROR(Operation op, Cpu6502::Operand operand) {
 	uint8_t res = operand.val >> 1;
-	res |= IsSet(Flag::C) ? 0x80 : 0x00;
+	res |= carry_ ? 0x80 : 0x00;
 
-	SetFlag(Flag::C, operand.val & 0x01);
-	SetFlag(Flag::N, res & 0x80);
-	SetFlag(Flag::Z, res == 0);
+	carry_ = operand.val & 0x01;
+	SetNZ(res);
 
 	if (operand.addr) {
 		bus_->Write(operand.addr.value(), res);
@@ -1258,7 +1430,7 @@ void Cpu6502::ROR(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::RTI(Operation op, Cpu6502::Operand operand) {
-	status_ = (PopStack() & ~Flag::B) | Flag::X;
+	SetStatus((PopStack() & ~Flag::B) | Flag::X);
 	uint16_t addr = PopStack();  // LL
 	addr |= PopStack() << 8;     // HH
 	pc_ = addr;
@@ -1277,12 +1449,11 @@ void Cpu6502::RTS(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::SBC(Operation op, Cpu6502::Operand operand) {
-	const uint16_t sum = acc_ + ~operand.val + (IsSet(Flag::C) ? 1 : 0);
+	const uint16_t sum = acc_ + ~operand.val + carry_;
 	const uint8_t result = sum & 0xFF;
-	SetFlag(Flag::C, !(sum >> 8));
-	SetFlag(Flag::V, !!((~(acc_ ^ ~operand.val)) & (acc_ ^ result) & 0x80));
-	SetFlag(Flag::N, !!(result & 0x80));
-	SetFlag(Flag::Z, !result);
+	carry_ = !(sum >> 8);
+	overflow_ = !!((~(acc_ ^ ~operand.val)) & (acc_ ^ result) & 0x80);
+	SetNZ(result);
 	acc_ = result;
 
 	switch (op.addrMode) {
@@ -1319,7 +1490,7 @@ void Cpu6502::SBC(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::SEC(Operation op, Cpu6502::Operand operand) {
-	SetFlag(Flag::C, true);
+	carry_ = true;
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 2;
 }
@@ -1331,9 +1502,11 @@ void Cpu6502::SED(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::SEI(Operation op, Cpu6502::Operand operand) {
+	const bool before = IsSet(Flag::I);
 	SetFlag(Flag::I, true);
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 2;
+	DelayIrqMask(before);
 }
 
 void Cpu6502::STA(Operation op, Cpu6502::Operand operand) {
@@ -1413,8 +1586,7 @@ void Cpu6502::STY(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::TAX(Operation op, Cpu6502::Operand operand) {
 	x_ = acc_;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 2;
@@ -1422,8 +1594,7 @@ void Cpu6502::TAX(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::TAY(Operation op, Cpu6502::Operand operand) {
 	y_ = acc_;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 2;
@@ -1431,8 +1602,7 @@ void Cpu6502::TAY(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::TSX(Operation op, Cpu6502::Operand operand) {
 	x_ = stackPtr_;
-	SetFlag(Flag::N, stackPtr_ & 0x80);
-	SetFlag(Flag::Z, stackPtr_ == 0);
+	SetNZ(stackPtr_);
 
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 2;
@@ -1440,8 +1610,7 @@ void Cpu6502::TSX(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::TXA(Operation op, Cpu6502::Operand operand) {
 	acc_ = x_;
-	SetFlag(Flag::N, x_ & 0x80);
-	SetFlag(Flag::Z, x_ == 0);
+	SetNZ(x_);
 
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 2;
@@ -1456,8 +1625,7 @@ void Cpu6502::TXS(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::TYA(Operation op, Cpu6502::Operand operand) {
 	acc_ = y_;
-	SetFlag(Flag::N, y_ & 0x80);
-	SetFlag(Flag::Z, y_ == 0);
+	SetNZ(y_);
 
 	assert(op.addrMode == AddressMode::kIMP);
 	cycleLeft_ += 2;
@@ -1467,8 +1635,7 @@ void Cpu6502::TYA(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::LAX(Operation op, Cpu6502::Operand operand) {
 	acc_ = x_ = operand.val;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	switch (op.addrMode) {
 		case AddressMode::kABS:
@@ -1522,12 +1689,11 @@ void Cpu6502::SAX(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::USBC(Operation op, Cpu6502::Operand operand) {
-	const uint16_t sum = acc_ + ~operand.val + (IsSet(Flag::C) ? 1 : 0);
+	const uint16_t sum = acc_ + ~operand.val + carry_;
 	const uint8_t result = sum & 0xFF;
-	SetFlag(Flag::C, !(sum >> 8));
-	SetFlag(Flag::V, !!((~(acc_ ^ ~operand.val)) & (acc_ ^ result) & 0x80));
-	SetFlag(Flag::N, !!(result & 0x80));
-	SetFlag(Flag::Z, !result);
+	carry_ = !(sum >> 8);
+	overflow_ = !!((~(acc_ ^ ~operand.val)) & (acc_ ^ result) & 0x80);
+	SetNZ(result);
 	acc_ = result;
 
 	assert(op.addrMode == AddressMode::kIMM);
@@ -1535,11 +1701,10 @@ void Cpu6502::USBC(Operation op, Cpu6502::Operand operand) {
 }
 
 void Cpu6502::DCP(Operation op, Cpu6502::Operand operand) {
-	bus_->Write(operand.addr.value(), operand.val - 1);
-	auto res = acc_ - operand.val + 1;
-	SetFlag(Flag::N, res != 0 ? (res & 0x80) : 0);
-	SetFlag(Flag::Z, (res & 0xFF) == 0);
-	SetFlag(Flag::C, res >= 0);
+	const uint8_t val = operand.val - 1;
+	bus_->Write(operand.addr.value(), val);
+	SetNZ(acc_ - val);
+	carry_ = acc_ >= val;
 
 	switch (op.addrMode) {
 		case AddressMode::kZP:
@@ -1575,12 +1740,11 @@ void Cpu6502::ISC(Operation op, Cpu6502::Operand operand) {
 	uint8_t incRes = operand.val + 1;
 	bus_->Write(operand.addr.value(), incRes);
 
-	const uint16_t sum = acc_ + ~incRes + (IsSet(Flag::C) ? 1 : 0);
+	const uint16_t sum = acc_ + ~incRes + carry_;
 	const uint8_t addRes = sum & 0xFF;
-	SetFlag(Flag::C, !(sum >> 8));
-	SetFlag(Flag::V, !!((~(acc_ ^ ~incRes)) & (acc_ ^ addRes) & 0x80));
-	SetFlag(Flag::N, !!(addRes & 0x80));
-	SetFlag(Flag::Z, !addRes);
+	carry_ = !(sum >> 8);
+	overflow_ = !!((~(acc_ ^ ~incRes)) & (acc_ ^ addRes) & 0x80);
+	SetNZ(addRes);
 	acc_ = addRes;
 
 	switch (op.addrMode) {
@@ -1615,12 +1779,11 @@ void Cpu6502::ISC(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::SLO(Operation op, Cpu6502::Operand operand) {
 	uint8_t shiftRes = operand.val << 1;
-	SetFlag(Flag::C, operand.val & 0x80);
+	carry_ = operand.val & 0x80;
 	bus_->Write(operand.addr.value(), shiftRes);
 
 	acc_ = acc_ | shiftRes;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	switch (op.addrMode) {
 		case AddressMode::kZP:
@@ -1654,13 +1817,12 @@ void Cpu6502::SLO(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::RLA(Operation op, Cpu6502::Operand operand) {
 	uint8_t shiftRes = operand.val << 1;
-	shiftRes |= IsSet(Flag::C) ? 0x01 : 0x00;
-	SetFlag(Flag::C, operand.val & 0x80);
+	shiftRes |= carry_ ? 0x01 : 0x00;
+	carry_ = operand.val & 0x80;
 	bus_->Write(operand.addr.value(), shiftRes);
 
 	acc_ = acc_ & shiftRes;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	switch (op.addrMode) {
 		case AddressMode::kZP:
@@ -1694,12 +1856,11 @@ void Cpu6502::RLA(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::SRE(Operation op, Cpu6502::Operand operand) {
 	uint8_t shiftRes = operand.val >> 1;
-	SetFlag(Flag::C, operand.val & 0x01);
+	carry_ = operand.val & 0x01;
 	bus_->Write(operand.addr.value(), shiftRes);
 
 	acc_ ^= shiftRes;
-	SetFlag(Flag::N, acc_ & 0x80);
-	SetFlag(Flag::Z, acc_ == 0);
+	SetNZ(acc_);
 
 	switch (op.addrMode) {
 		case AddressMode::kZP:
@@ -1733,16 +1894,15 @@ void Cpu6502::SRE(Operation op, Cpu6502::Operand operand) {
 
 void Cpu6502::RRA(Operation op, Cpu6502::Operand operand) {
 	uint8_t shiftRes = operand.val >> 1;
-	shiftRes |= IsSet(Flag::C) ? 0x80 : 0x00;
-	SetFlag(Flag::C, operand.val & 0x01);
+	shiftRes |= carry_ ? 0x80 : 0x00;
+	carry_ = operand.val & 0x01;
 	bus_->Write(operand.addr.value(), shiftRes);
 
-	const uint16_t sum = acc_ + shiftRes + (IsSet(Flag::C) ? 1 : 0);
+	const uint16_t sum = acc_ + shiftRes + carry_;
 	const uint8_t addRes = sum & 0xFF;
-	SetFlag(Flag::C, sum >> 8);
-	SetFlag(Flag::V, !!((acc_ ^ addRes) & (shiftRes ^ addRes) & 0x80));
-	SetFlag(Flag::N, !!(addRes & 0x80));
-	SetFlag(Flag::Z, !addRes);
+	carry_ = sum >> 8;
+	overflow_ = !!((acc_ ^ addRes) & (shiftRes ^ addRes) & 0x80);
+	SetNZ(addRes);
 	acc_ = addRes;
 
 	switch (op.addrMode) {
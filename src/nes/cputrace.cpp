@@ -0,0 +1,103 @@
+#include "nes/cputrace.h"
+
+#include "nes/instructions.h"
+#include "nes/types.h"
+
+#include <tfm/tinyformat.h>
+#include <algorithm>
+#include <bit>
+
+namespace nes {
+
+namespace {
+
+bool IsUnofficial(Instruction instr, uint8_t opCode) {
+	switch (instr) {
+		case Instruction::kLAX:
+		case Instruction::kSAX:
+		case Instruction::kUSBC:
+		case Instruction::kDCP:
+		case Instruction::kISC:
+		case Instruction::kSLO:
+		case Instruction::kRLA:
+		case Instruction::kSRE:
+		case Instruction::kRRA:
+			return true;
+		case Instruction::kNOP:
+			return opCode != 0xEA;
+		default:
+			return false;
+	}
+}
+
+std::string FormatOperand(AddressMode m, const TraceEntry& e) {
+	const uint8_t LL = e.code[1];
+	const uint16_t addr = (uint16_t)e.code[2] << 8 | LL;
+	switch (m) {
+		case AddressMode::kACC: return "A";
+		case AddressMode::kABS: return tfm::format("$%04X", addr);
+		case AddressMode::kABX: return tfm::format("$%04X,X", addr);
+		case AddressMode::kABY: return tfm::format("$%04X,Y", addr);
+		case AddressMode::kIMM: return tfm::format("#$%02X", LL);
+		case AddressMode::kIMP: return "";
+		case AddressMode::kIND: return tfm::format("($%04X)", addr);
+		case AddressMode::kINX: return tfm::format("($%02X,X)", LL);
+		case AddressMode::kINY: return tfm::format("($%02X),Y", LL);
+		case AddressMode::kREL: return tfm::format("$%04X", (uint16_t)(e.pc + 2 + (int8_t)LL));
+		case AddressMode::kZP:  return tfm::format("$%02X", LL);
+		case AddressMode::kZPX: return tfm::format("$%02X,X", LL);
+		case AddressMode::kZPY: return tfm::format("$%02X,Y", LL);
+	}
+	return "";
+}
+
+} // namespace
+
+CpuTrace::CpuTrace(size_t capacity) {
+	capacity = std::bit_ceil(std::max<size_t>(capacity, 1));
+	entries_ = std::make_unique<TraceEntry[]>(capacity);
+	mask_ = capacity - 1;
+}
+
+void CpuTrace::Clear() {
+	head_ = 0;
+}
+
+size_t CpuTrace::GetSize() const {
+	return std::min(head_, mask_ + 1);
+}
+
+void CpuTrace::Export(std::ostream& out, uint64_t currentCycle) const {
+	constexpr uint32_t kCycleMask = (1u << TraceEntry::kCycleBits) - 1;
+	const size_t size = GetSize();
+	for (size_t i = head_ - size; i != head_; ++i) {
+		const auto& e = entries_[i & mask_];
+		const uint32_t age = ((uint32_t)currentCycle - e.GetCycleLow()) & kCycleMask;
+		const uint64_t cycle = currentCycle - age;
+
+		std::string bytes = tfm::format("%02X", e.code[0]);
+		std::string text = "???";
+		bool unofficial = false;
+		auto it = kOpDecoder.find(e.code[0]);
+		if (it != kOpDecoder.end()) {
+			const auto& op = it->second;
+			for (int b = 1; b < OpSizeByMode(op.addrMode); ++b) {
+				bytes += tfm::format(" %02X", e.code[b]);
+			}
+			unofficial = IsUnofficial(op.instr, e.code[0]);
+			text = ToString(op.instr);
+			const auto operand = FormatOperand(op.addrMode, e);
+			if (!operand.empty()) {
+				text += " " + operand;
+			}
+		}
+
+		out << tfm::format("%04X  %-8s %c%-31s A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%d\n",
+				   e.pc, bytes, unofficial ? '*' : ' ', text,
+				   e.acc, e.x, e.y, e.status, e.stackPtr,
+				   e.GetDot() / kScanlineColCount, e.GetDot() % kScanlineColCount,
+				   cycle);
+	}
+}
+
+} // namespace nes
@@ -0,0 +1,228 @@
+#include "nes/differential.h"
+
+#include "nes/types.h"
+#include "nes/utils.h"
+
+#include <tfm/tinyformat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace nes {
+
+namespace {
+
+bool SameState(const CpuState& a, const CpuState& b) {
+	return a.pc == b.pc && a.acc == b.acc && a.x == b.x && a.y == b.y &&
+		a.stackPtr == b.stackPtr && a.status == b.status && a.cycle == b.cycle;
+}
+
+std::string FormatState(const CpuState& s) {
+	return tfm::format("PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%d",
+			   s.pc, s.acc, s.x, s.y, s.status, s.stackPtr, s.cycle);
+}
+
+std::string FormatPpu(const Ppu2C02::RegisterState& s) {
+	return tfm::format("DOT:%d V:%04X BUF:%02X STATUS:%02X OAM:%02X SCROLL:%d,%d/%d%s",
+			   s.dotIdx, s.vramAddress, s.vramBuffer, s.status, s.oamAddress,
+			   s.scrollX, s.scrollY, s.scrollSetIndex, s.oddFrame ? " ODD" : "");
+}
+
+uint64_t HashFrame(Machine& machine) {
+	const auto* frame = machine.GetOwnFramebuffers()[machine.GetPpu().GetActiveFramebufferId()];
+	return HashBytes(frame, sizeof(RGBA) * kScreenColCount * kScreenRowCount);
+}
+
+std::vector<uint8_t> LoadFile(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	return {std::istreambuf_iterator<char>(in), {}};
+}
+
+} // namespace
+
+DifferentialRunner::DifferentialRunner(Options options)
+: options_(std::move(options)) {}
+
+DifferentialRunner::Result DifferentialRunner::Run(const std::string& name,
+						   std::span<const uint8_t> rom) const {
+	Result res;
+	res.name = name;
+
+	Side a{&options_.a, {}, {}};
+	Side b{&options_.b, {}, {}};
+	if (!Setup(a, rom) || !Setup(b, rom)) {
+		res.report = "cannot load ROM";
+		return res;
+	}
+	res.loaded = true;
+
+	auto& cpuA = a.machine->GetCpu();
+	auto& cpuB = b.machine->GetCpu();
+	auto& ppuA = a.machine->GetPpu();
+	auto& ppuB = b.machine->GetPpu();
+
+	for (uint32_t frame = 0; frame < options_.frames; ++frame) {
+		std::string diff;
+		if (options_.granularity == Granularity::kFrame) {
+			a.machine->RunFrame();
+			b.machine->RunFrame();
+		} else {
+			// Step whichever side is behind; both are compared whenever
+			// they sit at an instruction boundary at the same cycle
+			const auto frameA = ppuA.GetActiveFramebufferId();
+			const auto frameB = ppuB.GetActiveFramebufferId();
+			while (diff.empty()) {
+				const bool doneA = ppuA.GetActiveFramebufferId() != frameA;
+				const bool doneB = ppuB.GetActiveFramebufferId() != frameB;
+				if (doneA && doneB) {
+					break;
+				}
+				const auto cycleA = cpuA.GetState().cycle;
+				const auto cycleB = cpuB.GetState().cycle;
+				if (!doneA && (doneB || cycleA <= cycleB)) {
+					Advance(a);
+				} else {
+					Advance(b);
+				}
+
+				if (cpuA.GetCyclesLeft() == 0 && cpuB.GetCyclesLeft() == 0 &&
+				    cpuA.GetState().cycle == cpuB.GetState().cycle) {
+					++res.comparisons;
+					diff = CompareBoundary(a, b);
+				}
+			}
+		}
+
+		if (diff.empty()) {
+			++res.comparisons;
+			diff = CompareFrame(a, b);
+		}
+		if (!diff.empty()) {
+			res.diverged = true;
+			res.report = Report(diff, frame, a, b);
+			return res;
+		}
+		res.frames = frame + 1;
+	}
+	return res;
+}
+
+std::vector<DifferentialRunner::Result> DifferentialRunner::RunCorpus(
+		const std::vector<std::string>& paths, size_t jobs) const {
+	std::vector<Result> results(paths.size());
+	std::atomic<size_t> next = 0;
+	auto worker = [&] {
+		for (size_t idx = next++; idx < paths.size(); idx = next++) {
+			results[idx] = Run(paths[idx], LoadFile(paths[idx]));
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const size_t count = std::clamp<size_t>(jobs, 1, std::max<size_t>(paths.size(), 1));
+	for (size_t i = 1; i < count; ++i) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : threads) {
+		t.join();
+	}
+	return results;
+}
+
+bool DifferentialRunner::Setup(Side& side, std::span<const uint8_t> rom) const {
+	side.machine = std::make_unique<Machine>();
+	if (!side.machine->LoadRom(rom)) {
+		return false;
+	}
+	side.machine->SetIdleLoopSkipping(side.backend->skipIdleLoops);
+	side.machine->GetCpu().SetJitEnabled(side.backend->jit);
+	if (side.backend->setup) {
+		side.backend->setup(*side.machine);
+	}
+	return true;
+}
+
+void DifferentialRunner::Advance(Side& side) const {
+	side.machine->Step();
+	auto& cpu = side.machine->GetCpu();
+	if (cpu.GetCyclesLeft() != 0 || options_.contextLength == 0) {
+		return;
+	}
+
+	// Silent reads, the code bytes must not disturb I/O registers
+	auto& bus = side.machine->GetBus();
+	TraceLine line;
+	line.cpu = cpu.GetState();
+	for (uint16_t i = 0; i < 3; ++i) {
+		line.code[i] = bus.Read(line.cpu.pc + i, true);
+	}
+	if (side.trace.size() == options_.contextLength) {
+		side.trace.pop_front();
+	}
+	side.trace.push_back(line);
+}
+
+std::string DifferentialRunner::CompareBoundary(Side& a, Side& b) const {
+	const auto cpuA = a.machine->GetCpu().GetState();
+	const auto cpuB = b.machine->GetCpu().GetState();
+	if (!SameState(cpuA, cpuB)) {
+		return tfm::format("CPU state differs\n  %-12s %s\n  %-12s %s",
+				   a.backend->name, FormatState(cpuA), b.backend->name, FormatState(cpuB));
+	}
+
+	const auto ramA = a.machine->GetBus().GetRamHash();
+	const auto ramB = b.machine->GetBus().GetRamHash();
+	if (ramA != ramB) {
+		const auto* dataA = a.machine->GetBus().GetRamData();
+		const auto* dataB = b.machine->GetBus().GetRamData();
+		const auto* mismatch = std::mismatch(dataA, dataA + 0x800, dataB).first;
+		const auto addr = mismatch - dataA;
+		return tfm::format("RAM differs at %s, first at $%04X: %02X vs %02X",
+				   FormatState(cpuA), addr, dataA[addr % 0x800], dataB[addr % 0x800]);
+	}
+
+	const auto ppuA = a.machine->GetPpu().GetRegisterState();
+	const auto ppuB = b.machine->GetPpu().GetRegisterState();
+	if (!(ppuA == ppuB)) {
+		return tfm::format("PPU registers differ at %s\n  %-12s %s\n  %-12s %s",
+				   FormatState(cpuA), a.backend->name, FormatPpu(ppuA),
+				   b.backend->name, FormatPpu(ppuB));
+	}
+	return {};
+}
+
+std::string DifferentialRunner::CompareFrame(Side& a, Side& b) const {
+	if (a.machine->GetCpu().GetCyclesLeft() != b.machine->GetCpu().GetCyclesLeft()) {
+		return tfm::format("CPU cycles left differ at frame end: %d vs %d",
+				   a.machine->GetCpu().GetCyclesLeft(), b.machine->GetCpu().GetCyclesLeft());
+	}
+	auto diff = CompareBoundary(a, b);
+	if (!diff.empty()) {
+		return diff;
+	}
+	if (a.machine->GetPpu().HashMemory() != b.machine->GetPpu().HashMemory()) {
+		return "PPU nametables, OAM or palettes differ";
+	}
+	if (HashFrame(*a.machine) != HashFrame(*b.machine)) {
+		return "pictures differ";
+	}
+	return {};
+}
+
+std::string DifferentialRunner::Report(const std::string& what, uint32_t frame,
+				       const Side& a, const Side& b) const {
+	auto res = tfm::format("frame %d: %s\n", frame, what);
+	for (const auto* side : {&a, &b}) {
+		res += tfm::format("last instructions on %s:\n", side->backend->name);
+		for (const auto& line : side->trace) {
+			res += tfm::format("  %04X  %02X %02X %02X  %s\n", line.cpu.pc, line.code[0],
+					   line.code[1], line.code[2], FormatState(line.cpu));
+		}
+	}
+	return res;
+}
+
+} // namespace nes
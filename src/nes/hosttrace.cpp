@@ -0,0 +1,185 @@
+#include "nes/hosttrace.h"
+
+#ifdef NES_HOST_TRACE
+
+#include <tfm/tinyformat.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nes::trace {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Owns all thread buffers so they outlive their threads. The mutex is only
+// taken when a thread registers and during export.
+struct Registry {
+	std::mutex mutex;
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	uint64_t startTicks = Now();
+	Clock::time_point startTime = Clock::now();
+};
+
+Registry& GetRegistry() {
+	static Registry registry;
+	return registry;
+}
+
+// Timestamp units per microsecond, measured over the run so far
+double TicksPerMicrosecond(const Registry& registry) {
+	const auto ticks = Now() - registry.startTicks;
+	const auto us = std::chrono::duration<double, std::micro>(Clock::now() - registry.startTime).count();
+	return us > 0 ? ticks / us : 1.0;
+}
+
+struct CollectedEvent {
+	Event event;
+	uint32_t threadId = 0;
+};
+
+std::vector<CollectedEvent> Collect(Registry& registry) {
+	std::vector<CollectedEvent> res;
+	for (const auto& buffer : registry.buffers) {
+		const size_t head = buffer->GetHead();
+		const size_t count = std::min(head - buffer->GetTail(), ThreadBuffer::kCapacity);
+		for (size_t i = head - count; i != head; ++i) {
+			res.push_back({buffer->At(i), buffer->GetThreadId()});
+		}
+	}
+	std::sort(res.begin(), res.end(), [](const CollectedEvent& a, const CollectedEvent& b) {
+		return a.event.begin < b.event.begin;
+	});
+	return res;
+}
+
+std::string EscapeJson(const char* str) {
+	std::string res;
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\') {
+			res += '\\';
+		}
+		res += *str;
+	}
+	return res;
+}
+
+} // namespace
+
+ThreadBuffer::ThreadBuffer(uint32_t threadId)
+: threadId_(threadId)
+, events_(std::make_unique<Event[]>(kCapacity)) {}
+
+uint32_t ThreadBuffer::GetThreadId() const {
+	return threadId_;
+}
+
+size_t ThreadBuffer::GetHead() const {
+	return head_.load(std::memory_order_acquire);
+}
+
+size_t ThreadBuffer::GetTail() const {
+	return tail_.load(std::memory_order_relaxed);
+}
+
+const Event& ThreadBuffer::At(size_t idx) const {
+	return events_[idx & (kCapacity - 1)];
+}
+
+void ThreadBuffer::Discard() {
+	tail_.store(GetHead(), std::memory_order_relaxed);
+}
+
+ThreadBuffer& GetThreadBuffer() {
+	thread_local ThreadBuffer* buffer = [] {
+		auto& registry = GetRegistry();
+		std::lock_guard lock(registry.mutex);
+		const auto threadId = (uint32_t)registry.buffers.size() + 1;
+		registry.buffers.push_back(std::make_shared<ThreadBuffer>(threadId));
+		return registry.buffers.back().get();
+	}();
+	return *buffer;
+}
+
+void WriteChromeTrace(std::ostream& out) {
+	auto& registry = GetRegistry();
+	std::lock_guard lock(registry.mutex);
+	const double scale = TicksPerMicrosecond(registry);
+	const auto events = Collect(registry);
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for (const auto& [e, threadId] : events) {
+		const double ts = (int64_t)(e.begin - registry.startTicks) / scale;
+		out << (first ? "\n" : ",\n");
+		first = false;
+		if (!e.name) {
+			out << tfm::format("{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+					   ts, threadId);
+		} else {
+			out << tfm::format("{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+					   EscapeJson(e.name), ts, (e.end - e.begin) / scale, threadId);
+		}
+	}
+	out << "\n]}\n";
+}
+
+void WriteFrameSummary(std::ostream& out) {
+	auto& registry = GetRegistry();
+	std::lock_guard lock(registry.mutex);
+	const double scale = TicksPerMicrosecond(registry);
+	const auto events = Collect(registry);
+
+	struct Stats {
+		double total = 0.0;
+		double max = 0.0;
+		double current = 0.0;
+	};
+	std::map<std::string, Stats> zones;
+	size_t frames = 0;
+	auto closeFrame = [&] {
+		for (auto& [name, stats] : zones) {
+			stats.total += stats.current;
+			stats.max = std::max(stats.max, stats.current);
+			stats.current = 0.0;
+		}
+		++frames;
+	};
+
+	// Zones are attributed to the frame they end in
+	bool started = false;
+	for (const auto& [e, threadId] : events) {
+		if (!e.name) {
+			if (started) {
+				closeFrame();
+			}
+			started = true;
+			continue;
+		}
+		if (started) {
+			zones[e.name].current += (e.end - e.begin) / scale;
+		}
+	}
+
+	out << tfm::format("%d frames\n%-32s %12s %12s\n", frames, "ZONE", "MEAN us", "MAX us");
+	for (const auto& [name, stats] : zones) {
+		out << tfm::format("%-32s %12.1f %12.1f\n", name,
+				   frames ? stats.total / frames : 0.0, stats.max);
+	}
+}
+
+void Reset() {
+	auto& registry = GetRegistry();
+	std::lock_guard lock(registry.mutex);
+	for (auto& buffer : registry.buffers) {
+		buffer->Discard();
+	}
+}
+
+} // namespace nes::trace
+
+#endif // NES_HOST_TRACE
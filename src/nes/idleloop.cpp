@@ -0,0 +1,227 @@
+#include "nes/idleloop.h"
+
+#include "nes/bus.h"
+#include "nes/instructions.h"
+#include "nes/ppu.h"
+#include "nes/utils.h"
+
+namespace nes {
+
+namespace {
+
+constexpr uint16_t kMaxLoopBytes = 16;
+constexpr size_t kMaxLoopSteps = 8;
+constexpr uint32_t kMaxAttempts = 3;
+constexpr uint8_t kFlagI = 1 << 2;
+
+bool SameRegisters(const CpuState& a, const CpuState& b) {
+	return a.pc == b.pc && a.acc == b.acc && a.x == b.x && a.y == b.y &&
+	       a.stackPtr == b.stackPtr && a.status == b.status;
+}
+
+// Instructions that neither write memory nor touch the stack
+bool IsSideEffectFree(Instruction instr) {
+	switch (instr) {
+		case Instruction::kADC: case Instruction::kAND: case Instruction::kBIT:
+		case Instruction::kBCC: case Instruction::kBCS: case Instruction::kBEQ:
+		case Instruction::kBMI: case Instruction::kBNE: case Instruction::kBPL:
+		case Instruction::kBVC: case Instruction::kBVS: case Instruction::kCLC:
+		case Instruction::kCLD: case Instruction::kCLI: case Instruction::kCLV:
+		case Instruction::kCMP: case Instruction::kCPX: case Instruction::kCPY:
+		case Instruction::kDEX: case Instruction::kDEY: case Instruction::kEOR:
+		case Instruction::kINX: case Instruction::kINY: case Instruction::kJMP:
+		case Instruction::kLDA: case Instruction::kLDX: case Instruction::kLDY:
+		case Instruction::kNOP: case Instruction::kORA: case Instruction::kSBC:
+		case Instruction::kSEC: case Instruction::kSED: case Instruction::kSEI:
+		case Instruction::kTAX: case Instruction::kTAY: case Instruction::kTSX:
+		case Instruction::kTXA: case Instruction::kTYA: case Instruction::kLAX:
+			return true;
+		default:
+			return false;
+	}
+}
+
+} // namespace
+
+IdleLoopSkipper::IdleLoopSkipper(Bus* bus, Cpu6502* cpu, Ppu2C02* ppu)
+: bus_(bus)
+, cpu_(cpu)
+, ppu_(ppu)
+{
+	Reset();
+}
+
+bool IdleLoopSkipper::OnBoundary(uint8_t frameId) {
+	if (mode_ == Mode::kSkipping) {
+		return Skip(frameId);
+	}
+
+	const auto state = cpu_->CaptureState();
+	const auto pc = state.pc;
+	const auto lastPc = lastPc_;
+	lastPc_ = pc;
+
+	if (mode_ == Mode::kRecording) {
+		return Record(state) && Skip(frameId);
+	}
+
+	// A short backward jump marks a loop head
+	if (pc <= lastPc && lastPc - pc <= kMaxLoopBytes && !IsRejected(pc)) {
+		mode_ = Mode::kRecording;
+		head_ = pc;
+		tail_ = lastPc;
+		attempts_ = 0;
+		steps_.clear();
+		if (!AddStep(state)) {
+			Reject(pc);
+		}
+	}
+	return false;
+}
+
+void IdleLoopSkipper::Reset() {
+	mode_ = Mode::kSearching;
+	lastPc_ = 0;
+	steps_.clear();
+	rejected_.fill(0xFFFF);
+}
+
+uint64_t IdleLoopSkipper::GetSkippedCycles() const {
+	return skippedCycles_;
+}
+
+// Returns true once an iteration ended in the state it started in
+bool IdleLoopSkipper::Record(const CpuState& state) {
+	if (state.pc == head_) {
+		auto& head = steps_.front().state;
+		steps_.back().duration = state.cycle - steps_.back().state.cycle;
+		if (SameRegisters(head, state)) {
+			mode_ = Mode::kSkipping;
+			return true;
+		}
+
+		if (++attempts_ >= kMaxAttempts) {
+			Reject(head_);
+			return false;
+		}
+		steps_.clear();
+		if (!AddStep(state)) {
+			Reject(head_);
+		}
+		return false;
+	}
+
+	// Left the loop, e.g. fell through or entered an interrupt handler
+	if (state.pc < head_ || state.pc > tail_) {
+		mode_ = Mode::kSearching;
+		return false;
+	}
+
+	if (steps_.size() >= kMaxLoopSteps || !AddStep(state)) {
+		Reject(head_);
+	}
+	return false;
+}
+
+bool IdleLoopSkipper::AddStep(const CpuState& state) {
+	const auto pc = state.pc;
+	if (!(pc < 0x2000 || pc >= 0x4020)) {
+		return false;
+	}
+
+	auto it = kOpDecoder.find(bus_->Read(pc, true));
+	if (it == kOpDecoder.end() || !IsSideEffectFree(it->second.instr)) {
+		return false;
+	}
+
+	Step step;
+	step.state = state;
+	switch (it->second.addrMode) {
+		case AddressMode::kACC:
+		case AddressMode::kIMP:
+		case AddressMode::kIMM:
+		case AddressMode::kREL:
+		case AddressMode::kZP:
+			break;
+		case AddressMode::kABS: {
+			if (it->second.instr == Instruction::kJMP) {
+				break;
+			}
+			uint16_t addr = bus_->Read(pc + 1, true) | (uint16_t)bus_->Read(pc + 2, true) << 8;
+			if (IsInRange(0x2000, 0x3FFF, addr) && (addr & 0x07) == 0x02) { // PPUSTATUS
+				step.volatileAddr = addr;
+				step.volatileValue = bus_->Read(addr, true);
+			} else if (IsInRange(0x2000, 0x401F, addr)) {
+				return false;
+			}
+			break;
+		}
+		default:
+			return false;
+	}
+
+	if (!steps_.empty()) {
+		steps_.back().duration = state.cycle - steps_.back().state.cycle;
+	}
+	steps_.push_back(step);
+	return true;
+}
+
+void IdleLoopSkipper::Reject(uint16_t pc) {
+	rejected_[pc % rejected_.size()] = pc;
+	mode_ = Mode::kSearching;
+}
+
+bool IdleLoopSkipper::IsRejected(uint16_t pc) const {
+	return rejected_[pc % rejected_.size()] == pc;
+}
+
+// Entered at the loop head with the PPU dots of the current cycle done.
+// Each iteration only replays PPU dots; the CPU object is written back on
+// exit, either at a step boundary (the caller then executes that step) or
+// mid-instruction when the frame ends.
+bool IdleLoopSkipper::Skip(uint8_t frameId) {
+	uint64_t cycle = cpu_->CaptureState().cycle;
+	size_t k = 0;
+	uint32_t elapsed = 0;
+
+	while (true) {
+		const auto& step = steps_[k];
+		if (elapsed == 0) {
+			// A DMA or an interrupt due by the end of this step is
+			// left to the CPU
+			const bool interrupt = bus_->GetInterruptCycle() <= cycle + step.duration &&
+					       (bus_->IsNMIPending() || !(step.state.status & kFlagI));
+			if (interrupt || cycle + step.duration >= bus_->GetNextDmaCycle() ||
+			    (step.volatileAddr && bus_->Read(*step.volatileAddr, true) != step.volatileValue)) {
+				auto state = step.state;
+				state.cycle = cycle;
+				cpu_->SetState(state);
+				mode_ = Mode::kSearching;
+				return false;
+			}
+		}
+
+		++cycle;
+		++skippedCycles_;
+		if (++elapsed == step.duration) {
+			k = (k + 1) % steps_.size();
+			elapsed = 0;
+		}
+
+		if (ppu_->GetActiveFramebufferId() != frameId) {
+			// Registers already hold the result of the running instruction
+			auto state = steps_[(k + (elapsed ? 1 : 0)) % steps_.size()].state;
+			state.cycle = cycle;
+			cpu_->SetState(state, elapsed ? step.duration - elapsed : 0);
+			mode_ = Mode::kSearching;
+			return true;
+		}
+
+		ppu_->Tick();
+		ppu_->Tick();
+		ppu_->Tick();
+	}
+}
+
+} // namespace nes
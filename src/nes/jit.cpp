@@ -0,0 +1,876 @@
+#include "nes/jit.h"
+
+#include "nes/bus.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define NES_JIT_X64 1
+#include <sys/mman.h>
+#endif
+
+#include <cstring>
+#include <vector>
+
+namespace nes {
+
+#ifdef NES_JIT_X64
+
+namespace {
+
+constexpr size_t kCodeArenaSize = 4 << 20;
+constexpr uint32_t kMaxBlockCycles = 250;
+
+uint16_t Join(uint8_t LL, uint8_t HH) {
+	return (uint16_t)HH << 8 | LL;
+}
+
+uint8_t ReadHelper(Bus* bus, uint16_t addr) {
+	return bus->Read(addr);
+}
+
+void WriteHelper(Bus* bus, uint16_t addr, uint8_t val) {
+	bus->Write(addr, val);
+}
+
+// Host registers
+enum Reg {
+	kRax = 0, kRcx = 1, kRdx = 2, kRbx = 3, kRsp = 4, kRbp = 5, kRsi = 6, kRdi = 7,
+	kR8 = 8, kR12 = 12, kR13 = 13, kR14 = 14, kR15 = 15,
+};
+
+constexpr Reg kRam = kRbx; // internal RAM base
+constexpr Reg kNz = kRbp;  // last result byte, source of Z (and N unless split)
+constexpr Reg kAcc = kR12;
+constexpr Reg kX = kR13;
+constexpr Reg kY = kR14;
+constexpr Reg kCtx = kR15;
+
+enum Cond {
+	kOverflow = 0x0, kBelow = 0x2, kAboveEqual = 0x3, kEqual = 0x4,
+	kNotEqual = 0x5, kSign = 0x8, kNotSign = 0x9,
+};
+
+// ALU opcodes of the "op r/m8, r8" form and their 0x80 group digit
+enum Alu {
+	kAdd = 0, kOr = 1, kAdc = 2, kSbb = 3, kAnd = 4, kSub = 5, kXor = 6, kCmp = 7,
+};
+
+enum Shift {
+	kRcl = 2, kRcr = 3, kShl = 4, kShr = 5,
+};
+
+constexpr int32_t Field(size_t offset) {
+	return (int32_t)offset;
+}
+
+const int32_t kCtxRam = Field(offsetof(Jit::Context, ram));
+const int32_t kCtxBus = Field(offsetof(Jit::Context, bus));
+const int32_t kCtxCycles = Field(offsetof(Jit::Context, cycles));
+const int32_t kCtxOpCount = Field(offsetof(Jit::Context, opCount));
+const int32_t kCtxPc = Field(offsetof(Jit::Context, pc));
+const int32_t kCtxAcc = Field(offsetof(Jit::Context, acc));
+const int32_t kCtxX = Field(offsetof(Jit::Context, x));
+const int32_t kCtxY = Field(offsetof(Jit::Context, y));
+const int32_t kCtxStackPtr = Field(offsetof(Jit::Context, stackPtr));
+const int32_t kCtxStatus = Field(offsetof(Jit::Context, status));
+const int32_t kCtxCarry = Field(offsetof(Jit::Context, carry));
+const int32_t kCtxOverflow = Field(offsetof(Jit::Context, overflow));
+const int32_t kCtxNSource = Field(offsetof(Jit::Context, nSource));
+const int32_t kCtxZSource = Field(offsetof(Jit::Context, zSource));
+
+// Raw x86-64 encoder for the handful of forms the translator needs.
+// Memory operands are [base + disp32] or [base + index + disp32].
+class Emitter {
+public:
+	std::vector<uint8_t>& Code() { return code_; }
+	size_t Pos() const { return code_.size(); }
+
+	void Patch(size_t at, size_t target) {
+		int32_t rel = (int32_t)(target - (at + 4));
+		std::memcpy(code_.data() + at, &rel, 4);
+	}
+
+	void Push(Reg r) { Rex(false, 0, 0, r, false); Byte(0x50 + (r & 7)); }
+	void Pop(Reg r) { Rex(false, 0, 0, r, false); Byte(0x58 + (r & 7)); }
+	void Ret() { Byte(0xC3); }
+	void SubRsp(uint8_t imm) { Byte(0x48); Byte(0x83); Byte(0xEC); Byte(imm); }
+	void AddRsp(uint8_t imm) { Byte(0x48); Byte(0x83); Byte(0xC4); Byte(imm); }
+
+	void Mov64(Reg dst, Reg src) { Rex(true, src, 0, dst, true); Byte(0x89); ModRM(3, src, dst); }
+	void Mov32(Reg dst, Reg src) { Rex(false, src, 0, dst, false); Byte(0x89); ModRM(3, src, dst); }
+	void Movzx8(Reg dst, Reg src) { Rex(false, dst, 0, src, true); Byte(0x0F); Byte(0xB6); ModRM(3, dst, src); }
+	void MovImm32(Reg dst, uint32_t imm) { Rex(false, 0, 0, dst, false); Byte(0xB8 + (dst & 7)); Dword(imm); }
+	void MovImm64(Reg dst, uint64_t imm) { Rex(true, 0, 0, dst, true); Byte(0xB8 + (dst & 7)); Qword(imm); }
+	void Load64(Reg dst, Reg base, int32_t disp) { Rex(true, dst, 0, base, true); Byte(0x8B); Mem(dst, base, disp); }
+
+	void LoadByte(Reg dst, Reg base, int32_t disp) {
+		Rex(false, dst, 0, base, false); Byte(0x0F); Byte(0xB6); Mem(dst, base, disp);
+	}
+	void LoadByteIdx(Reg dst, Reg base, Reg index, int32_t disp) {
+		Rex(false, dst, index, base, false); Byte(0x0F); Byte(0xB6); MemIdx(dst, base, index, disp);
+	}
+	void StoreByte(Reg base, int32_t disp, Reg src) { Rex(false, src, 0, base, true); Byte(0x88); Mem(src, base, disp); }
+	void StoreWord(Reg base, int32_t disp, Reg src) { Byte(0x66); Rex(false, src, 0, base, false); Byte(0x89); Mem(src, base, disp); }
+	void StoreImm8(Reg base, int32_t disp, uint8_t imm) { Rex(false, 0, 0, base, false); Byte(0xC6); Mem(0, base, disp); Byte(imm); }
+	void StoreImm16(Reg base, int32_t disp, uint16_t imm) {
+		Byte(0x66); Rex(false, 0, 0, base, false); Byte(0xC7); Mem(0, base, disp); Byte(imm & 0xFF); Byte(imm >> 8);
+	}
+	void StoreImm32(Reg base, int32_t disp, uint32_t imm) { Rex(false, 0, 0, base, false); Byte(0xC7); Mem(0, base, disp); Dword(imm); }
+	void AddMemImm32(Reg base, int32_t disp, uint32_t imm) { Rex(false, 0, 0, base, false); Byte(0x81); Mem(0, base, disp); Dword(imm); }
+	void AdcMemImm8(Reg base, int32_t disp, uint8_t imm) { Rex(false, 0, 0, base, false); Byte(0x83); Mem(kAdc, base, disp); Byte(imm); }
+	void AluMemImm8(Alu op, Reg base, int32_t disp, uint8_t imm) { Rex(false, 0, 0, base, false); Byte(0x80); Mem(op, base, disp); Byte(imm); }
+	void TestMemImm8(Reg base, int32_t disp, uint8_t imm) { Rex(false, 0, 0, base, false); Byte(0xF6); Mem(0, base, disp); Byte(imm); }
+	void IncMem8(Reg base, int32_t disp) { Rex(false, 0, 0, base, false); Byte(0xFE); Mem(0, base, disp); }
+	void DecMem8(Reg base, int32_t disp) { Rex(false, 0, 0, base, false); Byte(0xFE); Mem(1, base, disp); }
+	void SetccMem(Cond cc, Reg base, int32_t disp) { Rex(false, 0, 0, base, false); Byte(0x0F); Byte(0x90 + cc); Mem(0, base, disp); }
+
+	void Alu8(Alu op, Reg dst, Reg src) { Rex(false, src, 0, dst, true); Byte(op << 3); ModRM(3, src, dst); }
+	void Alu8Imm(Alu op, Reg dst, uint8_t imm) { Rex(false, 0, 0, dst, true); Byte(0x80); ModRM(3, op, dst); Byte(imm); }
+	void Alu32(Alu op, Reg dst, Reg src) { Rex(false, src, 0, dst, false); Byte((op << 3) | 1); ModRM(3, src, dst); }
+	void Alu32Imm(Alu op, Reg dst, uint32_t imm) { Rex(false, 0, 0, dst, false); Byte(0x81); ModRM(3, op, dst); Dword(imm); }
+	void Shift8(Shift op, Reg dst) { Rex(false, 0, 0, dst, true); Byte(0xD0); ModRM(3, op, dst); }
+	void Shift32Imm(Shift op, Reg dst, uint8_t imm) { Rex(false, 0, 0, dst, false); Byte(0xC1); ModRM(3, op, dst); Byte(imm); }
+	void Inc8(Reg dst) { Rex(false, 0, 0, dst, true); Byte(0xFE); ModRM(3, 0, dst); }
+	void Dec8(Reg dst) { Rex(false, 0, 0, dst, true); Byte(0xFE); ModRM(3, 1, dst); }
+	void Test8(Reg a, Reg b) { Rex(false, b, 0, a, true); Byte(0x84); ModRM(3, b, a); }
+	void Call(Reg target) { Rex(false, 0, 0, target, false); Byte(0xFF); ModRM(3, 2, target); }
+
+	// Jumps return the position of their rel32 field for Patch()
+	size_t Jcc(Cond cc) { Byte(0x0F); Byte(0x80 + cc); return Rel32(); }
+	size_t Jmp() { Byte(0xE9); return Rel32(); }
+
+private:
+	std::vector<uint8_t> code_;
+
+	void Byte(uint8_t b) { code_.push_back(b); }
+	void Dword(uint32_t v) { for (int i = 0; i < 4; ++i) Byte(v >> (8 * i)); }
+	void Qword(uint64_t v) { for (int i = 0; i < 8; ++i) Byte(v >> (8 * i)); }
+	size_t Rel32() { auto at = Pos(); Dword(0); return at; }
+
+	// force emits an empty REX so byte registers map to SPL/BPL/SIL/DIL
+	void Rex(bool w, int reg, int index, int base, bool force) {
+		uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) & 1) << 2 | ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+		if (rex != 0x40 || force) {
+			Byte(rex);
+		}
+	}
+	void ModRM(int mod, int reg, int rm) { Byte(mod << 6 | (reg & 7) << 3 | (rm & 7)); }
+	void Mem(int reg, Reg base, int32_t disp) {
+		// bases are never RSP/R12, which would need a SIB byte
+		ModRM(2, reg, base);
+		Dword(disp);
+	}
+	void MemIdx(int reg, Reg base, Reg index, int32_t disp) {
+		ModRM(2, reg, 4);
+		Byte((index & 7) << 3 | (base & 7));
+		Dword(disp);
+	}
+};
+
+enum class Group {
+	kUnsupported,
+	kRead,    // value operand
+	kStore,
+	kModify,  // read-modify-write on A or memory
+	kImplied,
+	kBranch,
+	kJump,
+};
+
+Group GroupOf(const Operation& op) {
+	switch (op.instr) {
+		case Instruction::kLDA: case Instruction::kLDX: case Instruction::kLDY:
+		case Instruction::kADC: case Instruction::kSBC: case Instruction::kAND:
+		case Instruction::kORA: case Instruction::kEOR: case Instruction::kCMP:
+		case Instruction::kCPX: case Instruction::kCPY: case Instruction::kBIT:
+			return Group::kRead;
+		case Instruction::kSTA: case Instruction::kSTX: case Instruction::kSTY:
+			return Group::kStore;
+		case Instruction::kINC: case Instruction::kDEC: case Instruction::kASL:
+		case Instruction::kLSR: case Instruction::kROL: case Instruction::kROR:
+			return Group::kModify;
+		case Instruction::kINX: case Instruction::kINY: case Instruction::kDEX:
+		case Instruction::kDEY: case Instruction::kTAX: case Instruction::kTAY:
+		case Instruction::kTXA: case Instruction::kTYA: case Instruction::kTSX:
+		case Instruction::kTXS: case Instruction::kCLC: case Instruction::kSEC:
+		case Instruction::kCLV: case Instruction::kCLD: case Instruction::kSED:
+		case Instruction::kCLI: case Instruction::kSEI: case Instruction::kPHA:
+		case Instruction::kPLA:
+			return Group::kImplied;
+		case Instruction::kNOP:
+			return op.addrMode == AddressMode::kIMP ? Group::kImplied : Group::kUnsupported;
+		case Instruction::kBCC: case Instruction::kBCS: case Instruction::kBEQ:
+		case Instruction::kBMI: case Instruction::kBNE: case Instruction::kBPL:
+		case Instruction::kBVC: case Instruction::kBVS:
+			return Group::kBranch;
+		case Instruction::kJMP:
+			return op.addrMode == AddressMode::kABS ? Group::kJump : Group::kUnsupported;
+		case Instruction::kJSR: case Instruction::kRTS:
+			return Group::kJump;
+		default:
+			return Group::kUnsupported;
+	}
+}
+
+// Cycles the interpreter adds to cycleLeft_, without page cross penalties
+uint32_t BaseCost(const Operation& op) {
+	switch (GroupOf(op)) {
+		case Group::kRead:
+			switch (op.addrMode) {
+				case AddressMode::kIMM: return 2;
+				case AddressMode::kZP: return 3;
+				case AddressMode::kINX: return 6;
+				case AddressMode::kINY: return 5;
+				default: return 4;
+			}
+		case Group::kStore:
+			switch (op.addrMode) {
+				case AddressMode::kZP: return 3;
+				case AddressMode::kABX: case AddressMode::kABY: return 5;
+				case AddressMode::kINX: case AddressMode::kINY: return 6;
+				default: return 4;
+			}
+		case Group::kModify:
+			switch (op.addrMode) {
+				case AddressMode::kACC: return 2;
+				case AddressMode::kZP: return 5;
+				case AddressMode::kABX: return 7;
+				default: return 6;
+			}
+		case Group::kImplied:
+			switch (op.instr) {
+				case Instruction::kPHA: return 3;
+				case Instruction::kPLA: return 4;
+				default: return 2;
+			}
+		case Group::kBranch:
+			return 2;
+		case Group::kJump:
+			return op.instr == Instruction::kJMP ? 3 : 6;
+		case Group::kUnsupported:
+			break;
+	}
+	return 0;
+}
+
+bool HasPageCrossPenalty(const Operation& op) {
+	return GroupOf(op) == Group::kRead && (op.addrMode == AddressMode::kABX ||
+		op.addrMode == AddressMode::kABY || op.addrMode == AddressMode::kINY);
+}
+
+class BlockCompiler {
+public:
+	explicit BlockCompiler(std::span<const JitOp> ops): ops_(ops) {}
+
+	bool Compile();
+
+	std::vector<uint8_t>& Code() { return e_.Code(); }
+	uint8_t GetOpCount() const { return opCount_; }
+	uint8_t GetMaxCycles() const { return maxCycles_; }
+
+private:
+	struct SideExit {
+		size_t jump;
+		uint16_t pc;
+		uint32_t cycles;
+		uint32_t opCount;
+		bool nzSplit;
+	};
+
+	std::span<const JitOp> ops_;
+	Emitter e_;
+	std::vector<SideExit> sideExits_;
+	std::vector<size_t> epilogueJumps_;
+
+	// Compile time view of the current instruction
+	uint32_t opIndex_ = 0;
+	uint32_t cycles_ = 0; // static cycles of the instructions before opIndex_
+	bool nzSplit_ = true; // N lives in Context::nSource instead of kNz
+	uint8_t opCount_ = 0;
+	uint8_t maxCycles_ = 0;
+
+	bool IsTranslatable(const JitOp& o) const;
+	void Prologue();
+	void Epilogue();
+	void Exit(uint32_t cycles, uint32_t opCount, bool dynamicPc, uint16_t pc);
+	void SideExitIf(Cond cc);
+
+	void SetNz(Reg r);
+	void LoadCarry();
+	void AddressToRcx(const JitOp& o);
+	void ReadOperand(const JitOp& o);
+	void WriteRcx(Reg val);
+	void Write(const JitOp& o, Reg val);
+	void CallRead();
+	void Push(Reg val);
+	void Pull(Reg dst);
+
+	void Read(const JitOp& o);
+	void Store(const JitOp& o);
+	void Modify(const JitOp& o);
+	void Implied(const JitOp& o);
+	void Branch(const JitOp& o);
+	void Jump(const JitOp& o);
+};
+
+bool BlockCompiler::IsTranslatable(const JitOp& o) const {
+	const auto group = GroupOf(o.op);
+	if (group == Group::kUnsupported) {
+		return false;
+	}
+
+	if (o.op.addrMode == AddressMode::kABS && group != Group::kJump) {
+		const auto addr = Join(o.LL, o.HH);
+		if (addr < 0x2000) {
+			return true;
+		}
+		// reads from the cartridge are side effect free, writes may swap banks
+		return group == Group::kRead && addr >= 0x4020;
+	}
+	return true;
+}
+
+void BlockCompiler::Prologue() {
+	for (auto r : {kRbx, kRbp, kR12, kR13, kR14, kR15}) {
+		e_.Push(r);
+	}
+	e_.SubRsp(8); // keep calls 16 byte aligned
+	e_.Mov64(kCtx, kRdi);
+	e_.Load64(kRam, kCtx, kCtxRam);
+	e_.LoadByte(kAcc, kCtx, kCtxAcc);
+	e_.LoadByte(kX, kCtx, kCtxX);
+	e_.LoadByte(kY, kCtx, kCtxY);
+	e_.LoadByte(kNz, kCtx, kCtxZSource);
+}
+
+void BlockCompiler::Epilogue() {
+	for (auto at : epilogueJumps_) {
+		e_.Patch(at, e_.Pos());
+	}
+	e_.StoreByte(kCtx, kCtxAcc, kAcc);
+	e_.StoreByte(kCtx, kCtxX, kX);
+	e_.StoreByte(kCtx, kCtxY, kY);
+	e_.AddRsp(8);
+	for (auto r : {kR15, kR14, kR13, kR12, kRbp, kRbx}) {
+		e_.Pop(r);
+	}
+	e_.Ret();
+}
+
+// Leaves the block; with dynamicPc the new PC was already stored
+void BlockCompiler::Exit(uint32_t cycles, uint32_t opCount, bool dynamicPc, uint16_t pc) {
+	e_.StoreByte(kCtx, kCtxZSource, kNz);
+	if (!nzSplit_) {
+		e_.StoreByte(kCtx, kCtxNSource, kNz);
+	}
+	if (!dynamicPc) {
+		e_.StoreImm16(kCtx, kCtxPc, pc);
+	}
+	e_.AddMemImm32(kCtx, kCtxCycles, cycles);
+	e_.StoreImm32(kCtx, kCtxOpCount, opCount);
+	epilogueJumps_.push_back(e_.Jmp());
+}
+
+// Hands the current instruction back to the interpreter, nothing of it
+// may have been committed yet
+void BlockCompiler::SideExitIf(Cond cc) {
+	sideExits_.push_back({e_.Jcc(cc), ops_[opIndex_].pc, cycles_, opIndex_, nzSplit_});
+}
+
+void BlockCompiler::SetNz(Reg r) {
+	e_.Movzx8(kNz, r);
+	nzSplit_ = false;
+}
+
+// CF = 6502 carry
+void BlockCompiler::LoadCarry() {
+	e_.LoadByte(kRcx, kCtx, kCtxCarry);
+	e_.Alu8Imm(kAdd, kRcx, 0xFF);
+}
+
+void BlockCompiler::CallRead() {
+	e_.Mov32(kRsi, kRcx);
+	e_.Load64(kRdi, kCtx, kCtxBus);
+	e_.MovImm64(kRax, (uint64_t)&ReadHelper);
+	e_.Call(kRax);
+	e_.Movzx8(kRax, kRax);
+}
+
+// Effective address of a non-immediate memory operand into ECX
+void BlockCompiler::AddressToRcx(const JitOp& o) {
+	switch (o.op.addrMode) {
+		case AddressMode::kZP:
+		case AddressMode::kABS:
+			e_.MovImm32(kRcx, Join(o.LL, o.HH));
+			break;
+		case AddressMode::kZPX:
+		case AddressMode::kZPY:
+			e_.Mov32(kRcx, o.op.addrMode == AddressMode::kZPX ? kX : kY);
+			e_.Alu32Imm(kAdd, kRcx, o.LL);
+			e_.Movzx8(kRcx, kRcx);
+			break;
+		case AddressMode::kABX:
+		case AddressMode::kABY:
+			e_.Mov32(kRcx, o.op.addrMode == AddressMode::kABX ? kX : kY);
+			e_.Alu32Imm(kAdd, kRcx, Join(o.LL, o.HH));
+			e_.Alu32Imm(kAnd, kRcx, 0xFFFF);
+			break;
+		case AddressMode::kINX:
+			e_.Mov32(kRcx, kX);
+			e_.Alu32Imm(kAdd, kRcx, o.LL);
+			e_.Movzx8(kRcx, kRcx);
+			e_.LoadByteIdx(kRax, kRam, kRcx, 0);
+			e_.Alu32Imm(kAdd, kRcx, 1);
+			e_.Movzx8(kRcx, kRcx);
+			e_.LoadByteIdx(kRcx, kRam, kRcx, 0);
+			e_.Shift32Imm(kShl, kRcx, 8);
+			e_.Alu32(kOr, kRcx, kRax);
+			break;
+		case AddressMode::kINY:
+			e_.LoadByte(kRax, kRam, o.LL);
+			e_.LoadByte(kRcx, kRam, (uint8_t)(o.LL + 1));
+			e_.Shift32Imm(kShl, kRcx, 8);
+			e_.Alu32(kOr, kRcx, kRax);
+			e_.Alu32(kAdd, kRcx, kY);
+			e_.Alu32Imm(kAnd, kRcx, 0xFFFF);
+			break;
+		default:
+			break;
+	}
+}
+
+// Operand value into EAX
+void BlockCompiler::ReadOperand(const JitOp& o) {
+	const auto mode = o.op.addrMode;
+	if (mode == AddressMode::kIMM) {
+		e_.MovImm32(kRax, o.LL);
+		return;
+	}
+	if (mode == AddressMode::kZP) {
+		e_.LoadByte(kRax, kRam, o.LL);
+		return;
+	}
+	if (mode == AddressMode::kABS) {
+		const auto addr = Join(o.LL, o.HH);
+		if (addr < 0x2000) {
+			e_.LoadByte(kRax, kRam, addr % 0x0800);
+		} else {
+			e_.MovImm32(kRcx, addr);
+			CallRead();
+		}
+		return;
+	}
+
+	AddressToRcx(o);
+	if (mode == AddressMode::kZPX || mode == AddressMode::kZPY) {
+		e_.LoadByteIdx(kRax, kRam, kRcx, 0);
+		return;
+	}
+
+	// RAM, cartridge or I/O is only known at run time
+	e_.Alu32Imm(kCmp, kRcx, 0x2000);
+	const auto notRam = e_.Jcc(kAboveEqual);
+	e_.Mov32(kRdx, kRcx);
+	e_.Alu32Imm(kAnd, kRdx, 0x07FF);
+	e_.LoadByteIdx(kRax, kRam, kRdx, 0);
+	const auto done = e_.Jmp();
+	e_.Patch(notRam, e_.Pos());
+	e_.Alu32Imm(kCmp, kRcx, 0x4020);
+	SideExitIf(kBelow);
+	CallRead();
+	e_.Patch(done, e_.Pos());
+
+	if (HasPageCrossPenalty(o.op)) {
+		if (mode == AddressMode::kINY) {
+			e_.LoadByte(kRdx, kRam, o.LL);
+		} else {
+			e_.MovImm32(kRdx, o.LL);
+		}
+		e_.Alu8(kAdd, kRdx, mode == AddressMode::kABX ? kX : kY);
+		e_.AdcMemImm8(kCtx, kCtxCycles, 0);
+	}
+}
+
+// Writes val to the internal RAM address in ECX
+void BlockCompiler::WriteRcx(Reg val) {
+	e_.Movzx8(kRdx, val);
+	e_.Mov32(kRsi, kRcx);
+	e_.Load64(kRdi, kCtx, kCtxBus);
+	e_.MovImm64(kRax, (uint64_t)&WriteHelper);
+	e_.Call(kRax);
+}
+
+// Memory operand write; anything outside internal RAM leaves to the
+// interpreter before the instruction starts
+void BlockCompiler::Write(const JitOp& o, Reg val) {
+	if (val == kRax || val == kRcx || val == kRdx) {
+		e_.Movzx8(kRdx, val);
+		val = kRdx;
+	}
+	AddressToRcx(o);
+	const auto mode = o.op.addrMode;
+	if (mode != AddressMode::kZP && mode != AddressMode::kZPX &&
+	    mode != AddressMode::kZPY && mode != AddressMode::kABS) {
+		e_.Alu32Imm(kCmp, kRcx, 0x2000);
+		SideExitIf(kAboveEqual);
+	}
+	WriteRcx(val);
+}
+
+void BlockCompiler::Push(Reg val) {
+	e_.LoadByte(kRcx, kCtx, kCtxStackPtr);
+	e_.Alu32Imm(kAdd, kRcx, 0x0100);
+	WriteRcx(val);
+	e_.DecMem8(kCtx, kCtxStackPtr);
+}
+
+void BlockCompiler::Pull(Reg dst) {
+	e_.IncMem8(kCtx, kCtxStackPtr);
+	e_.LoadByte(kRcx, kCtx, kCtxStackPtr);
+	e_.LoadByteIdx(dst, kRam, kRcx, 0x0100);
+}
+
+void BlockCompiler::Read(const JitOp& o) {
+	ReadOperand(o);
+	switch (o.op.instr) {
+		case Instruction::kLDA:
+			e_.Mov32(kAcc, kRax);
+			SetNz(kAcc);
+			break;
+		case Instruction::kLDX:
+			e_.Mov32(kX, kRax);
+			SetNz(kX);
+			break;
+		case Instruction::kLDY:
+			e_.Mov32(kY, kRax);
+			SetNz(kY);
+			break;
+		case Instruction::kAND:
+			e_.Alu8(kAnd, kAcc, kRax);
+			SetNz(kAcc);
+			break;
+		case Instruction::kORA:
+			e_.Alu8(kOr, kAcc, kRax);
+			SetNz(kAcc);
+			break;
+		case Instruction::kEOR:
+			e_.Alu8(kXor, kAcc, kRax);
+			SetNz(kAcc);
+			break;
+		case Instruction::kADC:
+			LoadCarry();
+			e_.Alu8(kAdc, kAcc, kRax);
+			e_.SetccMem(kBelow, kCtx, kCtxCarry);
+			e_.SetccMem(kOverflow, kCtx, kCtxOverflow);
+			SetNz(kAcc);
+			break;
+		case Instruction::kSBC:
+			// CF = borrow = !carry
+			e_.AluMemImm8(kCmp, kCtx, kCtxCarry, 1);
+			e_.Alu8(kSbb, kAcc, kRax);
+			e_.SetccMem(kAboveEqual, kCtx, kCtxCarry);
+			e_.SetccMem(kOverflow, kCtx, kCtxOverflow);
+			SetNz(kAcc);
+			break;
+		case Instruction::kCMP:
+		case Instruction::kCPX:
+		case Instruction::kCPY: {
+			const auto reg = o.op.instr == Instruction::kCMP ? kAcc :
+				o.op.instr == Instruction::kCPX ? kX : kY;
+			e_.Mov32(kRdx, reg);
+			e_.Alu8(kSub, kRdx, kRax);
+			e_.SetccMem(kAboveEqual, kCtx, kCtxCarry);
+			SetNz(kRdx);
+			break;
+		}
+		case Instruction::kBIT:
+			e_.StoreByte(kCtx, kCtxNSource, kRax);
+			e_.Mov32(kRdx, kRax);
+			e_.Shift32Imm(kShr, kRdx, 6);
+			e_.Alu32Imm(kAnd, kRdx, 1);
+			e_.StoreByte(kCtx, kCtxOverflow, kRdx);
+			e_.Alu8(kAnd, kRax, kAcc);
+			e_.Movzx8(kNz, kRax);
+			nzSplit_ = true;
+			break;
+		default:
+			break;
+	}
+}
+
+void BlockCompiler::Store(const JitOp& o) {
+	switch (o.op.instr) {
+		case Instruction::kSTA: Write(o, kAcc); break;
+		case Instruction::kSTX: Write(o, kX); break;
+		case Instruction::kSTY: Write(o, kY); break;
+		default: break;
+	}
+}
+
+void BlockCompiler::Modify(const JitOp& o) {
+	const bool onAcc = o.op.addrMode == AddressMode::kACC;
+	if (onAcc) {
+		e_.Mov32(kRax, kAcc);
+	} else {
+		AddressToRcx(o);
+		if (o.op.addrMode == AddressMode::kABX) {
+			e_.Alu32Imm(kCmp, kRcx, 0x2000);
+			SideExitIf(kAboveEqual);
+		}
+		e_.Mov32(kRdx, kRcx);
+		e_.Alu32Imm(kAnd, kRdx, 0x07FF);
+		e_.LoadByteIdx(kRax, kRam, kRdx, 0);
+	}
+
+	switch (o.op.instr) {
+		case Instruction::kINC:
+			e_.Inc8(kRax);
+			break;
+		case Instruction::kDEC:
+			e_.Dec8(kRax);
+			break;
+		case Instruction::kASL:
+			e_.Shift8(kShl, kRax);
+			e_.SetccMem(kBelow, kCtx, kCtxCarry);
+			break;
+		case Instruction::kLSR:
+			e_.Shift8(kShr, kRax);
+			e_.SetccMem(kBelow, kCtx, kCtxCarry);
+			break;
+		case Instruction::kROL:
+		case Instruction::kROR:
+			e_.Mov32(kRsi, kRcx); // LoadCarry clobbers ECX
+			LoadCarry();
+			e_.Mov32(kRcx, kRsi);
+			e_.Shift8(o.op.instr == Instruction::kROL ? kRcl : kRcr, kRax);
+			e_.SetccMem(kBelow, kCtx, kCtxCarry);
+			break;
+		default:
+			break;
+	}
+	SetNz(kRax);
+
+	if (onAcc) {
+		e_.Movzx8(kAcc, kRax);
+	} else {
+		WriteRcx(kRax);
+	}
+}
+
+void BlockCompiler::Implied(const JitOp& o) {
+	switch (o.op.instr) {
+		case Instruction::kINX: e_.Inc8(kX); SetNz(kX); break;
+		case Instruction::kINY: e_.Inc8(kY); SetNz(kY); break;
+		case Instruction::kDEX: e_.Dec8(kX); SetNz(kX); break;
+		case Instruction::kDEY: e_.Dec8(kY); SetNz(kY); break;
+		case Instruction::kTAX: e_.Mov32(kX, kAcc); SetNz(kX); break;
+		case Instruction::kTAY: e_.Mov32(kY, kAcc); SetNz(kY); break;
+		case Instruction::kTXA: e_.Mov32(kAcc, kX); SetNz(kAcc); break;
+		case Instruction::kTYA: e_.Mov32(kAcc, kY); SetNz(kAcc); break;
+		case Instruction::kTSX: e_.LoadByte(kX, kCtx, kCtxStackPtr); SetNz(kX); break;
+		case Instruction::kTXS: e_.StoreByte(kCtx, kCtxStackPtr, kX); break;
+		case Instruction::kCLC: e_.StoreImm8(kCtx, kCtxCarry, 0); break;
+		case Instruction::kSEC: e_.StoreImm8(kCtx, kCtxCarry, 1); break;
+		case Instruction::kCLV: e_.StoreImm8(kCtx, kCtxOverflow, 0); break;
+		case Instruction::kCLD: e_.AluMemImm8(kAnd, kCtx, kCtxStatus, (uint8_t)~0x08); break;
+		case Instruction::kSED: e_.AluMemImm8(kOr, kCtx, kCtxStatus, 0x08); break;
+		case Instruction::kCLI: e_.AluMemImm8(kAnd, kCtx, kCtxStatus, (uint8_t)~0x04); break;
+		case Instruction::kSEI: e_.AluMemImm8(kOr, kCtx, kCtxStatus, 0x04); break;
+		case Instruction::kPHA: Push(kAcc); break;
+		case Instruction::kPLA: Pull(kAcc); SetNz(kAcc); break;
+		default: break;
+	}
+}
+
+void BlockCompiler::Branch(const JitOp& o) {
+	Cond taken = kNotEqual;
+	switch (o.op.instr) {
+		case Instruction::kBCC:
+		case Instruction::kBCS:
+			e_.AluMemImm8(kCmp, kCtx, kCtxCarry, 0);
+			taken = o.op.instr == Instruction::kBCS ? kNotEqual : kEqual;
+			break;
+		case Instruction::kBVC:
+		case Instruction::kBVS:
+			e_.AluMemImm8(kCmp, kCtx, kCtxOverflow, 0);
+			taken = o.op.instr == Instruction::kBVS ? kNotEqual : kEqual;
+			break;
+		case Instruction::kBEQ:
+		case Instruction::kBNE:
+			e_.Test8(kNz, kNz);
+			taken = o.op.instr == Instruction::kBEQ ? kEqual : kNotEqual;
+			break;
+		case Instruction::kBMI:
+		case Instruction::kBPL:
+			if (nzSplit_) {
+				e_.TestMemImm8(kCtx, kCtxNSource, 0x80);
+				taken = o.op.instr == Instruction::kBMI ? kNotEqual : kEqual;
+			} else {
+				e_.Test8(kNz, kNz);
+				taken = o.op.instr == Instruction::kBMI ? kSign : kNotSign;
+			}
+			break;
+		default:
+			break;
+	}
+
+	// Same penalty rule as FetchOperand: offset applied to the opcode address
+	const uint16_t next = o.pc + o.size;
+	const uint16_t target = next + (int8_t)o.LL;
+	const bool crossed = ((o.pc + (int8_t)o.LL) & 0xFF00) != (o.pc & 0xFF00);
+	const auto jump = e_.Jcc(taken);
+	Exit(cycles_ + 3, opIndex_ + 1, false, next);
+	e_.Patch(jump, e_.Pos());
+	Exit(cycles_ + 4 + (crossed ? 1 : 0), opIndex_ + 1, false, target);
+}
+
+void BlockCompiler::Jump(const JitOp& o) {
+	const auto cycles = cycles_ + BaseCost(o.op) + 1;
+	switch (o.op.instr) {
+		case Instruction::kJMP:
+			Exit(cycles, opIndex_ + 1, false, Join(o.LL, o.HH));
+			break;
+		case Instruction::kJSR: {
+			const uint16_t ret = o.pc + o.size - 1;
+			e_.MovImm32(kRax, ret >> 8);
+			Push(kRax);
+			e_.MovImm32(kRax, ret & 0xFF);
+			Push(kRax);
+			Exit(cycles, opIndex_ + 1, false, Join(o.LL, o.HH));
+			break;
+		}
+		case Instruction::kRTS:
+			Pull(kRax);
+			Pull(kRdx);
+			e_.Shift32Imm(kShl, kRdx, 8);
+			e_.Alu32(kOr, kRax, kRdx);
+			e_.Alu32Imm(kAdd, kRax, 1);
+			e_.StoreWord(kCtx, kCtxPc, kRax);
+			Exit(cycles, opIndex_ + 1, true, 0);
+			break;
+		default:
+			break;
+	}
+}
+
+bool BlockCompiler::Compile() {
+	Prologue();
+
+	uint32_t maxCycles = 0;
+	bool ended = false;
+	uint32_t count = 0;
+	for (opIndex_ = 0; opIndex_ < ops_.size() && !ended; ++opIndex_) {
+		const auto& o = ops_[opIndex_];
+		if (!IsTranslatable(o)) {
+			break;
+		}
+
+		const auto group = GroupOf(o.op);
+		const uint32_t cost = BaseCost(o.op) + 1;
+		const uint32_t worst = cost + (HasPageCrossPenalty(o.op) ? 1 : 0) +
+			(group == Group::kBranch ? 2 : 0);
+		if (maxCycles + worst > kMaxBlockCycles) {
+			break;
+		}
+		maxCycles += worst;
+
+		switch (group) {
+			case Group::kRead: Read(o); break;
+			case Group::kStore: Store(o); break;
+			case Group::kModify: Modify(o); break;
+			case Group::kImplied: Implied(o); break;
+			case Group::kBranch: Branch(o); ended = true; break;
+			case Group::kJump: Jump(o); ended = true; break;
+			case Group::kUnsupported: break;
+		}
+		cycles_ += cost;
+		++count;
+	}
+
+	if (count == 0) {
+		return false;
+	}
+
+	if (!ended) {
+		const auto& last = ops_[count - 1];
+		const uint16_t pc = count < ops_.size() ? ops_[count].pc : last.pc + last.size;
+		Exit(cycles_, count, false, pc);
+	}
+
+	for (const auto& exit : sideExits_) {
+		e_.Patch(exit.jump, e_.Pos());
+		nzSplit_ = exit.nzSplit;
+		Exit(exit.cycles, exit.opCount, false, exit.pc);
+	}
+
+	Epilogue();
+
+	opCount_ = count;
+	maxCycles_ = maxCycles;
+	return true;
+}
+
+} // namespace
+
+bool Jit::IsSupported() {
+	return true;
+}
+
+Jit::Jit() {
+	void* mem = mmap(nullptr, kCodeArenaSize, PROT_READ | PROT_WRITE | PROT_EXEC,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem != MAP_FAILED) {
+		code_ = static_cast<uint8_t*>(mem);
+		codeSize_ = kCodeArenaSize;
+	}
+}
+
+Jit::~Jit() {
+	if (code_) {
+		munmap(code_, codeSize_);
+	}
+}
+
+Jit::Translation Jit::Translate(std::span<const JitOp> ops) {
+	BlockCompiler compiler(ops);
+	if (!code_ || !compiler.Compile()) {
+		return {};
+	}
+
+	auto& code = compiler.Code();
+	if (codeUsed_ + code.size() > codeSize_) {
+		return {};
+	}
+
+	auto* dst = code_ + codeUsed_;
+	std::memcpy(dst, code.data(), code.size());
+	codeUsed_ += (code.size() + 15) & ~size_t(15);
+
+	Translation res;
+	res.fn = reinterpret_cast<BlockFn>(dst);
+	res.opCount = compiler.GetOpCount();
+	res.maxCycles = compiler.GetMaxCycles();
+	return res;
+}
+
+void Jit::Clear() {
+	codeUsed_ = 0;
+}
+
+#else // NES_JIT_X64
+
+bool Jit::IsSupported() {
+	return false;
+}
+
+Jit::Jit() = default;
+Jit::~Jit() = default;
+
+Jit::Translation Jit::Translate(std::span<const JitOp> ops) {
+	return {};
+}
+
+void Jit::Clear() {}
+
+#endif // NES_JIT_X64
+
+} // namespace nes
@@ -0,0 +1,384 @@
+#include "nes/lockstep.h"
+
+#include "nes/instructions.h"
+#include "nes/utils.h"
+
+namespace nes {
+
+namespace {
+
+constexpr uint8_t kFlagN = 1 << 7;
+constexpr uint8_t kFlagV = 1 << 6;
+constexpr uint8_t kFlagD = 1 << 3;
+constexpr uint8_t kFlagI = 1 << 2;
+constexpr uint8_t kFlagZ = 1 << 1;
+constexpr uint8_t kFlagC = 1;
+
+// b where the lane mask is set, a elsewhere
+template<typename T>
+T Select(uint8_t mask, T a, T b) {
+	const T m = static_cast<T>(-static_cast<T>(mask & 1));
+	return (a & ~m) | (b & m);
+}
+
+uint8_t WithNZ(uint8_t status, uint8_t val) {
+	return (status & ~(kFlagN | kFlagZ)) | (val & kFlagN) | (val ? 0 : kFlagZ);
+}
+
+uint8_t WithFlag(uint8_t status, uint8_t flag, bool active) {
+	return (status & ~flag) | (active ? flag : 0);
+}
+
+// Only code in RAM or PRG space is fetched for lockstep comparison, so
+// that peeking operand bytes has no side effects
+bool IsPlainCode(uint16_t pc) {
+	return pc < 0x1FFE || IsInRange(0x8000, 0xFFFD, pc);
+}
+
+constexpr uint64_t kMaxVectorCost = 7;
+
+// DMA is run after the instruction that reaches it, which only the scalar
+// path does
+bool IsDmaDue(const Bus& bus, uint64_t cycle) {
+	return bus.GetNextDmaCycle() <= cycle + kMaxVectorCost;
+}
+
+// So are interrupts. A masked IRQ only matters when the instruction may
+// clear I, which the scalar CPU does with the poll delay.
+bool IsInterruptDue(const Bus& bus, uint64_t cycle, uint8_t status, uint8_t opCode) {
+	if (bus.GetInterruptCycle() > cycle + kMaxVectorCost) {
+		return false;
+	}
+	constexpr uint8_t kCLI = 0x58;
+	constexpr uint8_t kPLP = 0x28;
+	return bus.IsNMIPending() || !(status & kFlagI) || opCode == kCLI || opCode == kPLP;
+}
+
+} // namespace
+
+LockstepCpu::LockstepCpu(std::array<Machine*, kLaneCount> lanes)
+: lanes_(lanes)
+{
+	Reset();
+}
+
+void LockstepCpu::Reset() {
+	for (size_t i = 0; i < kLaneCount; ++i) {
+		LoadLane(i);
+	}
+}
+
+void LockstepCpu::Tick() {
+	for (auto* lane : lanes_) {
+		auto& ppu = lane->GetPpu();
+		ppu.Tick();
+		ppu.Tick();
+		ppu.Tick();
+	}
+
+	LaneMask pending;
+	for (size_t i = 0; i < kLaneCount; ++i) {
+		++cycle_[i];
+		pending[i] = cycleLeft_[i] == 0 ? 0xFF : 0x00;
+		cycleLeft_[i] -= cycleLeft_[i] != 0;
+	}
+
+	for (size_t leader = 0; leader < kLaneCount; ++leader) {
+		if (!pending[leader]) {
+			continue;
+		}
+
+		const uint16_t pc = pc_[leader];
+		auto& leaderBus = lanes_[leader]->GetBus();
+		if (IsDmaDue(leaderBus, cycle_[leader]) || !IsPlainCode(pc) ||
+		    IsInterruptDue(leaderBus, cycle_[leader], status_[leader], leaderBus.Read(pc, true))) {
+			ExecuteScalar(leader);
+			pending[leader] = 0;
+			continue;
+		}
+
+		const uint8_t opCode = leaderBus.Read(pc, true);
+		const uint8_t lo = leaderBus.Read(pc + 1, true);
+		const uint8_t hi = leaderBus.Read(pc + 2, true);
+
+		LaneMask group{};
+		size_t groupSize = 0;
+		for (size_t i = leader; i < kLaneCount; ++i) {
+			if (!pending[i] || pc_[i] != pc) {
+				continue;
+			}
+			auto& bus = lanes_[i]->GetBus();
+			if (IsDmaDue(bus, cycle_[i]) || IsInterruptDue(bus, cycle_[i], status_[i], opCode) ||
+			    bus.Read(pc, true) != opCode ||
+			    bus.Read(pc + 1, true) != lo || bus.Read(pc + 2, true) != hi) {
+				continue;
+			}
+			group[i] = 0xFF;
+			++groupSize;
+		}
+
+		if (groupSize > 1 && ExecuteVector(group, pc, opCode, lo, hi)) {
+			stats_.vectorInstructions += groupSize;
+		} else {
+			for (size_t i = leader; i < kLaneCount; ++i) {
+				if (group[i]) {
+					ExecuteScalar(i);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < kLaneCount; ++i) {
+			pending[i] &= ~group[i];
+		}
+	}
+}
+
+void LockstepCpu::RunFrame() {
+	auto& ppu = lanes_[0]->GetPpu();
+	const auto frameId = ppu.GetActiveFramebufferId();
+	while (ppu.GetActiveFramebufferId() == frameId) {
+		Tick();
+	}
+}
+
+CpuState LockstepCpu::GetLaneState(size_t lane) const {
+	return {pc_[lane], acc_[lane], x_[lane], y_[lane], stackPtr_[lane], status_[lane],
+		cycle_[lane]};
+}
+
+const LockstepCpu::Stats& LockstepCpu::GetStats() const {
+	return stats_;
+}
+
+bool LockstepCpu::ExecuteVector(const LaneMask& mask, uint16_t pc, uint8_t opCode,
+				uint8_t lo, uint8_t hi) {
+	auto it = kOpDecoder.find(opCode);
+	if (it == kOpDecoder.end()) {
+		return false;
+	}
+	const auto op = it->second;
+	const uint16_t next = pc + OpSizeByMode(op.addrMode);
+
+	// Branches pick their PC and timing per lane
+	if (op.addrMode == AddressMode::kREL) {
+		uint8_t flag = 0;
+		bool expected = true;
+		switch (op.instr) {
+			case Instruction::kBCC: flag = kFlagC; expected = false; break;
+			case Instruction::kBCS: flag = kFlagC; expected = true; break;
+			case Instruction::kBNE: flag = kFlagZ; expected = false; break;
+			case Instruction::kBEQ: flag = kFlagZ; expected = true; break;
+			case Instruction::kBPL: flag = kFlagN; expected = false; break;
+			case Instruction::kBMI: flag = kFlagN; expected = true; break;
+			case Instruction::kBVC: flag = kFlagV; expected = false; break;
+			case Instruction::kBVS: flag = kFlagV; expected = true; break;
+			default: return false;
+		}
+		const uint16_t target = next + (int8_t)lo;
+		const uint8_t crossed = ((pc + (int8_t)lo) & 0xFF00) != (pc & 0xFF00) ? 1 : 0;
+		for (size_t i = 0; i < kLaneCount; ++i) {
+			const bool taken = ((status_[i] & flag) != 0) == expected;
+			pc_[i] = Select<uint16_t>(mask[i], pc_[i], taken ? target : next);
+			cycleLeft_[i] += mask[i] & (taken ? 3 + crossed : 2);
+		}
+		return true;
+	}
+
+	uint8_t cost = 2;
+	uint16_t nextPc = next;
+	switch (op.addrMode) {
+		case AddressMode::kIMM: {
+			switch (op.instr) {
+				case Instruction::kLDA:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						acc_[i] = Select(mask[i], acc_[i], lo);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status_[i], lo));
+					}
+					break;
+				case Instruction::kLDX:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						x_[i] = Select(mask[i], x_[i], lo);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status_[i], lo));
+					}
+					break;
+				case Instruction::kLDY:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						y_[i] = Select(mask[i], y_[i], lo);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status_[i], lo));
+					}
+					break;
+				case Instruction::kAND:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						const uint8_t res = acc_[i] & lo;
+						acc_[i] = Select(mask[i], acc_[i], res);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status_[i], res));
+					}
+					break;
+				case Instruction::kORA:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						const uint8_t res = acc_[i] | lo;
+						acc_[i] = Select(mask[i], acc_[i], res);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status_[i], res));
+					}
+					break;
+				case Instruction::kEOR:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						const uint8_t res = acc_[i] ^ lo;
+						acc_[i] = Select(mask[i], acc_[i], res);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status_[i], res));
+					}
+					break;
+				case Instruction::kADC:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						const uint8_t acc = acc_[i];
+						const uint16_t sum = acc + lo + (status_[i] & kFlagC);
+						const uint8_t res = sum & 0xFF;
+						uint8_t status = WithFlag(status_[i], kFlagC, sum >> 8);
+						status = WithFlag(status, kFlagV,
+								  !((acc ^ lo) & 0x80) && ((acc ^ res) & 0x80));
+						acc_[i] = Select(mask[i], acc, res);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status, res));
+					}
+					break;
+				case Instruction::kSBC:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						const uint8_t acc = acc_[i];
+						const uint16_t sum = acc + ~lo + (status_[i] & kFlagC);
+						const uint8_t res = sum & 0xFF;
+						uint8_t status = WithFlag(status_[i], kFlagC, !(sum >> 8));
+						status = WithFlag(status, kFlagV,
+								  !!((~(acc ^ ~lo)) & (acc ^ res) & 0x80));
+						acc_[i] = Select(mask[i], acc, res);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status, res));
+					}
+					break;
+				case Instruction::kCMP:
+				case Instruction::kCPX:
+				case Instruction::kCPY: {
+					const auto& reg = op.instr == Instruction::kCMP ? acc_
+							: op.instr == Instruction::kCPX ? x_ : y_;
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						uint8_t status = WithNZ(status_[i], reg[i] - lo);
+						status = WithFlag(status, kFlagC, reg[i] >= lo);
+						status_[i] = Select(mask[i], status_[i], status);
+					}
+					break;
+				}
+				case Instruction::kNOP:
+					break;
+				default:
+					return false;
+			}
+			break;
+		}
+		case AddressMode::kIMP: {
+			switch (op.instr) {
+				case Instruction::kTAX:
+				case Instruction::kTAY:
+				case Instruction::kTXA:
+				case Instruction::kTYA:
+				case Instruction::kTSX: {
+					const auto& src = op.instr == Instruction::kTXA ? x_
+							: op.instr == Instruction::kTYA ? y_
+							: op.instr == Instruction::kTSX ? stackPtr_ : acc_;
+					auto& dst = (op.instr == Instruction::kTAX || op.instr == Instruction::kTSX) ? x_
+						  : op.instr == Instruction::kTAY ? y_ : acc_;
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						const uint8_t val = src[i];
+						dst[i] = Select(mask[i], dst[i], val);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status_[i], val));
+					}
+					break;
+				}
+				case Instruction::kTXS:
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						stackPtr_[i] = Select(mask[i], stackPtr_[i], x_[i]);
+					}
+					break;
+				case Instruction::kINX:
+				case Instruction::kDEX:
+				case Instruction::kINY:
+				case Instruction::kDEY: {
+					auto& reg = (op.instr == Instruction::kINX || op.instr == Instruction::kDEX) ? x_ : y_;
+					const uint8_t delta =
+					    (op.instr == Instruction::kINX || op.instr == Instruction::kINY) ? 1 : 0xFF;
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						const uint8_t val = reg[i] + delta;
+						reg[i] = Select(mask[i], reg[i], val);
+						status_[i] = Select(mask[i], status_[i], WithNZ(status_[i], val));
+					}
+					break;
+				}
+				case Instruction::kCLC:
+				case Instruction::kSEC:
+				case Instruction::kCLI:
+				case Instruction::kSEI:
+				case Instruction::kCLV:
+				case Instruction::kCLD:
+				case Instruction::kSED: {
+					uint8_t flag = 0;
+					bool active = false;
+					switch (op.instr) {
+						case Instruction::kCLC: flag = kFlagC; active = false; break;
+						case Instruction::kSEC: flag = kFlagC; active = true; break;
+						case Instruction::kCLI: flag = kFlagI; active = false; break;
+						case Instruction::kSEI: flag = kFlagI; active = true; break;
+						case Instruction::kCLV: flag = kFlagV; active = false; break;
+						case Instruction::kCLD: flag = kFlagD; active = false; break;
+						default: flag = kFlagD; active = true; break;
+					}
+					for (size_t i = 0; i < kLaneCount; ++i) {
+						status_[i] = Select(mask[i], status_[i], WithFlag(status_[i], flag, active));
+					}
+					break;
+				}
+				case Instruction::kNOP:
+					break;
+				default:
+					return false;
+			}
+			break;
+		}
+		case AddressMode::kABS: {
+			if (op.instr != Instruction::kJMP) {
+				return false;
+			}
+			nextPc = (uint16_t)hi << 8 | lo;
+			cost = 3;
+			break;
+		}
+		default:
+			return false;
+	}
+
+	for (size_t i = 0; i < kLaneCount; ++i) {
+		pc_[i] = Select(mask[i], pc_[i], nextPc);
+		cycleLeft_[i] += mask[i] & cost;
+	}
+	return true;
+}
+
+void LockstepCpu::ExecuteScalar(size_t lane) {
+	auto& cpu = lanes_[lane]->GetCpu();
+	// Tick() accounts the current cycle itself
+	cpu.SetState({pc_[lane], acc_[lane], x_[lane], y_[lane], stackPtr_[lane], status_[lane],
+		      cycle_[lane] - 1});
+	cpu.Tick();
+	LoadLane(lane);
+	++stats_.scalarInstructions;
+}
+
+void LockstepCpu::LoadLane(size_t lane) {
+	const auto& cpu = lanes_[lane]->GetCpu();
+	const auto state = cpu.CaptureState();
+	pc_[lane] = state.pc;
+	acc_[lane] = state.acc;
+	x_[lane] = state.x;
+	y_[lane] = state.y;
+	stackPtr_[lane] = state.stackPtr;
+	status_[lane] = state.status;
+	cycle_[lane] = state.cycle;
+	cycleLeft_[lane] = cpu.GetCyclesLeft();
+}
+
+} // namespace nes
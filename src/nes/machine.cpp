@@ -0,0 +1,103 @@
+#include "nes/machine.h"
+
+#include "nes/hosttrace.h"
+
+#include <algorithm>
+
+namespace nes {
+
+Machine::Machine()
+: bus_()
+, cpu_(&bus_)
+, ppu_(&bus_)
+, apu_(&bus_)
+, idleLoopSkipper_(&bus_, &cpu_, &ppu_)
+{
+	for (auto& buffer : frameBuffers_) {
+		buffer = std::make_unique<RGBA[]>(kScreenColCount * kScreenRowCount);
+	}
+	ppu_.SetFramebuffers(GetOwnFramebuffers());
+	bus_.AttachController(&con1_, true);
+	bus_.AttachController(&con2_, false);
+}
+
+bool Machine::LoadRom(std::span<const uint8_t> rom) {
+	if (!cartridge_.LoadData(rom)) {
+		return false;
+	}
+	bus_.InsertCartridge(&cartridge_);
+	cpu_.Reset();
+	apu_.Reset();
+	idleLoopSkipper_.Reset();
+	return true;
+}
+
+void Machine::Reset() {
+	cartridge_.Reset();
+	bus_.Reset();
+	ppu_.Reset();
+	cpu_.Reset();
+	apu_.Reset();
+	con1_ = {};
+	con2_ = {};
+	idleLoopSkipper_.Reset();
+	// Nothing is drawn until the program enables rendering
+	for (auto& buffer : frameBuffers_) {
+		std::fill_n(buffer.get(), kScreenColCount * kScreenRowCount, RGBA{});
+	}
+}
+
+void Machine::RunFrame() {
+	NES_TRACE_ZONE("Machine::RunFrame");
+	const auto frameId = ppu_.GetActiveFramebufferId();
+	while (ppu_.GetActiveFramebufferId() == frameId) {
+		Step();
+	}
+}
+
+void Machine::Step() {
+	const auto frameId = ppu_.GetActiveFramebufferId();
+	ppu_.Tick();
+	ppu_.Tick();
+	ppu_.Tick();
+	if (skipIdleLoops_ && cpu_.GetCyclesLeft() == 0 &&
+	    idleLoopSkipper_.OnBoundary(frameId)) {
+		return;
+	}
+	cpu_.Tick();
+}
+
+void Machine::SetIdleLoopSkipping(bool enabled) {
+	skipIdleLoops_ = enabled;
+	idleLoopSkipper_.Reset();
+}
+
+const IdleLoopSkipper& Machine::GetIdleLoopSkipper() const {
+	return idleLoopSkipper_;
+}
+
+Bus& Machine::GetBus() {
+	return bus_;
+}
+
+Cpu6502& Machine::GetCpu() {
+	return cpu_;
+}
+
+Ppu2C02& Machine::GetPpu() {
+	return ppu_;
+}
+
+Apu2A03& Machine::GetApu() {
+	return apu_;
+}
+
+Controller& Machine::GetController(bool playerOne) {
+	return playerOne ? con1_ : con2_;
+}
+
+std::array<RGBA*, 2> Machine::GetOwnFramebuffers() {
+	return {frameBuffers_[0].get(), frameBuffers_[1].get()};
+}
+
+} // namespace nes
@@ -0,0 +1,96 @@
+#include "nes/mappers/mapper_discrete.h"
+
+#include "tfm/tinyformat.h"
+
+#include <assert.h>
+
+namespace nes::mapper {
+
+namespace {
+
+constexpr size_t kChrRamSize = 0x2000;
+
+} // namespace
+
+template<typename Board>
+Mapper_Discrete<Board>::Mapper_Discrete(uint8_t* buffer, size_t bufSize, RomDescriptor desc)
+: MapperBase(buffer, bufSize, desc)
+, prgBankCount_(desc.prgRomSize / decltype(prg_)::kWindowSize)
+, chrBankCount_(desc.chrRomSize / decltype(chr_)::kWindowSize)
+, chrData_(buffer + desc.chrRomStart)
+{
+	if (chrBankCount_ == 0) {
+		chrRAM_ = std::make_unique<uint8_t[]>(kChrRamSize);
+		chrData_ = chrRAM_.get();
+		chrBankCount_ = 1;
+	}
+	UpdateBanks();
+}
+
+template<typename Board>
+const std::string& Mapper_Discrete<Board>::GetName() {
+	static const std::string name = Board::kName;
+	return name;
+}
+
+template<typename Board>
+uint16_t Mapper_Discrete<Board>::GetId() {
+	return Board::kId;
+}
+
+template<typename Board>
+std::span<uint8_t> Mapper_Discrete<Board>::ReadPrgN(uint16_t addr, uint16_t count) {
+	if (addr >= 0x8000) {
+		const uint32_t offset = addr - 0x8000;
+		assert(offset % prg_.kWindowSize + count <= prg_.kWindowSize);
+		return {prg_.Resolve(offset), count};
+	}
+
+	tfm::printf("ERROR: Invalid PRG-N read address at 0x%04X!", addr);
+	assert(false);
+	return {};
+}
+
+template<typename Board>
+void Mapper_Discrete<Board>::WritePrg(uint16_t addr, uint8_t val) {
+	if (addr < 0x8000) {
+		return; // no PRG RAM, writes are lost
+	}
+	// The ROM drives the data bus too, the latch sees both values ANDed
+	latch_ = Board::kBusConflicts ? val & ReadPrg(addr) : val;
+	UpdateBanks();
+}
+
+template<typename Board>
+uint32_t Mapper_Discrete<Board>::GetPrgBankId(uint16_t addr) {
+	if (addr >= 0x8000) {
+		return prg_.GetBank(addr - 0x8000);
+	}
+	return kPrgRamBank;
+}
+
+template<typename Board>
+void Mapper_Discrete<Board>::WriteChar(uint16_t addr, uint8_t val) {
+	if (chrRAM_) { // CHR ROM ignores writes
+		*chr_.Resolve(addr) = val;
+	}
+}
+
+template<typename Board>
+void Mapper_Discrete<Board>::UpdateBanks() {
+	uint8_t* prgData = buffer_ + descriptor_.prgRomStart;
+	constexpr size_t kPrgWindows = decltype(prg_)::kWindowCount;
+	prg_.Map(0, prgData, Board::kPrg.Decode(latch_) % prgBankCount_);
+	for (size_t i = 1; i < kPrgWindows; ++i) {
+		prg_.Map(i, prgData, (prgBankCount_ - kPrgWindows + i) % prgBankCount_);
+	}
+	chr_.Map(0, chrData_, Board::kChr.Decode(latch_) % chrBankCount_);
+}
+
+template class Mapper_Discrete<UxROM>;
+template class Mapper_Discrete<CNROM>;
+template class Mapper_Discrete<AxROM>;
+template class Mapper_Discrete<ColorDreams>;
+template class Mapper_Discrete<GxROM>;
+
+} // namespace nes::mapper
@@ -3,6 +3,8 @@
 #include "tfm/tinyformat.h"
 #include "nes/utils.h"
 
+#include <cstring>
+
 namespace nes::mapper {
 
 namespace {
@@ -10,12 +12,22 @@ namespace {
 const std::string kMapperName = "MMC1";
 uint16_t kMapperId = 1;
 
+constexpr size_t kChrRamSize = 0x2000;
+
 } // namespace
 
 Mapper_MMC1::Mapper_MMC1(uint8_t* buffer, size_t bufSize, RomDescriptor desc)
 : MapperBase(buffer, bufSize, desc)
 , prgBankCount_(desc.prgRomSize >> 14)
+, chrBankCount_(desc.chrRomSize / decltype(chr_)::kWindowSize)
+, chrData_(buffer + desc.chrRomStart)
 {
+	if (chrBankCount_ == 0) {
+		chrRAM_ = std::make_unique<uint8_t[]>(kChrRamSize);
+		chrData_ = chrRAM_.get();
+		chrBankCount_ = kChrRamSize / decltype(chr_)::kWindowSize;
+	}
+	UpdateChrBanks();
 	memset(prgRAM_.data(), 0, 0x2000);
 	memset(prgBankAddressOffsets_.data(), 0, prgBankAddressOffsets_.size() * sizeof(size_t));
 	Reset();
@@ -29,30 +41,15 @@ uint16_t Mapper_MMC1::GetId() {
 	return kMapperId;
 }
 
-uint8_t Mapper_MMC1::ReadPrg(uint16_t addr) {
-	if (IsInRange(0x6000, 0x7FFF, addr) && ramEnabled_) { // PRG RAM
-		return prgRAM_[addr - 0x6000];
-	} else if (IsInRange(0x8000, 0xBFFF, addr)) {
-		return buffer_[descriptor_.prgRomStart + prgBankAddressOffsets_[0] + (addr - 0x8000)];
-	} else if (IsInRange(0xC000, 0xFFFF, addr)) {
-		return buffer_[descriptor_.prgRomStart + prgBankAddressOffsets_[1] + (addr - 0xC000)];
-	}
-
-	tfm::printf("ERROR: Invalid PRG read address at 0x%04X!", addr);
-	assert(false);
-	return 0;
-}
-
 std::span<uint8_t> Mapper_MMC1::ReadPrgN(uint16_t addr, uint16_t count) {
-	uint16_t endAddr = addr + count;
 	if (IsInRange(0x6000, 0x7FFF, addr) && ramEnabled_) { // PRG RAM
 		uint16_t effAddr = addr - 0x6000;
 		return {prgRAM_.data() + effAddr, count};
 	} else if (IsInRange(0x8000, 0xBFFF, addr)) {
-		uint16_t effAddr = prgBankAddressOffsets_[0] + (addr - 0x8000);
+		size_t effAddr = descriptor_.prgRomStart + prgBankAddressOffsets_[0] + (addr - 0x8000);
 		return {buffer_ + effAddr, count};
 	} else if (IsInRange(0xC000, 0xFFFF, addr)) {
-		uint16_t effAddr = prgBankAddressOffsets_[1] + (addr - 0xC000);
+		size_t effAddr = descriptor_.prgRomStart + prgBankAddressOffsets_[1] + (addr - 0xC000);
 		return {buffer_ + effAddr, count};
 	}
 
@@ -62,8 +59,10 @@ std::span<uint8_t> Mapper_MMC1::ReadPrgN(uint16_t addr, uint16_t count) {
 }
 
 void Mapper_MMC1::WritePrg(uint16_t addr, uint8_t val) {
-	if (IsInRange(0x6000, 0x7FFF, addr) && ramEnabled_) { // PRG RAM
-		prgRAM_[addr - 0x6000] = val;
+	if (IsInRange(0x6000, 0x7FFF, addr)) { // PRG RAM, writes are lost while disabled
+		if (ramEnabled_) {
+			prgRAM_[addr - 0x6000] = val;
+		}
 	} else if (IsInRange(0x8000, 0xFFFF, addr)) {
 		if (val & 0x80) {
 			shiftRegister_ = 0;
@@ -80,81 +79,83 @@ void Mapper_MMC1::WritePrg(uint16_t addr, uint8_t val) {
 				writeCount_ = 0;
 			}
 		}
-		return;
 	}
-
-	tfm::printf("ERROR: Invalid PRG write address at 0x%04X!", addr);
-	assert(false);
+	// Nothing is decoded at $4020-$5FFF
 }
 
-uint8_t Mapper_MMC1::ReadChar(uint16_t addr) {
-	return buffer_[descriptor_.chrRomStart + addr];
-}
+uint32_t Mapper_MMC1::GetPrgBankId(uint16_t addr) {
+	if (IsInRange(0x8000, 0xBFFF, addr)) {
+		return prgBankAddressOffsets_[0] >> 14;
+	} else if (IsInRange(0xC000, 0xFFFF, addr)) {
+		return prgBankAddressOffsets_[1] >> 14;
+	}
 
-std::span<uint8_t> Mapper_MMC1::ReadChrN(uint16_t addr, uint16_t count) {
-	return {buffer_ + descriptor_.chrRomStart + addr, count};
+	return kPrgRamBank;
 }
 
 void Mapper_MMC1::WriteChar(uint16_t addr, uint8_t val) {
-	tfm::printf("ERROR: Invalid CHR write address at 0x%04X!", addr);
-	assert(false);
+	if (chrRAM_) { // CHR ROM ignores writes
+		*chr_.Resolve(addr) = val;
+	}
 }
 
 void Mapper_MMC1::HandleControlMsg(uint16_t addr, uint8_t msg) {
 	if (IsInRange(0x8000, 0x9FFF, addr)) { // Control
-		prgRomBankMode_ = (msg & 0x0A) >> 2;
+		prgRomBankMode_ = (msg & 0x0C) >> 2;
 		chrRomBankMode_ = (msg & 0x10) >> 4;
+		UpdatePrgBanks();
+		UpdateChrBanks();
 	} else if (IsInRange(0xA000, 0xBFFF, addr)) { // CHR bank 0
-		auto bankNr = msg & 0x0F;
-		if (chrRomBankMode_ == 0) { // 8KB CHR ROM
-			bankNr &= 0xFE;
-			chrBankAddressOffsets_[0] = bankNr * 0x1000;
-			chrBankAddressOffsets_[1] = (bankNr + 1) * 0x1000;
-		} else {
-			chrBankAddressOffsets_[0] = bankNr * 0x1000;
-		}
-		tfm::printf("MMC1: CHR bank swapped:\n- Bank0 = 0x%06X\n- Bank1 = 0x%06X\n",
-				chrBankAddressOffsets_[0], chrBankAddressOffsets_[1]);
+		chrBanks_[0] = msg & 0x1F;
+		UpdateChrBanks();
 	} else if (IsInRange(0xC000, 0xDFFF, addr)) { // CHR bank 1
-		if (chrRomBankMode_ == 1) {
-			auto bankNr = msg & 0x0F;
-			chrBankAddressOffsets_[1] = bankNr * 0x1000;
-			tfm::printf("MMC1: CHR bank swapped:\n- Bank0 = 0x%06X\n- Bank1 = 0x%06X\n",
-					chrBankAddressOffsets_[0], chrBankAddressOffsets_[1]);
-		}
+		chrBanks_[1] = msg & 0x1F;
+		UpdateChrBanks();
 	} else if (IsInRange(0xE000, 0xFFFF, addr)) { // PRG bank
-		auto bankNr = msg & 0x0F;
-		switch (prgRomBankMode_) {
-			case 0:
-			case 1: {
-				bankNr &= 0xFE;
-				prgBankAddressOffsets_[0] = bankNr * 0x4000;
-				prgBankAddressOffsets_[1] = (bankNr + 1) * 0x4000;
-				break;
-			}
-			case 2: {
-				prgBankAddressOffsets_[0] = 0;
-				prgBankAddressOffsets_[1] = bankNr * 0x4000;
-				break;
-			}
-			case 3: {
-				prgBankAddressOffsets_[0] = bankNr * 0x4000;
-				prgBankAddressOffsets_[1] = (prgBankCount_ - 1) * 0x4000;
-				break;
-			}
+		prgBank_ = msg & 0x0F;
+		ramEnabled_ = !(msg & 0x10);
+		UpdatePrgBanks();
+	}
+}
+
+void Mapper_MMC1::UpdatePrgBanks() {
+	uint32_t banks[2] = {};
+	switch (prgRomBankMode_) {
+		case 0:
+		case 1: { // 32KB, the low bit is ignored
+			banks[0] = prgBank_ & 0xFE;
+			banks[1] = banks[0] + 1;
+			break;
+		}
+		case 2: { // first bank fixed at $8000
+			banks[0] = 0;
+			banks[1] = prgBank_;
+			break;
 		}
+		case 3: { // last bank fixed at $C000
+			banks[0] = prgBank_;
+			banks[1] = prgBankCount_ - 1;
+			break;
+		}
+	}
+	prgBankAddressOffsets_[0] = (banks[0] % prgBankCount_) * 0x4000;
+	prgBankAddressOffsets_[1] = (banks[1] % prgBankCount_) * 0x4000;
+}
 
-		ramEnabled_ = !(msg & 0x10);
-		tfm::printf("MMC1: PRG bank swapped (total %d):\n- Bank0 = 0x%06X\n- Bank1 = 0x%06X\n",
-				prgBankCount_, prgBankAddressOffsets_[0],prgBankAddressOffsets_[1]);
+void Mapper_MMC1::UpdateChrBanks() {
+	uint32_t banks[2] = {chrBanks_[0], chrBanks_[1]};
+	if (chrRomBankMode_ == 0) { // 8KB, the low bit is ignored
+		banks[0] = chrBanks_[0] & 0x1E;
+		banks[1] = banks[0] + 1;
 	}
+	chr_.Map(0, chrData_, banks[0] % chrBankCount_);
+	chr_.Map(1, chrData_, banks[1] % chrBankCount_);
 }
 
+// Writing a value with bit 7 set also selects PRG mode 3
 void Mapper_MMC1::Reset() {
-	prgBankAddressOffsets_[0] = 0x0000;
-	prgBankAddressOffsets_[1] = (prgBankCount_ - 1) * 0x4000;
-	tfm::printf("MMC1: PRG bank reset!\n- Bank0 = 0x%06X\n- Bank1 = 0x%06X\n",
-			prgBankAddressOffsets_[0], prgBankAddressOffsets_[1]);
+	prgRomBankMode_ = 3;
+	UpdatePrgBanks();
 }
 
 } // namespace nes::mapper
@@ -0,0 +1,168 @@
+#include "nes/mappers/mapper_mmc3.h"
+
+#include "tfm/tinyformat.h"
+#include "nes/utils.h"
+
+#include <assert.h>
+
+namespace nes::mapper {
+
+namespace {
+
+const std::string kMapperName = "MMC3";
+uint16_t kMapperId = 4;
+
+constexpr size_t kChrRamSize = 0x2000;
+
+} // namespace
+
+Mapper_MMC3::Mapper_MMC3(uint8_t* buffer, size_t bufSize, RomDescriptor desc)
+: MapperBase(buffer, bufSize, desc)
+, prgBankCount_(desc.prgRomSize / decltype(prg_)::kWindowSize)
+, chrBankCount_(desc.chrRomSize / decltype(chr_)::kWindowSize)
+, chrData_(buffer + desc.chrRomStart)
+{
+	if (chrBankCount_ == 0) {
+		chrRAM_ = std::make_unique<uint8_t[]>(kChrRamSize);
+		chrData_ = chrRAM_.get();
+		chrBankCount_ = kChrRamSize / decltype(chr_)::kWindowSize;
+	}
+	UpdateBanks();
+}
+
+const std::string& Mapper_MMC3::GetName() {
+	return kMapperName;
+}
+
+uint16_t Mapper_MMC3::GetId() {
+	return kMapperId;
+}
+
+std::span<uint8_t> Mapper_MMC3::ReadPrgN(uint16_t addr, uint16_t count) {
+	if (addr >= 0x8000) {
+		const uint32_t offset = addr - 0x8000;
+		assert(offset % prg_.kWindowSize + count <= prg_.kWindowSize);
+		return {prg_.Resolve(offset), count};
+	}
+	if (IsInRange(0x6000, 0x7FFF, addr) && ramEnabled_) {
+		return {prgRAM_.data() + (addr - 0x6000), count};
+	}
+
+	tfm::printf("ERROR: Invalid PRG-N read address at 0x%04X!", addr);
+	assert(false);
+	return {};
+}
+
+void Mapper_MMC3::WritePrg(uint16_t addr, uint8_t val) {
+	if (IsInRange(0x6000, 0x7FFF, addr)) {
+		if (ramEnabled_ && ramWritable_) {
+			prgRAM_[addr - 0x6000] = val;
+		}
+		return;
+	}
+	if (addr < 0x8000) {
+		return; // nothing is decoded at $4020-$5FFF
+	}
+
+	// Registers are decoded from A14, A13 and A0
+	const bool odd = addr & 0x01;
+	switch (addr & 0xE000) {
+		case 0x8000: {
+			if (odd) {
+				bankRegisters_[bankSelect_ & 0x07] = val;
+			} else {
+				bankSelect_ = val;
+			}
+			UpdateBanks();
+			break;
+		}
+		case 0xA000: {
+			// Even: mirroring, the PPU has a fixed nametable layout
+			if (odd) {
+				ramEnabled_ = val & 0x80;
+				ramWritable_ = !(val & 0x40);
+			}
+			break;
+		}
+		case 0xC000: {
+			if (odd) {
+				irqCounter_ = 0;
+				irqReload_ = true;
+			} else {
+				irqLatch_ = val;
+			}
+			break;
+		}
+		case 0xE000: {
+			irqEnabled_ = odd;
+			if (!odd) {
+				irqPending_ = false;
+			}
+			break;
+		}
+	}
+}
+
+uint32_t Mapper_MMC3::GetPrgBankId(uint16_t addr) {
+	if (addr >= 0x8000) {
+		return prg_.GetBank(addr - 0x8000);
+	}
+	return kPrgRamBank;
+}
+
+void Mapper_MMC3::WriteChar(uint16_t addr, uint8_t val) {
+	if (chrRAM_) { // CHR ROM ignores writes
+		*chr_.Resolve(addr) = val;
+	}
+}
+
+void Mapper_MMC3::ClockScanline() {
+	if (irqCounter_ == 0 || irqReload_) {
+		irqCounter_ = irqLatch_;
+		irqReload_ = false;
+	} else {
+		--irqCounter_;
+	}
+	if (irqCounter_ == 0 && irqEnabled_) {
+		irqPending_ = true;
+	}
+}
+
+bool Mapper_MMC3::IsIrqPending() const {
+	return irqPending_;
+}
+
+bool Mapper_MMC3::IsIrqDueNextScanline() const {
+	if (!irqEnabled_) {
+		return false;
+	}
+	return (irqCounter_ == 0 || irqReload_) ? irqLatch_ == 0 : irqCounter_ == 1;
+}
+
+void Mapper_MMC3::UpdateBanks() {
+	uint8_t* prgData = buffer_ + descriptor_.prgRomStart;
+	const uint32_t secondLast = prgBankCount_ - 2;
+	const uint32_t last = prgBankCount_ - 1;
+	const uint32_t r6 = bankRegisters_[6] % prgBankCount_;
+	const uint32_t r7 = bankRegisters_[7] % prgBankCount_;
+	// PRG mode 1 swaps the $8000 and $C000 windows
+	const bool prgSwapped = bankSelect_ & 0x40;
+	prg_.Map(0, prgData, prgSwapped ? secondLast : r6);
+	prg_.Map(1, prgData, r7);
+	prg_.Map(2, prgData, prgSwapped ? r6 : secondLast);
+	prg_.Map(3, prgData, last);
+
+	// R0 and R1 select 2KB banks, R2-R5 1KB banks; CHR mode 1 swaps the
+	// pattern table halves
+	const size_t invert = (bankSelect_ & 0x80) ? 4 : 0;
+	const uint32_t chrBanks[8] = {
+		(uint32_t)(bankRegisters_[0] & 0xFE), (uint32_t)(bankRegisters_[0] | 0x01),
+		(uint32_t)(bankRegisters_[1] & 0xFE), (uint32_t)(bankRegisters_[1] | 0x01),
+		bankRegisters_[2], bankRegisters_[3], bankRegisters_[4], bankRegisters_[5],
+	};
+	for (size_t i = 0; i < 8; ++i) {
+		chr_.Map(i ^ invert, chrData_, chrBanks[i] % chrBankCount_);
+	}
+}
+
+} // namespace nes::mapper
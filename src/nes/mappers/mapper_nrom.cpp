@@ -1,7 +1,6 @@
 #include "nes/mappers/mapper_nrom.h"
 
-#include "tfm/tinyformat.h"
-#include "nes/utils.h"
+#include <assert.h>
 
 namespace nes::mapper {
 
@@ -10,10 +9,21 @@ namespace {
 const std::string kMapperName = "NROM";
 uint16_t kMapperId = 0;
 
+constexpr size_t kChrRamSize = 0x2000;
+
 } // namespace
 
-Mapper_NROM::Mapper_NROM(uint8_t* buffer, size_t bufSize, RomDescriptor desc):
-	MapperBase(buffer, bufSize, desc) {}
+Mapper_NROM::Mapper_NROM(uint8_t* buffer, size_t bufSize, RomDescriptor desc)
+: MapperBase(buffer, bufSize, desc)
+, prgData_(buffer + desc.prgRomStart)
+, prgMask_(desc.prgRomSize > 0x4000 ? 0x7FFF : 0x3FFF)
+, chrData_(buffer + desc.chrRomStart)
+{
+	if (desc.chrRomSize == 0) {
+		chrRAM_ = std::make_unique<uint8_t[]>(kChrRamSize);
+		chrData_ = chrRAM_.get();
+	}
+}
 
 const std::string& Mapper_NROM::GetName() {
 	return kMapperName;
@@ -23,58 +33,27 @@ uint16_t Mapper_NROM::GetId() {
 	return kMapperId;
 }
 
-uint8_t Mapper_NROM::ReadPrg(uint16_t addr) {
-	if (IsInRange(0x8000, 0xBFFF, addr)) {
-		return buffer_[descriptor_.prgRomStart + (addr - 0x8000)];
-	}
-	if (IsInRange(0xC000, 0xFFFF, addr)) {
-		if (descriptor_.prgRomSize > 0x4000) {
-			return buffer_[descriptor_.prgRomStart + (addr - 0x8000)];
-		} else {
-			return buffer_[descriptor_.prgRomStart + (addr - 0xC000)];
-		}
-	}
-
-	tfm::printf("ERROR: Invalid PRG read address at 0x%04X!", addr);
-	assert(false);
-	return 0;
-}
-
 std::span<uint8_t> Mapper_NROM::ReadPrgN(uint16_t addr, uint16_t count) {
-	if (IsInRange(0x8000, 0xBFFF, addr)) {
-		auto effAddr = descriptor_.prgRomStart + addr - 0x8000;
-		return {buffer_ + effAddr, count};
-	}
-	if (IsInRange(0xC000, 0xFFFF, addr)) {
-		if (descriptor_.prgRomSize > 0x4000) {
-			auto effAddr = descriptor_.prgRomStart + (addr - 0x8000);
-			return {buffer_ + effAddr, count};
-		} else {
-			auto effAddr = descriptor_.prgRomStart + (addr - 0xC000);
-			return {buffer_ + effAddr, count};
-		}
+	if (addr >= 0x8000) {
+		return {prgData_ + (addr & prgMask_), count};
 	}
 
 	assert(false);
 	return {};
 }
 
-void Mapper_NROM::WritePrg(uint16_t addr, uint8_t val) {
-	tfm::printf("ERROR: Invalid PRG write address at 0x%04X!", addr);
-	assert(false);
+void Mapper_NROM::WritePrg(uint16_t, uint8_t) {
+	// No registers and no PRG RAM, writes are lost
 }
 
-uint8_t Mapper_NROM::ReadChar(uint16_t addr) {
-	return buffer_[descriptor_.chrRomStart + addr];
-}
-
-std::span<uint8_t> Mapper_NROM::ReadChrN(uint16_t addr, uint16_t count) {
-	return {buffer_ + descriptor_.chrRomStart + addr, count};
+uint32_t Mapper_NROM::GetPrgBankId(uint16_t addr) {
+	return addr >= 0x8000 ? 0 : kPrgRamBank;
 }
 
 void Mapper_NROM::WriteChar(uint16_t addr, uint8_t val) {
-	tfm::printf("ERROR: Invalid CHR write address at 0x%04X!", addr);
-	assert(false);
+	if (chrRAM_) { // CHR ROM ignores writes
+		chrData_[addr] = val;
+	}
 }
 
 } // namespace nes::mapper
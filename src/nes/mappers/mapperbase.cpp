@@ -1,5 +1,9 @@
 #include "nes/mappers/mapperbase.h"
 
+#include "tfm/tinyformat.h"
+
+#include <assert.h>
+
 namespace nes::mapper {
 
 MapperBase::MapperBase(uint8_t* buffer, size_t bufSize, RomDescriptor desc)
@@ -7,4 +11,10 @@ MapperBase::MapperBase(uint8_t* buffer, size_t bufSize, RomDescriptor desc)
 , bufSize_(bufSize)
 , descriptor_(desc) {}
 
+uint8_t MapperBase::InvalidPrgRead(uint16_t addr) {
+	tfm::printf("ERROR: Invalid PRG read address at 0x%04X!", addr);
+	assert(false);
+	return 0;
+}
+
 } // namespace nes::mapper
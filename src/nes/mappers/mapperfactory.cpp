@@ -1,21 +1,53 @@
 #include "nes/mappers/mapperfactory.h"
 
 #include "tfm/tinyformat.h"
-#include "nes/mappers/mapper_nrom.h"
-#include "nes/mappers/mapper_mmc1.h"
 
 namespace nes::mapper {
 
-MapperBase* MapperFactory::CreateMapper(uint8_t* buffer,
-					size_t bufSize, RomDescriptor desc)
+namespace {
+
+// Bank numbers wrap modulo the bank count, so images must fill at least
+// the banks the board always maps
+template<typename Mapper>
+bool CreateSized(AnyMapper& mapper, uint8_t* buffer, size_t bufSize, RomDescriptor desc,
+		 const char* name, uint32_t minPrgRomSize) {
+	if (desc.prgRomSize < minPrgRomSize) {
+		tfm::printf("ERROR: %s needs at least %d bytes of PRG ROM, got %d\n",
+			    name, minPrgRomSize, desc.prgRomSize);
+		mapper.emplace<std::monostate>();
+		return false;
+	}
+	mapper.emplace<Mapper>(buffer, bufSize, desc);
+	return true;
+}
+
+// Windows are never smaller than the board's, so smaller images cannot be
+// mirrored into them
+template<typename Board>
+bool CreateDiscrete(AnyMapper& mapper, uint8_t* buffer, size_t bufSize, RomDescriptor desc) {
+	return CreateSized<Mapper_Discrete<Board>>(mapper, buffer, bufSize, desc,
+						   Board::kName, Board::kPrgWindowSize);
+}
+
+} // namespace
+
+bool MapperFactory::CreateMapper(AnyMapper& mapper, uint8_t* buffer,
+				 size_t bufSize, RomDescriptor desc)
 {
     switch (desc.mapperType) {
-		case 0: return new Mapper_NROM(buffer, bufSize, desc);
-		case 1: return new Mapper_MMC1(buffer, bufSize, desc);
+		case 0: mapper.emplace<Mapper_NROM>(buffer, bufSize, desc); return true;
+		case 1: return CreateSized<Mapper_MMC1>(mapper, buffer, bufSize, desc, "MMC1", 0x4000);
+		case 2: return CreateDiscrete<UxROM>(mapper, buffer, bufSize, desc);
+		case 3: return CreateDiscrete<CNROM>(mapper, buffer, bufSize, desc);
+		case 4: return CreateSized<Mapper_MMC3>(mapper, buffer, bufSize, desc, "MMC3", 2 * 0x2000);
+		case 7: return CreateDiscrete<AxROM>(mapper, buffer, bufSize, desc);
+		case 11: return CreateDiscrete<ColorDreams>(mapper, buffer, bufSize, desc);
+		case 66: return CreateDiscrete<GxROM>(mapper, buffer, bufSize, desc);
     }
 
     tfm::printf("ERROR: unsupported mapper id %d", desc.mapperType);
-    return nullptr;
+    mapper.emplace<std::monostate>();
+    return false;
 }
 
 } // namespace nes::mapper
@@ -0,0 +1,192 @@
+#include "nes/pcmwriter.h"
+
+#include "nes/utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace nes {
+
+namespace {
+
+constexpr size_t kWavHeaderSize = 44;
+
+void Put16(uint8_t* out, uint16_t val) {
+	out[0] = val & 0xFF;
+	out[1] = val >> 8;
+}
+
+void Put32(uint8_t* out, uint32_t val) {
+	Put16(out, val & 0xFFFF);
+	Put16(out + 2, val >> 16);
+}
+
+std::array<uint8_t, kWavHeaderSize> MakeWavHeader(uint32_t sampleRate, uint64_t sampleCount) {
+	const uint32_t dataSize = (uint32_t)std::min<uint64_t>(sampleCount * 2, UINT32_MAX - kWavHeaderSize);
+	std::array<uint8_t, kWavHeaderSize> header;
+	std::memcpy(header.data(), "RIFF", 4);
+	Put32(header.data() + 4, dataSize + kWavHeaderSize - 8);
+	std::memcpy(header.data() + 8, "WAVEfmt ", 8);
+	Put32(header.data() + 16, 16);             // fmt chunk size
+	Put16(header.data() + 20, 1);              // PCM
+	Put16(header.data() + 22, 1);              // mono
+	Put32(header.data() + 24, sampleRate);
+	Put32(header.data() + 28, sampleRate * 2); // byte rate
+	Put16(header.data() + 32, 2);              // block align
+	Put16(header.data() + 34, 16);             // bits per sample
+	std::memcpy(header.data() + 36, "data", 4);
+	Put32(header.data() + 40, dataSize);
+	return header;
+}
+
+} // namespace
+
+PcmWriter::~PcmWriter() {
+	Close();
+}
+
+bool PcmWriter::Open(const std::string& path, Format format, uint32_t sampleRate) {
+	Close();
+	if (!path.empty()) {
+		fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd_ < 0) {
+			return false;
+		}
+	}
+	open_ = true;
+	format_ = format;
+	sampleRate_ = sampleRate;
+	sampleCount_ = 0;
+	hash_ = kHashSeed;
+	failed_ = false;
+	pending_ = false;
+	stopping_ = false;
+	// The header is rewritten on Close(), this reserves its space
+	offset_ = format_ == Format::kWav ? kWavHeaderSize : 0;
+
+	front_.clear();
+	front_.reserve(kBlockSamples);
+	back_.clear();
+	back_.reserve(kBlockSamples);
+	if (fd_ >= 0) {
+		thread_ = std::thread(&PcmWriter::Run, this);
+	}
+	return true;
+}
+
+void PcmWriter::Write(std::span<const float> samples) {
+	if (!open_) {
+		return;
+	}
+	while (!samples.empty()) {
+		const size_t n = std::min(samples.size(), kBlockSamples - front_.size());
+		for (size_t i = 0; i < n; ++i) {
+			const float clipped = std::clamp(samples[i], -1.f, 1.f);
+			front_.push_back((int16_t)std::lrint(clipped * 32767.f));
+		}
+		hash_ = HashBytes(front_.data() + front_.size() - n, n * sizeof(int16_t), hash_);
+		sampleCount_ += n;
+		samples = samples.subspan(n);
+		if (front_.size() == kBlockSamples) {
+			Submit();
+		}
+	}
+}
+
+bool PcmWriter::Close() {
+	if (!open_) {
+		return true;
+	}
+	open_ = false;
+	if (fd_ < 0) {
+		front_.clear();
+		return true;
+	}
+	Submit();
+	{
+		std::lock_guard lock(mutex_);
+		stopping_ = true;
+	}
+	cv_.notify_all();
+	thread_.join();
+
+	bool ok = !failed_;
+	if (format_ == Format::kWav) {
+		const auto header = MakeWavHeader(sampleRate_, sampleCount_);
+		ok &= WriteAt(header.data(), header.size(), 0);
+	}
+	ok &= close(fd_) == 0;
+	fd_ = -1;
+	return ok;
+}
+
+bool PcmWriter::IsOpen() const {
+	return open_;
+}
+
+uint64_t PcmWriter::GetSampleCount() const {
+	return sampleCount_;
+}
+
+uint64_t PcmWriter::GetHash() const {
+	return hash_;
+}
+
+// Hands the front block to the writer thread, waiting only if the
+// previous block is still being written
+void PcmWriter::Submit() {
+	if (fd_ < 0) {
+		front_.clear(); // hash only
+		return;
+	}
+	if (front_.empty()) {
+		return;
+	}
+	std::unique_lock lock(mutex_);
+	cv_.wait(lock, [this] { return !pending_; });
+	std::swap(front_, back_);
+	pending_ = true;
+	lock.unlock();
+	cv_.notify_all();
+	front_.clear();
+}
+
+void PcmWriter::Run() {
+	std::unique_lock lock(mutex_);
+	while (true) {
+		cv_.wait(lock, [this] { return pending_ || stopping_; });
+		if (!pending_) {
+			return;
+		}
+		// back_ is not touched by the other side while pending
+		lock.unlock();
+		const size_t size = back_.size() * sizeof(int16_t);
+		const bool ok = WriteAt(back_.data(), size, offset_);
+		offset_ += size;
+		lock.lock();
+		failed_ |= !ok;
+		pending_ = false;
+		cv_.notify_all();
+	}
+}
+
+bool PcmWriter::WriteAt(const void* data, size_t size, uint64_t offset) {
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	while (size > 0) {
+		const ssize_t written = pwrite(fd_, bytes, size, offset);
+		if (written <= 0) {
+			return false;
+		}
+		bytes += written;
+		size -= written;
+		offset += written;
+	}
+	return true;
+}
+
+} // namespace nes
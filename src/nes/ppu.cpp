@@ -1,11 +1,18 @@
 #include "nes/ppu.h"
 
 #include "nes/bus.h"
+#include "nes/hosttrace.h"
 #include "nes/types.h"
 #include "nes/utils.h"
 
 #include <tfm/tinyformat.h>
 
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace nes {
 
 namespace {
@@ -21,6 +28,8 @@ constexpr uint16_t kPPUDATA = 0x2007;   // READ/WRITE
 
 constexpr std::array<uint16_t, 2> kPatternTableStart = {0x0000, 0x1000};
 constexpr std::array<uint16_t, 4> kNameTableStart = {0x2000, 0x2400, 0x2800, 0x2C00};
+
+constexpr uint32_t kPreRenderLine = 260; // where VBlank ends
 constexpr uint16_t kPaletteTableStart = 0x3F00;
 constexpr uint16_t kNameTableSize = 0x03FF;
 constexpr uint16_t kAttributeTableOffset = 0x3C0;
@@ -58,6 +67,60 @@ std::string AddressToString(uint16_t addr) {
     }
 }
 
+constexpr uint32_t kLuma84Size = 84;
+
+// Source pixel range of every output bin: [bins[i], bins[i + 1])
+template<uint32_t kSrcSize>
+constexpr std::array<uint16_t, kLuma84Size + 1> MakeBins() {
+	std::array<uint16_t, kLuma84Size + 1> bins{};
+	for (uint32_t i = 0; i <= kLuma84Size; ++i) {
+		bins[i] = i * kSrcSize / kLuma84Size;
+	}
+	return bins;
+}
+
+constexpr auto kLuma84Cols = MakeBins<kScreenColCount>();
+constexpr auto kLuma84Rows = MakeBins<kScreenRowCount>();
+constexpr std::array<uint8_t, kScreenRowCount> kLuma84RowBin = [] {
+	std::array<uint8_t, kScreenRowCount> bin{};
+	for (uint32_t i = 0; i < kLuma84Size; ++i) {
+		for (auto row = kLuma84Rows[i]; row < kLuma84Rows[i + 1]; ++row) {
+			bin[row] = i;
+		}
+	}
+	return bin;
+}();
+
+void ToLuma(uint8_t* line) {
+	for (int x = 0; x < kScreenColCount; ++x) {
+		line[x] = kLumaPalette[line[x]];
+	}
+}
+
+// Averages 2x2 blocks of two kScreenColCount wide lines
+void BoxFilter2x2(const uint8_t* top, const uint8_t* bottom, uint8_t* out) {
+#if defined(__SSE2__)
+	const __m128i lowMask = _mm_set1_epi16(0x00FF);
+	const __m128i rounding = _mm_set1_epi16(2);
+	for (int x = 0; x < kScreenColCount; x += 32) {
+		__m128i sums[2];
+		for (int half = 0; half < 2; ++half) {
+			auto t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x + half * 16));
+			auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + x + half * 16));
+			auto pairT = _mm_add_epi16(_mm_and_si128(t, lowMask), _mm_srli_epi16(t, 8));
+			auto pairB = _mm_add_epi16(_mm_and_si128(b, lowMask), _mm_srli_epi16(b, 8));
+			sums[half] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(pairT, pairB), rounding), 2);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x / 2),
+				 _mm_packus_epi16(sums[0], sums[1]));
+	}
+#else
+	for (int x = 0; x < kScreenColCount; x += 2) {
+		out[x / 2] = (top[x] + top[x + 1] + bottom[x] + bottom[x + 1] + 2) / 4;
+	}
+#endif
+}
+
 } // namespace
 
 Ppu2C02::Ppu2C02(Bus* bus)
@@ -67,6 +130,35 @@ Ppu2C02::Ppu2C02(Bus* bus)
 	memset(vramStorage_.data(), 0, 0x0800);
 }
 
+void Ppu2C02::Reset() {
+	activeFrameBufferId_ = 0;
+	lineBuffer_ = {};
+	prevLineBuffer_ = {};
+	lumaAccumulator_.fill(0);
+	// Layers are composed into the picture before the first frame draws them
+	for (auto& buffer : backgroundBuffers_) {
+		buffer.fill({});
+	}
+	spriteBuffer_.fill({});
+	spriteZeroReported_ = false;
+	oamAddress_ = 0;
+	oamStorage_ = {};
+	vramAddress_ = 0;
+	vramBuffer_ = 0;
+	vramStorage_ = {};
+	framePalette_ = {};
+	rawTileBuffer_ = {};
+	scrollSetIndex_ = 0;
+	scrollBuffer_ = {0, 0};
+	status_ = 0;
+	dotIdx_ = 0;
+	oddFrame_ = false;
+	scanlineEventDot_ = UINT32_MAX;
+	controlState_ = {};
+	maskState_ = {};
+	spriteZeroData_ = {};
+}
+
 uint8_t Ppu2C02::Read(uint16_t addr, bool silent) {
 	//tfm::printf("PPU read %s (0x%04X)\n", AddressToString(addr), addr);
 	switch (addr) {
@@ -138,10 +230,12 @@ void Ppu2C02::Write(uint16_t addr, uint8_t val) {
 	switch (addr) {
 		case kPPUCTRL: {
 			ParseControlMessage(val);
+			ScheduleScanlineEvent();
 			break;
 		}
 		case kPPUMASK: {
 			ParseMaskMessage(val);
+			ScheduleScanlineEvent();
 			break;
 		}
 		case kPPUSTATUS: {
@@ -170,28 +264,74 @@ void Ppu2C02::Write(uint16_t addr, uint8_t val) {
 			HandleDataWrite(val);
 			break;
 		}
-		case kOAMDMA: {
-			uint16_t baseAddr = val << 8;
-			auto data = bus_->ReadN(baseAddr, 256);
-			memcpy(oamStorage_.data(), data.data(), 256);
-			oamAddress_+=256;
-			bus_->TriggerDMA();
-			break;
-		}
 		default: {
 			assert(false);
 		}
 	}
 }
 
+void Ppu2C02::WriteOamDma(std::span<const uint8_t> data) {
+	assert(data.size() == oamStorage_.size());
+	// Written through OAMDATA, wrapping around from OAMADDR
+	const size_t head = oamStorage_.size() - oamAddress_;
+	std::copy(data.begin(), data.begin() + head, oamStorage_.begin() + oamAddress_);
+	std::copy(data.begin() + head, data.end(), oamStorage_.begin());
+}
+
 void Ppu2C02::SetFramebuffers(std::array<RGBA*, 2> buffers) {
 	frameBuffers_ = buffers;
 }
 
+void Ppu2C02::SetObservationOutput(ObservationFormat format, std::array<uint8_t*, 2> buffers) {
+	observationFormat_ = format;
+	observationBuffers_ = buffers;
+	lumaAccumulator_.fill(0);
+}
+
+size_t Ppu2C02::GetObservationSize(ObservationFormat format) {
+	switch (format) {
+		case ObservationFormat::kRGBA:
+			return kScreenColCount * kScreenRowCount * sizeof(RGBA);
+		case ObservationFormat::kLumaHalf:
+		case ObservationFormat::kPaletteIndexHalf:
+			return (kScreenColCount / 2) * (kScreenRowCount / 2);
+		case ObservationFormat::kLuma84:
+			return kLuma84Size * kLuma84Size;
+	}
+	return 0;
+}
+
 uint8_t Ppu2C02::GetActiveFramebufferId() const {
 	return (activeFrameBufferId_ + 1) % 2;
 }
 
+uint32_t Ppu2C02::GetDotsUntilVBlank() const {
+	constexpr uint32_t kVBlankDot = 240 * kScanlineColCount + 1;
+	constexpr uint32_t kFrameDots = kScanlineRowCount * kScanlineColCount;
+	if (dotIdx_ < kVBlankDot) {
+		return kVBlankDot - dotIdx_;
+	}
+	if (dotIdx_ - kVBlankDot < 3) {
+		return 0;
+	}
+	return kFrameDots - dotIdx_ + kVBlankDot - 1; // odd frames skip a dot
+}
+
+uint32_t Ppu2C02::GetDotsUntilScanlineEvent() const {
+	constexpr uint32_t kFrameDots = kScanlineRowCount * kScanlineColCount;
+	if (scanlineEventDot_ == UINT32_MAX) {
+		return UINT32_MAX;
+	}
+	if (scanlineEventDot_ > dotIdx_) {
+		return scanlineEventDot_ - dotIdx_;
+	}
+	return kFrameDots - dotIdx_ + scanlineEventDot_ - 1; // odd frames skip a dot
+}
+
+uint32_t Ppu2C02::GetDotIndex() const {
+	return dotIdx_;
+}
+
 const std::array<Ppu2C02::Palette, 8>& Ppu2C02::GetFramePalette() const {
 	return framePalette_;
 }
@@ -200,6 +340,17 @@ const std::array<RGBA, 8 * 8>& Ppu2C02::GetSpriteZero() const {
 	return spriteZeroData_;
 }
 
+Ppu2C02::RegisterState Ppu2C02::GetRegisterState() const {
+	return {dotIdx_, vramAddress_, vramBuffer_, status_, oamAddress_,
+		scrollBuffer_[0], scrollBuffer_[1], scrollSetIndex_, oddFrame_};
+}
+
+uint64_t Ppu2C02::HashMemory() const {
+	auto hash = HashBytes(vramStorage_.data(), vramStorage_.size());
+	hash = HashBytes(oamStorage_.data(), oamStorage_.size(), hash);
+	return HashBytes(framePalette_.data(), sizeof(framePalette_), hash);
+}
+
 void Ppu2C02::Tick() {
 	uint32_t newDot = (dotIdx_ + 1) % (kScanlineRowCount * kScanlineColCount);
 
@@ -216,6 +367,7 @@ void Ppu2C02::Tick() {
 	}
 
 	if (newDot == (240 * kScanlineColCount + 1)) { // Set VBLANK
+		NES_TRACE_FRAME();
 		status_ |= 0x80;
 		if (controlState_.generateNMI) {
 			bus_->TriggerNMI();
@@ -230,6 +382,11 @@ void Ppu2C02::Tick() {
 
 	dotIdx_ = newDot;
 
+	if (newDot == scanlineEventDot_) {
+		bus_->ClockScanlineCounter();
+		ScheduleScanlineEvent();
+	}
+
 	auto col = dotIdx_ % kScanlineColCount;
 	auto row = dotIdx_ / kScanlineColCount;
 	BufferDot bgDot;
@@ -239,17 +396,17 @@ void Ppu2C02::Tick() {
 		int sRow = row + scrollBuffer_[1];
 		if (sCol >= kScreenColCount) {
 			int srcIdx = sRow * kScreenColCount + (sCol % kScreenColCount);
-			bgDot = backgroundBuffers_[1 - controlState_.nameTableId][srcIdx];
+			bgDot = backgroundBuffers_[controlState_.nameTableId ^ 1][srcIdx];
 		} else {
 			int srcIdx = sRow * kScreenColCount + sCol;
 			bgDot = backgroundBuffers_[controlState_.nameTableId][srcIdx];
 		}
-		frameBuffers_[activeFrameBufferId_][dstIdx] = bgDot.color;
+		const BufferDot* outDot = &bgDot;
 
-	    auto spriteDot = spriteBuffer_[dstIdx];
+	    const auto& spriteDot = spriteBuffer_[dstIdx];
 	    if (spriteDot.color.a != 0 && spriteDot.isOpaque) {
 			if (!spriteDot.isBehind || !bgDot.isOpaque) {
-			    frameBuffers_[activeFrameBufferId_][dstIdx] = spriteDot.color;
+			    outDot = &spriteDot;
 			}
 
 			if (bgDot.isOpaque && spriteDot.isSprite0 &&
@@ -258,6 +415,15 @@ void Ppu2C02::Tick() {
 				spriteZeroReported_ = true;
 			}
 	    }
+
+		if (observationFormat_ == ObservationFormat::kRGBA) {
+			frameBuffers_[activeFrameBufferId_][dstIdx] = outDot->color;
+		} else {
+			lineBuffer_[col] = outDot->color.a ? outDot->colorIdx : kBlankColorIdx;
+			if (col == kScreenColCount - 1) {
+				EmitObservationLine(row);
+			}
+		}
 	}
 }
 
@@ -285,6 +451,33 @@ void Ppu2C02::ParseMaskMessage(uint8_t val) {
 	maskState_.emphasizeBlue = !!(val & 0x80);
 }
 
+// A12 rises once per rendered line when the background and the sprites
+// use different pattern tables: with the sprite fetches (dot 260) for
+// sprites at $1000, else with the next line's first tile fetches (dot
+// 324). Visible lines and the pre-render line count. 8x16 sprites are
+// assumed to come from $1000.
+void Ppu2C02::ScheduleScanlineEvent() {
+	scanlineEventDot_ = UINT32_MAX;
+	if (!maskState_.showBackground && !maskState_.showSprites) {
+		return;
+	}
+	const bool spritesHigh = controlState_.spriteSize == ControlState::SpriteSize::k8x16 ||
+				 controlState_.spriteTableAddr == kPatternTableStart[1];
+	const bool backgroundHigh = controlState_.backgroundTableIdx == 1;
+	if (spritesHigh == backgroundHigh) {
+		return;
+	}
+
+	const uint32_t dot = spritesHigh ? 260 : 324;
+	uint32_t line = dotIdx_ / kScanlineColCount + (dotIdx_ % kScanlineColCount >= dot ? 1 : 0);
+	if (line > kPreRenderLine) {
+		line = 0;
+	} else if (line >= kScreenRowCount) {
+		line = kPreRenderLine;
+	}
+	scanlineEventDot_ = line * kScanlineColCount + dot;
+}
+
 uint8_t Ppu2C02::HandleDataRead(bool silent) {
 	if (silent) {
 		return vramBuffer_;
@@ -295,12 +488,12 @@ uint8_t Ppu2C02::HandleDataRead(bool silent) {
 
 	// Pattern table 0
 	if (IsInRange(kPatternTableStart[0], kPatternTableStart[0] + 0x0FFF, addr)) {
-		result = bus_->ReadChr(addr - kPatternTableStart[0]);
+		result = bus_->ReadChr(addr);
 	}
 
 	// Pattern table 1
 	if (IsInRange(kPatternTableStart[1], kPatternTableStart[1] + 0x0FFF, addr)) {
-		result = bus_->ReadChr(addr - kPatternTableStart[1]);
+		result = bus_->ReadChr(addr);
 	}
 
 	// Mirror 0x2000-0x2EFF
@@ -369,12 +562,12 @@ void Ppu2C02::HandleDataWrite(uint8_t val) {
 	auto addr = vramAddress_;
 	// Pattern table 0
 	if (IsInRange(kPatternTableStart[0], kPatternTableStart[0] + 0x0FFF, addr)) {
-		//bus_->WriteChr(addr - kPatternTableStart[0], val);
+		bus_->WriteChr(addr, val);
 	}
 
 	// Pattern table 1
 	if (IsInRange(kPatternTableStart[1], kPatternTableStart[1] + 0x0FFF, addr)) {
-		//bus_->WriteChr(addr - kPatternTableStart[1], val);
+		bus_->WriteChr(addr, val);
 	}
 
 	// Mirror 0x2000-0x2EFF
@@ -432,6 +625,7 @@ void Ppu2C02::HandleDataWrite(uint8_t val) {
 }
 
 void Ppu2C02::DrawBackgroundLayers() {
+	NES_TRACE_ZONE("Ppu2C02::DrawBackgroundLayers");
 	if (!maskState_.showBackground && !maskState_.showBackgroundLeft) {
 		return;
 	}
@@ -460,7 +654,8 @@ void Ppu2C02::DrawBackgroundLayers() {
 					// Pal0 contains global bg color
 					auto colorIdx = framePalette_[pxColorIdx ? paletteIdx : 0][pxColorIdx];
 					bgBuffer[(row * 8 + i / 8) * 256 + col * 8 + i % 8] = {
-						kColorPalette[colorIdx], pxColorIdx != 0, false};
+						kColorPalette[colorIdx], pxColorIdx != 0, false, false,
+						static_cast<uint8_t>(colorIdx & 0x3F)};
 				}
 			}
 		}
@@ -468,6 +663,7 @@ void Ppu2C02::DrawBackgroundLayers() {
 }
 
 void Ppu2C02::DrawSpriteLayer() {
+	NES_TRACE_ZONE("Ppu2C02::DrawSpriteLayer");
 	if (!maskState_.showSprites && !maskState_.showSpritesLeft) {
 		return;
 	}
@@ -514,12 +710,63 @@ void Ppu2C02::DrawSpriteLayer() {
 				continue;
 			}
 
-			spriteBuffer_[idx] = {c, isOpaque, (entry.attr & 0x20) != 0, i == 0};
+			spriteBuffer_[idx] = {c, isOpaque, (entry.attr & 0x20) != 0, i == 0,
+					      static_cast<uint8_t>(colorIdx & 0x3F)};
 		}
 	}
 
 }
 
+void Ppu2C02::EmitObservationLine(uint32_t row) {
+	uint8_t* out = observationBuffers_[activeFrameBufferId_];
+
+	switch (observationFormat_) {
+		case ObservationFormat::kRGBA: {
+			break;
+		}
+		case ObservationFormat::kLumaHalf: {
+			ToLuma(lineBuffer_.data());
+			if (row % 2 == 0) {
+				std::swap(lineBuffer_, prevLineBuffer_);
+			} else {
+				BoxFilter2x2(prevLineBuffer_.data(), lineBuffer_.data(),
+					     out + (row / 2) * (kScreenColCount / 2));
+			}
+			break;
+		}
+		case ObservationFormat::kLuma84: {
+			ToLuma(lineBuffer_.data());
+			for (uint32_t j = 0; j < kLuma84Size; ++j) {
+				uint32_t sum = 0;
+				for (auto x = kLuma84Cols[j]; x < kLuma84Cols[j + 1]; ++x) {
+					sum += lineBuffer_[x];
+				}
+				lumaAccumulator_[j] += sum;
+			}
+
+			auto outRow = kLuma84RowBin[row];
+			if (row + 1 == kLuma84Rows[outRow + 1]) {
+				const uint32_t rows = kLuma84Rows[outRow + 1] - kLuma84Rows[outRow];
+				for (uint32_t j = 0; j < kLuma84Size; ++j) {
+					const uint32_t n = rows * (kLuma84Cols[j + 1] - kLuma84Cols[j]);
+					out[outRow * kLuma84Size + j] = (lumaAccumulator_[j] + n / 2) / n;
+				}
+				lumaAccumulator_.fill(0);
+			}
+			break;
+		}
+		case ObservationFormat::kPaletteIndexHalf: {
+			if (row % 2 == 0) {
+				auto* dst = out + (row / 2) * (kScreenColCount / 2);
+				for (int x = 0; x < kScreenColCount / 2; ++x) {
+					dst[x] = lineBuffer_[x * 2];
+				}
+			}
+			break;
+		}
+	}
+}
+
 uint8_t Ppu2C02::GetPaletteIdx(uint16_t attrTableBase, uint8_t row, uint8_t col) {
 	auto attrIdx = (row / 4) * 8 + (col / 4);
 	auto attr = vramStorage_[attrTableBase + attrIdx];
@@ -0,0 +1,126 @@
+#include "nes/profiler.h"
+
+#include "nes/instructions.h"
+#include "nes/mappers/mapperbase.h"
+
+#include <tfm/tinyformat.h>
+#include <algorithm>
+
+namespace nes {
+
+CpuProfiler::CpuProfiler() {
+	Reset();
+}
+
+void CpuProfiler::EnterRoutine(uint32_t bankId, uint16_t pc) {
+	const auto& current = stacks_[stack_];
+	if (current.depth >= kMaxDepth) {
+		return; // runaway recursion or a stack that is never unwound
+	}
+
+	const uint64_t key = (uint64_t)stack_ << 32 | (uint64_t)(uint16_t)(bankId + 1) << 16 | pc;
+	auto [it, inserted] = children_.try_emplace(key, (uint32_t)stacks_.size());
+	if (inserted) {
+		stacks_.push_back({stack_, bankId, pc, current.depth + 1, 0});
+	}
+	stack_ = it->second;
+}
+
+void CpuProfiler::LeaveRoutine() {
+	stack_ = stacks_[stack_].parent;
+}
+
+void CpuProfiler::Reset() {
+	pcCounters_.assign(1 << 16, {});
+	opCounts_ = {};
+	opCycles_ = {};
+	stacks_.assign(1, {});
+	children_.clear();
+	stack_ = 0;
+}
+
+std::vector<CpuProfiler::Hotspot> CpuProfiler::GetHotspots() const {
+	std::vector<Hotspot> res;
+	for (size_t idx = 0; idx < pcCounters_.size(); ++idx) {
+		const auto& counter = pcCounters_[idx];
+		if (counter.count == 0) {
+			continue;
+		}
+		res.push_back({(uint32_t)(idx >> 16) - 1, (uint16_t)idx, counter.count, counter.cycles});
+	}
+	std::sort(res.begin(), res.end(), [](const Hotspot& a, const Hotspot& b) {
+		return a.cycles > b.cycles;
+	});
+	return res;
+}
+
+uint64_t CpuProfiler::GetTotalCycles() const {
+	uint64_t total = 0;
+	for (auto cycles : opCycles_) {
+		total += cycles;
+	}
+	return total;
+}
+
+void CpuProfiler::WriteReport(std::ostream& out, size_t maxHotspots) const {
+	const double total = std::max<uint64_t>(GetTotalCycles(), 1);
+
+	std::array<uint8_t, 256> opCodes;
+	for (size_t i = 0; i < opCodes.size(); ++i) {
+		opCodes[i] = i;
+	}
+	std::sort(opCodes.begin(), opCodes.end(), [this](uint8_t a, uint8_t b) {
+		return opCycles_[a] > opCycles_[b];
+	});
+
+	out << tfm::format("%-6s %-10s %12s %12s %7s\n", "OP", "INSTR", "COUNT", "CYCLES", "%");
+	for (auto opCode : opCodes) {
+		if (opCounts_[opCode] == 0) {
+			break;
+		}
+		std::string name = "???";
+		if (auto it = kOpDecoder.find(opCode); it != kOpDecoder.end()) {
+			name = ToString(it->second.instr) + " " + ToString(it->second.addrMode);
+		}
+		out << tfm::format("0x%02X   %-10s %12d %12d %6.2f%%\n", opCode, name,
+				   opCounts_[opCode], opCycles_[opCode],
+				   100.0 * opCycles_[opCode] / total);
+	}
+
+	out << "\n" << tfm::format("%-6s %-6s %12s %12s %7s\n", "BANK", "PC", "COUNT", "CYCLES", "%");
+	const auto hotspots = GetHotspots();
+	for (size_t i = 0; i < hotspots.size() && i < maxHotspots; ++i) {
+		const auto& h = hotspots[i];
+		const auto bank = h.bankId == mapper::MapperBase::kPrgRamBank
+			? std::string("RAM") : tfm::format("%d", h.bankId);
+		out << tfm::format("%-6s 0x%04X %12d %12d %6.2f%%\n", bank, h.pc,
+				   h.count, h.cycles, 100.0 * h.cycles / total);
+	}
+}
+
+void CpuProfiler::WriteFoldedStacks(std::ostream& out) const {
+	for (size_t idx = 0; idx < stacks_.size(); ++idx) {
+		if (stacks_[idx].cycles == 0) {
+			continue;
+		}
+
+		std::vector<uint32_t> path;
+		for (uint32_t node = idx; node != 0; node = stacks_[node].parent) {
+			path.push_back(node);
+		}
+		std::string line = "reset";
+		for (auto it = path.rbegin(); it != path.rend(); ++it) {
+			line += ";" + FrameName(stacks_[*it]);
+		}
+		out << line << " " << stacks_[idx].cycles << "\n";
+	}
+}
+
+std::string CpuProfiler::FrameName(const StackNode& node) const {
+	if (node.bankId == mapper::MapperBase::kPrgRamBank) {
+		return tfm::format("RAM:%04X", node.pc);
+	}
+	return tfm::format("PRG%d:%04X", node.bankId, node.pc);
+}
+
+} // namespace nes
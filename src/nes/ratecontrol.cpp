@@ -0,0 +1,34 @@
+#include "nes/ratecontrol.h"
+
+#include <algorithm>
+
+namespace nes {
+
+namespace {
+
+constexpr double kSmoothing = 0.1;
+
+} // namespace
+
+RateControl::RateControl(size_t targetFill, double maxDeviation)
+: targetFill_(targetFill)
+, maxDeviation_(maxDeviation)
+, smoothedFill_(targetFill) {
+}
+
+double RateControl::Update(size_t fill) {
+	smoothedFill_ += kSmoothing * (fill - smoothedFill_);
+	const double error = (targetFill_ - smoothedFill_) / targetFill_;
+	ratio_ = 1.0 + maxDeviation_ * std::clamp(error, -1.0, 1.0);
+	return ratio_;
+}
+
+size_t RateControl::GetTargetFill() const {
+	return targetFill_;
+}
+
+double RateControl::GetRatio() const {
+	return ratio_;
+}
+
+} // namespace nes
@@ -0,0 +1,149 @@
+#include "nes/stepbuffer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace nes {
+
+namespace {
+
+constexpr double kHighPassHz = 90.0; // first stage of the console's output filter
+constexpr double kCutoff = 0.9;      // relative to the output Nyquist rate
+
+constexpr int kWidth = StepBuffer::kHalfWidth * 2;
+constexpr int kPhaseCount = 1 << StepBuffer::kPhaseBits;
+
+using Kernel = std::array<std::array<float, kWidth>, kPhaseCount>;
+
+// Blackman windowed sinc impulses, one per sub-sample offset. Each phase
+// sums to 1 so a step settles exactly at its amplitude.
+Kernel MakeKernel() {
+	Kernel kernel;
+	for (int phase = 0; phase < kPhaseCount; ++phase) {
+		const double offset = (double)phase / kPhaseCount;
+		std::array<double, kWidth> taps;
+		double sum = 0.0;
+		for (int i = 0; i < kWidth; ++i) {
+			const double x = i - (StepBuffer::kHalfWidth - 1) - offset;
+			const double arg = M_PI * kCutoff * x;
+			const double sinc = x == 0.0 ? 1.0 : std::sin(arg) / arg;
+			const double w = M_PI * x / StepBuffer::kHalfWidth;
+			taps[i] = sinc * (0.42 + 0.5 * std::cos(w) + 0.08 * std::cos(2.0 * w));
+			sum += taps[i];
+		}
+		for (int i = 0; i < kWidth; ++i) {
+			kernel[phase][i] = taps[i] / sum;
+		}
+	}
+	return kernel;
+}
+
+const Kernel& GetKernel() {
+	static const Kernel kernel = MakeKernel();
+	return kernel;
+}
+
+} // namespace
+
+StepBuffer::StepBuffer(double clockRate, uint32_t sampleRate, size_t capacity)
+: clockRate_(clockRate)
+, sampleRate_(sampleRate)
+, deltas_(capacity + kWidth)
+, capacity_(capacity) {
+	SetSampleRate(sampleRate);
+}
+
+void StepBuffer::SetSampleRate(uint32_t sampleRate) {
+	for (size_t i = 0; i < used_; ++i) {
+		level_ += deltas_[i];
+	}
+	std::fill(deltas_.begin(), deltas_.begin() + used_, 0.f);
+	used_ = 0;
+	available_ = 0;
+
+	sampleRate_ = sampleRate;
+	samplesPerClock_ = sampleRate / clockRate_;
+	highPassPole_ = std::exp(-2.0 * M_PI * kHighPassHz / sampleRate);
+	startTime_ = lastTime_;
+}
+
+uint32_t StepBuffer::GetSampleRate() const {
+	return sampleRate_;
+}
+
+void StepBuffer::SetClockRate(double clockRate) {
+	// Keep the position of the last completed time where it is
+	const double pos = (lastTime_ - startTime_) * samplesPerClock_;
+	clockRate_ = clockRate;
+	samplesPerClock_ = sampleRate_ / clockRate_;
+	startTime_ = lastTime_ - pos / samplesPerClock_;
+}
+
+void StepBuffer::AddDelta(uint64_t time, float delta) {
+	const double pos = std::max(0.0, (time - startTime_) * samplesPerClock_);
+	const size_t idx = (size_t)pos;
+	if (idx >= capacity_) {
+		level_ += delta;
+		return;
+	}
+	const auto& taps = GetKernel()[(int)((pos - idx) * kPhaseCount)];
+	float* out = deltas_.data() + idx;
+	for (int i = 0; i < kWidth; ++i) {
+		out[i] += delta * taps[i];
+	}
+	used_ = std::max(used_, idx + kWidth);
+}
+
+void StepBuffer::EndFrame(uint64_t time) {
+	lastTime_ = time;
+	const size_t end = (size_t)((time - startTime_) * samplesPerClock_);
+	if (end > capacity_) {
+		// Skip the timeline ahead, the samples in between are lost
+		dropped_ += end - capacity_;
+		startTime_ += (end - capacity_) / samplesPerClock_;
+		available_ = capacity_;
+		return;
+	}
+	available_ = std::max(available_, end);
+}
+
+size_t StepBuffer::GetSamplesAvailable() const {
+	return available_;
+}
+
+size_t StepBuffer::ReadSamples(std::span<float> out) {
+	const size_t n = std::min(out.size(), available_);
+	for (size_t i = 0; i < n; ++i) {
+		level_ += deltas_[i];
+		const float sample = level_ - prevIn_ + highPassPole_ * prevOut_;
+		prevIn_ = level_;
+		prevOut_ = sample;
+		out[i] = sample;
+	}
+
+	const size_t tail = std::max(used_, n);
+	std::copy(deltas_.begin() + n, deltas_.begin() + tail, deltas_.begin());
+	std::fill(deltas_.begin() + tail - n, deltas_.begin() + tail, 0.f);
+	used_ = tail - n;
+	available_ -= n;
+	startTime_ += n / samplesPerClock_;
+	return n;
+}
+
+uint64_t StepBuffer::GetDroppedSamples() const {
+	return dropped_;
+}
+
+void StepBuffer::Clear(uint64_t time) {
+	std::fill(deltas_.begin(), deltas_.end(), 0.f);
+	used_ = 0;
+	available_ = 0;
+	lastTime_ = time;
+	startTime_ = time;
+	level_ = 0.f;
+	prevIn_ = 0.f;
+	prevOut_ = 0.f;
+}
+
+} // namespace nes
@@ -2,8 +2,12 @@
 
 namespace nes {
 
-bool IsInRange(uint16_t beg, uint16_t end, uint16_t val) {
-	return (beg <= val) && (val <= end);
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed) {
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		seed = (seed ^ bytes[i]) * 0x100000001B3ull;
+	}
+	return seed;
 }
 
 } // namespace nes
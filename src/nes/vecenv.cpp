@@ -0,0 +1,263 @@
+#include "nes/vecenv.h"
+
+#include <tfm/tinyformat.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace nes {
+
+namespace {
+
+void MaxPool(uint8_t* dst, const uint8_t* src, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		dst[i] = std::max(dst[i], src[i]);
+	}
+}
+
+} // namespace
+
+VecEnv::VecEnv(Config config)
+: config_(std::move(config))
+{}
+
+VecEnv::~VecEnv() {
+	{
+		std::lock_guard lock(mutex_);
+		stopping_ = true;
+	}
+	startCv_.notify_all();
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+bool VecEnv::Load() {
+	std::ifstream input{config_.romPath, std::ios::binary};
+	if (!input.is_open()) {
+		tfm::printf("ERROR: failed to open rom file: %s\n", config_.romPath);
+		return false;
+	}
+	const std::vector<uint8_t> rom{std::istreambuf_iterator<char>(input), {}};
+
+	if (config_.envCount == 0 || config_.frameSkip == 0) {
+		tfm::printf("ERROR: invalid env config (envs: %d, frame skip: %d)\n",
+			    config_.envCount, config_.frameSkip);
+		return false;
+	}
+
+	observationSize_ = Ppu2C02::GetObservationSize(config_.observation);
+	if (config_.observation == Ppu2C02::ObservationFormat::kPaletteIndexHalf) {
+		config_.maxPool = false;
+	}
+	// Machines live as long as the VecEnv, episodes reset them in place
+	envs_.resize(config_.envCount);
+	for (auto& env : envs_) {
+		env.machine = std::make_unique<Machine>();
+		if (!env.machine->LoadRom(rom)) {
+			envs_.clear();
+			return false;
+		}
+	}
+
+	size_t threadCount = config_.threadCount;
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threadCount = std::min(threadCount, config_.envCount);
+	// The calling thread works too
+	for (size_t i = 1; i < threadCount; ++i) {
+		workers_.emplace_back(&VecEnv::WorkerLoop, this);
+	}
+
+	return true;
+}
+
+size_t VecEnv::GetEnvCount() const {
+	return envs_.size();
+}
+
+size_t VecEnv::GetObservationSize() const {
+	return observationSize_;
+}
+
+void VecEnv::Reset(std::span<const uint64_t> seeds, uint8_t* frames) {
+	assert(seeds.size() == envs_.size());
+	ParallelFor([&](size_t idx) {
+		envs_[idx].rng.seed(seeds[idx]);
+		ResetEnv(envs_[idx], frames + idx * observationSize_);
+	});
+}
+
+void VecEnv::Step(std::span<const uint8_t> actions, uint8_t* frames,
+		  float* rewards, uint8_t* dones) {
+	assert(actions.size() == envs_.size());
+	ParallelFor([&](size_t idx) {
+		StepEnv(envs_[idx], actions[idx], frames + idx * observationSize_,
+			rewards[idx], dones[idx]);
+	});
+}
+
+void VecEnv::ResetEnv(Env& env, uint8_t* frame) {
+	env.machine->Reset();
+	env.episodeFrames = 0;
+	// The first frame after power-up does not reach pixel (0, 0), keep the
+	// slot's previous observation out of it
+	memset(frame, 0, observationSize_);
+
+	uint32_t noops = 0;
+	if (config_.maxNoopFrames) {
+		noops = std::uniform_int_distribution<uint32_t>(0, config_.maxNoopFrames)(env.rng);
+	}
+	RunFrames(env, noops + 1, frame, false);
+	env.episodeFrames = 0;
+	env.done = false;
+
+	auto& bus = env.machine->GetBus();
+	env.watched.resize(config_.rewards.size());
+	for (size_t i = 0; i < config_.rewards.size(); ++i) {
+		env.watched[i] = bus.Read(config_.rewards[i].addr, true);
+	}
+}
+
+void VecEnv::StepEnv(Env& env, uint8_t action, uint8_t* frame, float& reward, uint8_t& done) {
+	reward = 0.f;
+	if (env.done) {
+		ResetEnv(env, frame);
+		done = 0;
+		return;
+	}
+
+	auto& con = env.machine->GetController(true);
+	for (int bit = 0; bit < 8; ++bit) {
+		auto b = static_cast<Controller::Button>(1 << bit);
+		if (action & b) {
+			con.PressButton(b);
+		} else {
+			con.ReleaseButton(b);
+		}
+	}
+
+	env.done = RunFrames(env, config_.frameSkip, frame, config_.maxPool);
+
+	auto& bus = env.machine->GetBus();
+	for (size_t i = 0; i < config_.rewards.size(); ++i) {
+		auto val = bus.Read(config_.rewards[i].addr, true);
+		reward += config_.rewards[i].scale * (static_cast<int>(val) - env.watched[i]);
+		env.watched[i] = val;
+	}
+	done = env.done ? 1 : 0;
+}
+
+bool VecEnv::RunFrames(Env& env, uint32_t count, uint8_t* frame, bool maxPool) {
+	auto& ppu = env.machine->GetPpu();
+	auto own = env.machine->GetOwnFramebuffers();
+	std::array<uint8_t*, 2> scratch{
+		reinterpret_cast<uint8_t*>(own[0]), reinterpret_cast<uint8_t*>(own[1])};
+
+	// Route the last frame of the batch straight into the output slot,
+	// the one before it lands in the machine's scratch buffer.
+	const uint8_t first = (ppu.GetActiveFramebufferId() + 1) % 2;
+	const uint8_t last = (first + count - 1) % 2;
+	auto buffers = scratch;
+	buffers[last] = frame;
+	SetOutput(env, buffers);
+
+	uint32_t ran = 0;
+	bool done = false;
+	while (ran < count && !done) {
+		env.machine->RunFrame();
+		++ran;
+		++env.episodeFrames;
+		done = IsDone(env);
+	}
+
+	// On early termination the final frame may sit in the scratch buffer
+	const uint8_t finalIdx = (first + ran - 1) % 2;
+	const uint8_t* other = scratch[(last + 1) % 2];
+	if (maxPool && ran > 1) {
+		MaxPool(frame, other, observationSize_);
+	} else if (finalIdx != last) {
+		memcpy(frame, other, observationSize_);
+	}
+
+	SetOutput(env, scratch);
+	return done;
+}
+
+void VecEnv::SetOutput(Env& env, std::array<uint8_t*, 2> buffers) {
+	auto& ppu = env.machine->GetPpu();
+	if (config_.observation == Ppu2C02::ObservationFormat::kRGBA) {
+		ppu.SetFramebuffers({reinterpret_cast<RGBA*>(buffers[0]),
+				     reinterpret_cast<RGBA*>(buffers[1])});
+	} else {
+		ppu.SetObservationOutput(config_.observation, buffers);
+	}
+}
+
+bool VecEnv::IsDone(Env& env) {
+	if (config_.maxEpisodeFrames && env.episodeFrames >= config_.maxEpisodeFrames) {
+		return true;
+	}
+	if (config_.done) {
+		auto val = env.machine->GetBus().Read(config_.done->addr, true);
+		return (val & config_.done->mask) == config_.done->value;
+	}
+	return false;
+}
+
+void VecEnv::ParallelFor(const std::function<void(size_t)>& job) {
+	if (workers_.empty()) {
+		for (size_t i = 0; i < envs_.size(); ++i) {
+			job(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+		job_ = &job;
+		nextJob_ = 0;
+		busyWorkers_ = workers_.size();
+		++generation_;
+	}
+	startCv_.notify_all();
+
+	RunJobs();
+
+	std::unique_lock lock(mutex_);
+	doneCv_.wait(lock, [this] { return busyWorkers_ == 0; });
+	job_ = nullptr;
+}
+
+void VecEnv::RunJobs() {
+	for (size_t idx = nextJob_++; idx < envs_.size(); idx = nextJob_++) {
+		(*job_)(idx);
+	}
+}
+
+void VecEnv::WorkerLoop() {
+	uint64_t seenGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock lock(mutex_);
+			startCv_.wait(lock, [&] { return stopping_ || generation_ != seenGeneration; });
+			if (stopping_) {
+				return;
+			}
+			seenGeneration = generation_;
+		}
+
+		RunJobs();
+
+		std::lock_guard lock(mutex_);
+		if (--busyWorkers_ == 0) {
+			doneCv_.notify_one();
+		}
+	}
+}
+
+} // namespace nes
@@ -1,13 +1,12 @@
 #include "nesapp.h"
+#include "nes/hosttrace.h"
 #include "tfm/tinyformat.h"
 
 namespace {
 
-constexpr uint64_t kClockFrequency = 21'477'272; // Hz
-constexpr uint64_t kPPUFrequency = kClockFrequency / 4; // Hz
-constexpr uint64_t kCPUFrequency = kClockFrequency / 12; // Hz
-constexpr double kPPUTickDuration = 1.0 / kPPUFrequency; // s
-constexpr double kCPUTickDuration = 1.0 / kCPUFrequency; // s
+constexpr uint32_t kSampleRate = 48000; // Hz
+constexpr size_t kQueueTarget = kSampleRate / 20; // 50 ms of latency
+constexpr int kMaxFramesPerUpdate = 16;
 
 const olc::vi2d kChrBankDisplayPos{80, 80};
 
@@ -31,7 +30,10 @@ NesApp::NesApp()
 : bus_()
 , cpu_(&bus_)
 , ppu_(&bus_)
-, tickDuration_(kCPUTickDuration) {
+, apu_(&bus_, kSampleRate)
+, audio_(kSampleRate, kQueueTarget * 2)
+, rateControl_(kQueueTarget)
+, samples_(kQueueTarget * 2) {
 	sAppName = "NesEmu";
 	frameBufferSprites_[0] = olc::Sprite{256, 240};
 	frameBufferSprites_[1] = olc::Sprite{256, 240};
@@ -39,6 +41,7 @@ NesApp::NesApp()
 
 bool NesApp::OnUserCreate() {
 	cpu_.Reset();
+	apu_.Reset();
 
 	std::array<RGBA*, 2> frameBuffers{
 		reinterpret_cast<RGBA*>(frameBufferSprites_[0].GetData()),
@@ -47,6 +50,7 @@ bool NesApp::OnUserCreate() {
 	ppu_.SetFramebuffers(frameBuffers);
 
 	bus_.AttachController(&con1_, true);
+	audio_.Start();
 	return true;
 }
 
@@ -58,10 +62,10 @@ bool NesApp::ProcessKeyInputs() {
 		paused_ = !paused_;
 	}
 	if (GetKey(olc::Key::PGDN).bReleased) {
-		tickDuration_ *= 2;
+		speed_ /= 2;
 	}
 	if (GetKey(olc::Key::PGUP).bReleased) {
-		tickDuration_ /= 2;
+		speed_ *= 2;
 	}
 
 	if (GetKey(olc::Key::C).bReleased) {
@@ -120,20 +124,13 @@ bool NesApp::ProcessKeyInputs() {
 	return true;
 }
 
-bool NesApp::OnUserUpdate(float fElapsedTime) {
+bool NesApp::OnUserUpdate(float /*fElapsedTime*/) {
 	if (!ProcessKeyInputs()) {
 		return false;
 	}
 
-	timeToRun_ += paused_ ? 0.f : fElapsedTime;
-
-	while (timeToRun_ > tickDuration_) {
-		ppu_.Tick();
-		ppu_.Tick();
-		ppu_.Tick(); // For some reason causes rendering to misbehave
-		cpu_.Tick();
-
-		timeToRun_ -= tickDuration_;
+	if (!paused_) {
+		RunEmulation();
 	}
 
 	Clear(olc::Pixel(30, 30, 47));
@@ -148,14 +145,37 @@ bool NesApp::OnUserUpdate(float fElapsedTime) {
 	return true;
 }
 
+// Paced by the audio device: frames are run while the sample queue is
+// below its target. Speed changes stretch the audio instead of the pacing.
+void NesApp::RunEmulation() {
+	NES_TRACE_ZONE("NesApp::RunEmulation");
+	auto& queue = audio_.GetQueue();
+	for (int i = 0; i < kMaxFramesPerUpdate && queue.GetSize() < rateControl_.GetTargetFill(); ++i) {
+		RunFrame();
+		apu_.SetResampleRatio(rateControl_.Update(queue.GetSize()) / speed_);
+		const auto count = apu_.ReadSamples(samples_);
+		queue.Push({samples_.data(), count});
+	}
+}
+
+void NesApp::RunFrame() {
+	const auto frameId = ppu_.GetActiveFramebufferId();
+	while (ppu_.GetActiveFramebufferId() == frameId) {
+		ppu_.Tick();
+		ppu_.Tick();
+		ppu_.Tick(); // For some reason causes rendering to misbehave
+		cpu_.Tick();
+	}
+}
+
 void NesApp::InsertCartridge(Cartridge* cart) {
 	bus_.InsertCartridge(cart);
 }
 
 void NesApp::RenderChrBanks() {
+	NES_TRACE_ZONE("NesApp::RenderChrBanks");
 	olc::Sprite tileSprite{8, 8};
 	auto& palette = ppu_.GetFramePalette()[4];
-	std::span<uint8_t> bank = bus_.ReadChrN(0, 0x2000);
 
 	FillRect(75, 75, 512 + 32 + 10, 256 + 16 + 10,
 		 olc::Pixel{255, 200, 200});
@@ -163,7 +183,8 @@ void NesApp::RenderChrBanks() {
 	for (int row = 0; row < 16; ++row) {
 		for (int col = 0; col < 32; ++col) {
 			int idx = row * 32 + col;
-			DecodeTileData(bank.subspan(idx * 16, 16), palette,
+			// Tile by tile, banked CHR is only contiguous within a window
+			DecodeTileData(bus_.ReadChrN(idx * 16, 16), palette,
 					   tileSprite);
 			DrawSprite(80 + col * 16 + (col > 0 ? col : 0),
 				   80 + row * 16 + (row > 0 ? row : 0),
@@ -173,6 +194,7 @@ void NesApp::RenderChrBanks() {
 }
 
 void NesApp::RenderSidePanel() {
+	NES_TRACE_ZONE("NesApp::RenderSidePanel");
 	const olc::Pixel fontColor{255, 175, 127};
 	const auto state = cpu_.GetState();
 	const int32_t leftMargin = 10;
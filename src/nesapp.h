@@ -1,10 +1,15 @@
 #pragma once
 
 #include "olc/olcPixelGameEngine.h"
+#include "audiooutput.h"
+#include "nes/apu.h"
 #include "nes/cpu6502.h"
 #include "nes/ppu.h"
 #include "nes/cartridge.h"
 #include "nes/controller.h"
+#include "nes/ratecontrol.h"
+
+#include <vector>
 
 using namespace nes;
 
@@ -17,6 +22,8 @@ public:
 	void InsertCartridge(Cartridge* cart);
 
 private:
+	void RunEmulation();
+	void RunFrame();
 	void RenderSidePanel();
 	void RenderChrBanks();
 	bool ProcessKeyInputs();
@@ -24,10 +31,15 @@ private:
 	Bus bus_;
 	Cpu6502 cpu_;
 	Ppu2C02 ppu_;
+	Apu2A03 apu_;
 	Controller con1_;
 	bool paused_ = false;
-	double tickDuration_ = 0.0;
-	float timeToRun_ = 0.f;
+	double speed_ = 1.0;
+
+	// Emulation runs ahead only as far as the audio queue asks for
+	AudioOutput audio_;
+	RateControl rateControl_;
+	std::vector<float> samples_;
 	bool displayChrBanks_ = false;
 
 	std::array<olc::Sprite, 2> frameBufferSprites_;
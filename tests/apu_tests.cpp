@@ -0,0 +1,357 @@
+#include <catch2/catch.hpp>
+
+#include "nes/machine.h"
+#include "nes/pcmwriter.h"
+#include "nes/ratecontrol.h"
+#include "nes/spscring.h"
+#include "nes/stepbuffer.h"
+
+#include "romimage.h"
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace nes;
+using testing::RomImage;
+
+namespace {
+
+// The APU follows the CPU cycle counter, so the rig moves the clock
+// instead of executing code. DMC samples read from a PRG filled with $55.
+class ApuRig {
+public:
+	ApuRig()
+	: machine_(std::make_unique<Machine>()) {
+		RomImage rom;
+		rom.Org(0xC000).Emit(std::initializer_list<uint8_t>{0x55});
+		REQUIRE(machine_->LoadRom(rom.Build()));
+	}
+
+	void Write(uint16_t addr, uint8_t val) {
+		machine_->GetBus().Write(addr, val);
+	}
+
+	uint8_t ReadStatus() {
+		return machine_->GetBus().Read(0x4015);
+	}
+
+	void Run(uint64_t cycles) {
+		auto& cpu = machine_->GetCpu();
+		auto state = cpu.GetState();
+		state.cycle += cycles;
+		cpu.SetState(state);
+	}
+
+	Apu2A03& GetApu() {
+		return machine_->GetApu();
+	}
+
+	Bus& GetBus() {
+		return machine_->GetBus();
+	}
+
+	uint64_t GetCycle() {
+		return machine_->GetCpu().GetCycle();
+	}
+
+private:
+	std::unique_ptr<Machine> machine_;
+};
+
+constexpr uint32_t kFrameCycles = 29830;
+
+// Starts a tone on pulse 1, triangle and noise, then idles
+std::vector<uint8_t> ToneProgram() {
+	RomImage rom;
+	const std::pair<uint16_t, uint8_t> writes[] = {
+		{0x4015, 0x0F},
+		{0x4000, 0xBF}, {0x4002, 0xFD}, {0x4003, 0x08},
+		{0x4008, 0xFF}, {0x400A, 0x80}, {0x400B, 0x08},
+		{0x400C, 0x3F}, {0x400E, 0x05}, {0x400F, 0x08},
+	};
+	for (const auto& [addr, val] : writes) {
+		rom.Emit({0xA9, val}); // LDA #
+		rom.Abs(0x8D, addr);   // STA
+	}
+	rom.Abs(0x4C, rom.Here()); // JMP *
+	return rom.Build();
+}
+
+// Hann windowed DFT magnitude at one frequency
+double Magnitude(std::span<const float> samples, double freq, double rate) {
+	double re = 0.0;
+	double im = 0.0;
+	for (size_t i = 0; i < samples.size(); ++i) {
+		const double window = 0.5 - 0.5 * std::cos(2.0 * M_PI * i / samples.size());
+		re += samples[i] * window * std::cos(2.0 * M_PI * freq * i / rate);
+		im += samples[i] * window * std::sin(2.0 * M_PI * freq * i / rate);
+	}
+	return std::hypot(re, im);
+}
+
+} // namespace
+
+TEST_CASE("Length counters show up in $4015", "[apu]") {
+	ApuRig rig;
+	rig.Write(0x4017, 0x40); // no frame interrupt
+	rig.Write(0x4015, 0x0F);
+	rig.Write(0x4000, 0x10); // pulse 1, constant volume 0
+	rig.Write(0x4003, 0x18); // length index 3: 2 half frames
+	rig.Write(0x400B, 0x08); // triangle, length 254
+	CHECK(rig.ReadStatus() == 0x05);
+
+	rig.Run(kFrameCycles / 2 + 1);
+	CHECK(rig.ReadStatus() == 0x05);
+	rig.Run(kFrameCycles / 2);
+	CHECK(rig.ReadStatus() == 0x04);
+
+	// Disabling a channel clears its counter, writes while disabled are lost
+	rig.Write(0x4015, 0x00);
+	CHECK(rig.ReadStatus() == 0x00);
+	rig.Write(0x4003, 0x08);
+	CHECK(rig.ReadStatus() == 0x00);
+}
+
+TEST_CASE("Frame counter raises its interrupt in 4-step mode only", "[apu]") {
+	ApuRig rig;
+	rig.Write(0x4017, 0x00);
+	rig.Run(kFrameCycles - 10);
+	CHECK(rig.ReadStatus() == 0x00);
+	rig.Run(10);
+	CHECK(rig.GetApu().IsFrameIrqPending());
+	CHECK(rig.ReadStatus() == 0x40);
+	CHECK(rig.ReadStatus() == 0x00);
+
+	rig.Write(0x4017, 0x40); // inhibit
+	rig.Run(kFrameCycles * 2);
+	CHECK(rig.ReadStatus() == 0x00);
+
+	rig.Write(0x4017, 0x80); // 5-step
+	rig.Run(kFrameCycles * 2);
+	CHECK_FALSE(rig.GetApu().IsFrameIrqPending());
+}
+
+TEST_CASE("DMC plays its sample and raises its interrupt", "[apu]") {
+	ApuRig rig;
+	rig.Write(0x4010, 0x8F); // IRQ, fastest rate
+	rig.Write(0x4012, 0x00); // $C000
+	rig.Write(0x4013, 0x01); // 17 bytes
+	rig.Write(0x4015, 0x10);
+	CHECK(rig.ReadStatus() == 0x10);
+
+	rig.Run(54 * 8 * 17);
+	CHECK(rig.ReadStatus() == 0x80);
+	rig.Write(0x4015, 0x00);
+	CHECK(rig.ReadStatus() == 0x00);
+}
+
+TEST_CASE("DMC fetches are scheduled as bus DMA", "[apu]") {
+	ApuRig rig;
+	auto& bus = rig.GetBus();
+	rig.Write(0x4010, 0x0F); // fastest rate, 54 cycles per bit
+	rig.Write(0x4013, 0x01); // 17 bytes
+	rig.Write(0x4015, 0x10);
+
+	// Enabling fetches the first byte right away
+	CHECK(bus.RunDma(rig.GetCycle()) == 4);
+	CHECK(bus.RunDma(rig.GetCycle()) == 0);
+
+	// The next ones follow a byte of output apart
+	const uint64_t next = bus.GetNextDmaCycle();
+	REQUIRE(next > rig.GetCycle());
+	CHECK(bus.RunDma(next - 1) == 0);
+	CHECK(bus.RunDma(next) == 4);
+	CHECK(bus.GetNextDmaCycle() == next + 54 * 8);
+
+	rig.Write(0x4015, 0x00);
+	CHECK(bus.GetNextDmaCycle() == UINT64_MAX);
+}
+
+TEST_CASE("Pulse channel produces a tone at its period", "[apu]") {
+	ApuRig rig;
+	auto& apu = rig.GetApu();
+	apu.SetSampleRate(48000);
+	rig.Write(0x4015, 0x01);
+	rig.Write(0x4000, 0xBF); // 50% duty, constant volume 15
+	rig.Write(0x4002, 0xFD); // period 253: 1789773 / (16 * 254) ~ 440 Hz
+	rig.Write(0x4003, 0x08);
+
+	std::vector<float> samples(48000);
+	rig.Run(1789773 / 4);
+	const size_t count = apu.ReadSamples(samples);
+	CHECK(count > 11990);
+	CHECK(count <= 12000);
+
+	// Rising edges after the high pass settled, 440 Hz over 0.2 s
+	int edges = 0;
+	float peak = 0.f;
+	for (size_t i = 2400; i + 1 < count; ++i) {
+		edges += samples[i] <= 0.f && samples[i + 1] > 0.f;
+		peak = std::max(peak, samples[i]);
+	}
+	CHECK(edges >= 86);
+	CHECK(edges <= 90);
+	CHECK(peak > 0.05f);
+
+	// Disabled, the output decays to silence
+	rig.Write(0x4015, 0x00);
+	rig.Run(1789773 / 4);
+	const size_t tail = apu.ReadSamples(samples);
+	REQUIRE(tail > 0);
+	CHECK(std::abs(samples[tail - 1]) < 0.001f);
+}
+
+TEST_CASE("Step buffer keeps square wave harmonics from aliasing", "[apu]") {
+	constexpr double kClockRate = Apu2A03::kCpuClockRate;
+	constexpr uint32_t kRate = 48000;
+	constexpr uint64_t kHalfPeriod = 169; // ~5.3 kHz
+	StepBuffer buffer(kClockRate, kRate, 1 << 16);
+	float level = 0.f;
+	for (uint64_t i = 0; i < 600; ++i) {
+		const float next = i % 2 ? 0.f : 1.f;
+		buffer.AddDelta(i * kHalfPeriod, next - level);
+		level = next;
+	}
+	buffer.EndFrame(600 * kHalfPeriod);
+	std::vector<float> samples(buffer.GetSamplesAvailable());
+	REQUIRE(buffer.ReadSamples(samples) == samples.size());
+	const std::span<const float> settled = std::span<const float>(samples).subspan(200);
+
+	const double fundamental = kClockRate / (2 * kHalfPeriod);
+	const double reference = Magnitude(settled, fundamental, kRate);
+	for (int harmonic : {7, 9, 11, 13, 15}) {
+		double alias = std::fmod(fundamental * harmonic, kRate);
+		alias = alias > kRate / 2 ? kRate - alias : alias;
+		CAPTURE(harmonic, alias);
+		CHECK(20.0 * std::log10(Magnitude(settled, alias, kRate) / reference) < -60.0);
+	}
+}
+
+TEST_CASE("SPSC ring hands samples across threads in order", "[apu][audio]") {
+	SpscRing<float> ring(60);
+	REQUIRE(ring.GetCapacity() == 64);
+
+	constexpr int kCount = 100000;
+	std::thread producer([&ring] {
+		std::array<float, 24> block;
+		for (int next = 0; next < kCount;) {
+			const int n = std::min<int>(block.size(), kCount - next);
+			for (int i = 0; i < n; ++i) {
+				block[i] = (float)(next + i);
+			}
+			const size_t pushed = ring.Push(std::span<const float>(block.data(), n));
+			if (pushed == 0) {
+				std::this_thread::yield();
+			}
+			next += pushed;
+		}
+	});
+
+	std::array<float, 40> block;
+	int expected = 0;
+	bool ordered = true;
+	while (expected < kCount) {
+		const size_t n = ring.Pop(block);
+		if (n == 0) {
+			std::this_thread::yield();
+		}
+		for (size_t i = 0; i < n; ++i) {
+			ordered &= block[i] == (float)expected++;
+		}
+	}
+	producer.join();
+	CHECK(ordered);
+	CHECK(ring.GetSize() == 0);
+}
+
+TEST_CASE("Rate control holds the queue against a clock mismatch", "[apu][audio]") {
+	// The emulation produces 0.3% too few samples per frame
+	constexpr size_t kTarget = 2400;
+	constexpr double kConsumed = 800.0;
+	constexpr double kProduced = kConsumed * 0.997;
+	RateControl control(kTarget);
+	double fill = kTarget;
+	double minFill = fill;
+	for (int frame = 0; frame < 3000; ++frame) {
+		const double ratio = control.Update((size_t)fill);
+		CHECK(std::abs(ratio - 1.0) <= 0.005);
+		fill += kProduced * ratio - kConsumed;
+		minFill = std::min(minFill, fill);
+	}
+	CHECK(minFill > kTarget / 4);
+	CHECK(control.GetRatio() == Approx(kConsumed / kProduced).epsilon(0.0005));
+}
+
+TEST_CASE("Stems match the main output restricted to one channel", "[apu]") {
+	std::vector<float> stem(2048);
+	std::vector<float> main(2048);
+	for (auto channel : {Apu2A03::kPulse1, Apu2A03::kTriangle, Apu2A03::kNoise}) {
+		CAPTURE(channel);
+		auto withStems = std::make_unique<Machine>();
+		auto masked = std::make_unique<Machine>();
+		REQUIRE(withStems->LoadRom(ToneProgram()));
+		REQUIRE(masked->LoadRom(ToneProgram()));
+		withStems->GetApu().SetStemsEnabled(true);
+		masked->GetApu().SetChannelMask(1 << channel);
+
+		bool same = true;
+		float peak = 0.f;
+		for (int frame = 0; frame < 10; ++frame) {
+			withStems->RunFrame();
+			masked->RunFrame();
+			const auto n = withStems->GetApu().ReadStemSamples(channel, stem);
+			REQUIRE(masked->GetApu().ReadSamples(main) == n);
+			same &= std::equal(stem.begin(), stem.begin() + n, main.begin());
+			peak = std::max(peak, *std::max_element(stem.begin(), stem.begin() + n));
+		}
+		CHECK(same);
+		CHECK(peak > 0.01f);
+	}
+}
+
+TEST_CASE("PCM writer streams a WAV file across blocks", "[apu][audio]") {
+	const auto path = std::filesystem::temp_directory_path() / "nes-tests-pcmwriter.wav";
+	constexpr size_t kCount = PcmWriter::kBlockSamples * 2 + 100;
+	std::vector<float> samples(kCount);
+	for (size_t i = 0; i < kCount; ++i) {
+		samples[i] = std::sin(i * 0.01f) * 1.5f; // clips at the peaks
+	}
+
+	PcmWriter writer;
+	PcmWriter hashOnly;
+	REQUIRE(writer.Open(path.string(), PcmWriter::Format::kWav, 44100));
+	REQUIRE(hashOnly.Open("", PcmWriter::Format::kWav, 44100));
+	for (size_t i = 0; i < kCount; i += 1000) {
+		const auto block = std::span<const float>(samples).subspan(i, std::min<size_t>(1000, kCount - i));
+		writer.Write(block);
+		hashOnly.Write(block);
+	}
+	REQUIRE(writer.Close());
+	REQUIRE(hashOnly.Close());
+	CHECK(writer.GetSampleCount() == kCount);
+	CHECK(writer.GetHash() == hashOnly.GetHash());
+
+	std::ifstream in(path, std::ios::binary);
+	const std::vector<uint8_t> file{std::istreambuf_iterator<char>(in), {}};
+	std::filesystem::remove(path);
+	REQUIRE(file.size() == 44 + kCount * 2);
+	auto read32 = [&file](size_t at) {
+		return file[at] | file[at + 1] << 8 | file[at + 2] << 16 | (uint32_t)file[at + 3] << 24;
+	};
+	CHECK(std::string(file.begin(), file.begin() + 4) == "RIFF");
+	CHECK(read32(4) == file.size() - 8);
+	CHECK(read32(24) == 44100);
+	CHECK(read32(40) == kCount * 2);
+
+	bool same = true;
+	for (size_t i = 0; i < kCount; ++i) {
+		const int16_t val = file[44 + i * 2] | file[45 + i * 2] << 8;
+		same &= val == (int16_t)std::lrint(std::clamp(samples[i], -1.f, 1.f) * 32767.f);
+	}
+	CHECK(same);
+}
@@ -0,0 +1,536 @@
+// Catch first, X11 headers pulled in by olc define conflicting macros
+#include <catch2/catch.hpp>
+
+#include "nes/instructions.h"
+#include "nes/machine.h"
+
+#include "programs.h"
+#include "romimage.h"
+
+#include <memory>
+#include <vector>
+
+using namespace nes;
+using testing::RomImage;
+
+namespace {
+
+constexpr uint8_t kN = 1 << 7;
+constexpr uint8_t kV = 1 << 6;
+constexpr uint8_t kX = 1 << 5;
+constexpr uint8_t kB = 1 << 4;
+constexpr uint8_t kI = 1 << 2;
+constexpr uint8_t kZ = 1 << 1;
+constexpr uint8_t kC = 1;
+
+// NMOS 6502 base cycle counts, without page crossing or taken branches
+constexpr uint8_t kCycleTable[256] = {
+//	0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+	7, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6, // 0
+	2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 1
+	6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6, // 2
+	2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 3
+	6, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6, // 4
+	2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 5
+	6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6, // 6
+	2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 7
+	2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, // 8
+	2, 6, 0, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5, // 9
+	2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, // A
+	2, 5, 0, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4, // B
+	2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, // C
+	2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // D
+	2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, // E
+	2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // F
+};
+
+// Indexed reads pay a cycle when the effective address crosses a page;
+// stores and read-modify-write instructions always take the long path
+bool HasPageCrossPenalty(const Operation& op) {
+	switch (op.addrMode) {
+		case AddressMode::kABX:
+		case AddressMode::kABY:
+		case AddressMode::kINY:
+			break;
+		default:
+			return false;
+	}
+	switch (op.instr) {
+		case Instruction::kADC:
+		case Instruction::kAND:
+		case Instruction::kCMP:
+		case Instruction::kEOR:
+		case Instruction::kLDA:
+		case Instruction::kLDX:
+		case Instruction::kLDY:
+		case Instruction::kNOP:
+		case Instruction::kORA:
+		case Instruction::kSBC:
+		case Instruction::kLAX:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Single instruction at $8000 in an otherwise NOP filled NROM image
+class CpuRig {
+public:
+	explicit CpuRig(std::initializer_list<uint8_t> code)
+	: machine_(std::make_unique<Machine>()) {
+		RomImage rom;
+		rom.Emit(code);
+		rom.SetVectors(0x9000, RomImage::kPrgBase, 0xA000);
+		REQUIRE(machine_->LoadRom(rom.Build()));
+	}
+
+	Bus& GetBus() {
+		return machine_->GetBus();
+	}
+
+	// Executes the instruction at $8000 from the given registers, returns
+	// its cost in CPU cycles
+	int Step(CpuState state) {
+		state.pc = RomImage::kPrgBase;
+		auto& cpu = machine_->GetCpu();
+		cpu.SetState(state);
+		cpu.Tick();
+		return cpu.GetCyclesLeft();
+	}
+
+	// Finishes the running instruction and starts the next one, returns
+	// its cost
+	int Continue() {
+		auto& cpu = machine_->GetCpu();
+		while (cpu.GetCyclesLeft() > 0) {
+			cpu.Tick();
+		}
+		cpu.Tick();
+		return cpu.GetCyclesLeft();
+	}
+
+	CpuState GetState() const {
+		return machine_->GetCpu().GetState();
+	}
+
+private:
+	std::unique_ptr<Machine> machine_;
+};
+
+CpuState Regs(uint8_t acc, uint8_t x, uint8_t y, uint8_t status = kX | kI) {
+	return {0, acc, x, y, 0xFD, status, 0};
+}
+
+} // namespace
+
+TEST_CASE("Every opcode costs its documented cycles", "[cpu][cycles]") {
+	for (const auto& [opCode, op] : kOpDecoder) {
+		if (op.addrMode == AddressMode::kREL) {
+			continue; // see branch test
+		}
+		CAPTURE(opCode, ToString(op.instr), ToString(op.addrMode));
+
+		// Operand $0210 / $10, pointer at $10 leads to $0310
+		CpuRig rig({(uint8_t)opCode, 0x10, 0x02});
+		rig.GetBus().Write(0x10, 0x10);
+		rig.GetBus().Write(0x11, 0x03);
+		CHECK(rig.Step(Regs(0, 0, 0)) == kCycleTable[opCode]);
+
+		const int crossed = rig.Step(Regs(0, 0xFF, 0xFF));
+		if (HasPageCrossPenalty(op)) {
+			CHECK(crossed == kCycleTable[opCode] + 1);
+		} else if (op.addrMode != AddressMode::kZPX && op.addrMode != AddressMode::kZPY &&
+			   op.addrMode != AddressMode::kINX) {
+			CHECK(crossed == kCycleTable[opCode]);
+		}
+	}
+}
+
+TEST_CASE("Branches cost 2, 3 when taken and 4 across a page", "[cpu][cycles]") {
+	struct Branch {
+		uint8_t opCode;
+		uint8_t takenStatus;
+		uint8_t notTakenStatus;
+	};
+	const Branch branches[] = {
+		{0x10, 0, kN},  // BPL
+		{0x30, kN, 0},  // BMI
+		{0x50, 0, kV},  // BVC
+		{0x70, kV, 0},  // BVS
+		{0x90, 0, kC},  // BCC
+		{0xB0, kC, 0},  // BCS
+		{0xD0, 0, kZ},  // BNE
+		{0xF0, kZ, 0},  // BEQ
+	};
+	for (const auto& branch : branches) {
+		CAPTURE(branch.opCode);
+		{
+			CpuRig rig({branch.opCode, 0x10});
+			CHECK(rig.Step(Regs(0, 0, 0, branch.notTakenStatus)) == 2);
+			CHECK(rig.GetState().pc == 0x8002);
+			CHECK(rig.Step(Regs(0, 0, 0, branch.takenStatus)) == 3);
+			CHECK(rig.GetState().pc == 0x8012);
+		}
+		{
+			CpuRig rig({branch.opCode, 0xF0});
+			CHECK(rig.Step(Regs(0, 0, 0, branch.takenStatus)) == 4);
+			CHECK(rig.GetState().pc == 0x7FF2);
+		}
+	}
+}
+
+TEST_CASE("OAM DMA costs 513 cycles, 514 when it starts on an odd one", "[cpu][cycles]") {
+	CpuRig rig({0x8D, 0x14, 0x40}); // STA $4014
+	for (int i = 0; i < 256; ++i) {
+		rig.GetBus().Write(0x0200 + i, i);
+	}
+	rig.GetBus().Write(0x2003, 0x10);
+
+	// Started on cycle 1, STA abs hands the bus over on cycle 5
+	auto state = Regs(0x02, 0, 0);
+	CHECK(rig.Step(state) == 4 + 514);
+	state.cycle = 1;
+	CHECK(rig.Step(state) == 4 + 513);
+
+	// Written through OAMDATA, OAMADDR ends where it started
+	CHECK(rig.GetBus().Read(0x2004) == 0x00);
+	rig.GetBus().Write(0x2003, 0x0F);
+	CHECK(rig.GetBus().Read(0x2004) == 0xFF);
+}
+
+TEST_CASE("Loads and transfers set N and Z", "[cpu]") {
+	SECTION("LDA #imm") {
+		CpuRig rig({0xA9, 0x00});
+		rig.Step(Regs(0x12, 0, 0, kX | kN));
+		CHECK(rig.GetState().acc == 0x00);
+		CHECK(rig.GetState().status == (kX | kZ));
+	}
+	SECTION("LDX zp") {
+		CpuRig rig({0xA6, 0x10});
+		rig.GetBus().Write(0x10, 0x80);
+		rig.Step(Regs(0, 0, 0, kX | kZ));
+		CHECK(rig.GetState().x == 0x80);
+		CHECK(rig.GetState().status == (kX | kN));
+	}
+	SECTION("LDY abs,X") {
+		CpuRig rig({0xBC, 0x00, 0x02});
+		rig.GetBus().Write(0x0205, 0x7F);
+		rig.Step(Regs(0, 5, 0, kX));
+		CHECK(rig.GetState().y == 0x7F);
+		CHECK(rig.GetState().status == kX);
+	}
+	SECTION("TAX, TSX and TXS") {
+		CpuRig tax({0xAA});
+		tax.Step(Regs(0xF0, 0, 0, kX));
+		CHECK(tax.GetState().x == 0xF0);
+		CHECK(tax.GetState().status == (kX | kN));
+
+		CpuRig tsx({0xBA});
+		tsx.Step(Regs(0, 0, 0, kX));
+		CHECK(tsx.GetState().x == 0xFD);
+		CHECK(tsx.GetState().status == (kX | kN));
+
+		CpuRig txs({0x9A});
+		txs.Step(Regs(0, 0x00, 0, kX));
+		CHECK(txs.GetState().stackPtr == 0x00);
+		CHECK(txs.GetState().status == kX); // TXS leaves flags alone
+	}
+}
+
+TEST_CASE("ADC and SBC carry and overflow", "[cpu]") {
+	struct Case {
+		uint8_t opCode;
+		uint8_t acc;
+		uint8_t val;
+		uint8_t carryIn;
+		uint8_t result;
+		uint8_t status;
+	};
+	const Case cases[] = {
+		{0x69, 0x01, 0x01, 0, 0x02, kX},
+		{0x69, 0x01, 0x01, kC, 0x03, kX},
+		{0x69, 0x7F, 0x01, 0, 0x80, kX | kN | kV},
+		{0x69, 0xFF, 0x01, 0, 0x00, kX | kZ | kC},
+		{0x69, 0x80, 0x80, 0, 0x00, kX | kZ | kC | kV},
+		{0xE9, 0x05, 0x03, kC, 0x02, kX | kC},
+		{0xE9, 0x05, 0x03, 0, 0x01, kX | kC},
+		{0xE9, 0x03, 0x05, kC, 0xFE, kX | kN},
+		{0xE9, 0x80, 0x01, kC, 0x7F, kX | kC | kV},
+		{0xEB, 0x10, 0x10, kC, 0x00, kX | kZ | kC}, // unofficial SBC
+	};
+	for (const auto& c : cases) {
+		CAPTURE(c.opCode, c.acc, c.val, c.carryIn);
+		CpuRig rig({c.opCode, c.val});
+		CHECK(rig.Step(Regs(c.acc, 0, 0, kX | c.carryIn)) == 2);
+		CHECK(rig.GetState().acc == c.result);
+		CHECK(rig.GetState().status == c.status);
+	}
+}
+
+TEST_CASE("Logic, compare and BIT", "[cpu]") {
+	struct Case {
+		uint8_t opCode;
+		uint8_t reg;
+		uint8_t val;
+		uint8_t acc;
+		uint8_t status;
+	};
+	// Register under test goes to A, X or Y depending on the opcode
+	const Case cases[] = {
+		{0x29, 0xF0, 0x0F, 0x00, kX | kZ},        // AND
+		{0x09, 0x80, 0x01, 0x81, kX | kN},        // ORA
+		{0x49, 0xFF, 0xFF, 0x00, kX | kZ},        // EOR
+		{0xC9, 0x10, 0x10, 0x10, kX | kZ | kC},   // CMP equal
+		{0xC9, 0x10, 0x20, 0x10, kX | kN},        // CMP less
+		{0xC9, 0x20, 0x10, 0x20, kX | kC},        // CMP greater
+		{0xE0, 0x00, 0x01, 0x00, kX | kN},        // CPX
+		{0xC0, 0x80, 0x00, 0x00, kX | kN | kC},   // CPY
+	};
+	for (const auto& c : cases) {
+		CAPTURE(c.opCode, c.reg, c.val);
+		CpuRig rig({c.opCode, c.val});
+		const bool isX = c.opCode == 0xE0;
+		const bool isY = c.opCode == 0xC0;
+		rig.Step(Regs(isX || isY ? 0 : c.reg, isX ? c.reg : 0, isY ? c.reg : 0, kX));
+		CHECK(rig.GetState().acc == c.acc);
+		CHECK(rig.GetState().status == c.status);
+	}
+
+	SECTION("BIT takes N and V from memory, Z from A & M") {
+		CpuRig rig({0x24, 0x10});
+		rig.GetBus().Write(0x10, 0xC0);
+		CHECK(rig.Step(Regs(0x3F, 0, 0, kX)) == 3);
+		CHECK(rig.GetState().acc == 0x3F);
+		CHECK(rig.GetState().status == (kX | kN | kV | kZ));
+	}
+}
+
+TEST_CASE("Shifts, rotates and memory increments", "[cpu]") {
+	SECTION("ASL A") {
+		CpuRig rig({0x0A});
+		rig.Step(Regs(0x81, 0, 0, kX));
+		CHECK(rig.GetState().acc == 0x02);
+		CHECK(rig.GetState().status == (kX | kC));
+	}
+	SECTION("LSR zp") {
+		CpuRig rig({0x46, 0x10});
+		rig.GetBus().Write(0x10, 0x01);
+		CHECK(rig.Step(Regs(0, 0, 0, kX)) == 5);
+		CHECK(rig.GetBus().Read(0x10) == 0x00);
+		CHECK(rig.GetState().status == (kX | kZ | kC));
+	}
+	SECTION("ROL A shifts the carry in") {
+		CpuRig rig({0x2A});
+		rig.Step(Regs(0x40, 0, 0, kX | kC));
+		CHECK(rig.GetState().acc == 0x81);
+		CHECK(rig.GetState().status == (kX | kN));
+	}
+	SECTION("ROR abs") {
+		CpuRig rig({0x6E, 0x00, 0x02});
+		rig.GetBus().Write(0x0200, 0x01);
+		CHECK(rig.Step(Regs(0, 0, 0, kX | kC)) == 6);
+		CHECK(rig.GetBus().Read(0x0200) == 0x80);
+		CHECK(rig.GetState().status == (kX | kN | kC));
+	}
+	SECTION("INC and DEC wrap") {
+		CpuRig inc({0xE6, 0x10});
+		inc.GetBus().Write(0x10, 0xFF);
+		inc.Step(Regs(0, 0, 0, kX));
+		CHECK(inc.GetBus().Read(0x10) == 0x00);
+		CHECK(inc.GetState().status == (kX | kZ));
+
+		CpuRig dex({0xCA});
+		dex.Step(Regs(0, 0x00, 0, kX));
+		CHECK(dex.GetState().x == 0xFF);
+		CHECK(dex.GetState().status == (kX | kN));
+	}
+}
+
+TEST_CASE("Stack, subroutines and interrupts", "[cpu]") {
+	SECTION("PHP pushes B and bit 5, PLP drops B") {
+		CpuRig php({0x08});
+		php.Step(Regs(0, 0, 0, kC));
+		CHECK(php.GetState().stackPtr == 0xFC);
+		CHECK(php.GetBus().Read(0x01FD) == (kX | kB | kC));
+
+		CpuRig plp({0x28});
+		plp.GetBus().Write(0x01FE, 0xFF);
+		plp.Step(Regs(0, 0, 0, 0));
+		CHECK(plp.GetState().stackPtr == 0xFE);
+		CHECK(plp.GetState().status == (0xFF & ~kB));
+	}
+	SECTION("PLA sets N and Z") {
+		CpuRig rig({0x68});
+		rig.GetBus().Write(0x01FE, 0x00);
+		CHECK(rig.Step(Regs(0x55, 0, 0, kX)) == 4);
+		CHECK(rig.GetState().acc == 0x00);
+		CHECK(rig.GetState().status == (kX | kZ));
+	}
+	SECTION("JSR pushes the address of its last byte") {
+		CpuRig rig({0x20, 0x34, 0x92});
+		CHECK(rig.Step(Regs(0, 0, 0)) == 6);
+		CHECK(rig.GetState().pc == 0x9234);
+		CHECK(rig.GetState().stackPtr == 0xFB);
+		CHECK(rig.GetBus().Read(0x01FD) == 0x80);
+		CHECK(rig.GetBus().Read(0x01FC) == 0x02);
+	}
+	SECTION("RTS returns past the JSR") {
+		CpuRig rig({0x60});
+		rig.GetBus().Write(0x01FE, 0x02);
+		rig.GetBus().Write(0x01FF, 0x90);
+		rig.Step(Regs(0, 0, 0));
+		CHECK(rig.GetState().pc == 0x9003);
+		CHECK(rig.GetState().stackPtr == 0xFF);
+	}
+	SECTION("BRK vectors through $FFFE and sets I") {
+		CpuRig rig({0x00});
+		rig.Step(Regs(0, 0, 0, kX | kN));
+		CHECK(rig.GetState().pc == 0xA000);
+		CHECK(rig.GetState().stackPtr == 0xFA);
+		CHECK(rig.GetState().status == (kX | kN | kI));
+		CHECK(rig.GetBus().Read(0x01FD) == 0x80);
+		CHECK(rig.GetBus().Read(0x01FC) == 0x02);
+		CHECK(rig.GetBus().Read(0x01FB) == (kX | kB | kN));
+	}
+	SECTION("RTI restores P and PC") {
+		CpuRig rig({0x40});
+		rig.GetBus().Write(0x01FE, kC | kB);
+		rig.GetBus().Write(0x01FF, 0x34);
+		rig.GetBus().Write(0x0100, 0x12);
+		rig.Step(Regs(0, 0, 0, kI));
+		CHECK(rig.GetState().pc == 0x1234);
+		CHECK(rig.GetState().status == (kX | kC));
+	}
+	SECTION("JMP (ind) wraps within the pointer page") {
+		CpuRig rig({0x6C, 0xFF, 0x02});
+		rig.GetBus().Write(0x02FF, 0x34);
+		rig.GetBus().Write(0x0200, 0x12);
+		rig.GetBus().Write(0x0300, 0x56);
+		rig.Step(Regs(0, 0, 0));
+		CHECK(rig.GetState().pc == 0x1234);
+	}
+}
+
+TEST_CASE("IRQs are taken at instruction boundaries while I allows", "[cpu]") {
+	SECTION("Masked while I is set") {
+		CpuRig rig({0xEA, 0xEA});
+		rig.Step(Regs(0, 0, 0));
+		rig.GetBus().SetIrq(Bus::kIrqCartridge, true);
+		CHECK(rig.Continue() == 2);
+		CHECK(rig.GetState().pc == 0x8002);
+	}
+	SECTION("CLI unmasks after the next instruction") {
+		CpuRig rig({0x58, 0xEA, 0xEA});
+		rig.GetBus().SetIrq(Bus::kIrqCartridge, true);
+		rig.Step(Regs(0, 0, 0, kX | kI | kC));
+		CHECK(rig.Continue() == 2);
+		CHECK(rig.GetState().pc == 0x8002);
+
+		CHECK(rig.Continue() == 6);
+		CHECK(rig.GetState().pc == 0xA000);
+		CHECK(rig.GetState().stackPtr == 0xFA);
+		CHECK(rig.GetState().status == (kX | kI | kC));
+		CHECK(rig.GetBus().Read(0x01FD) == 0x80);
+		CHECK(rig.GetBus().Read(0x01FC) == 0x02);
+		CHECK(rig.GetBus().Read(0x01FB) == (kX | kC));
+	}
+	SECTION("SEI still lets one through") {
+		CpuRig rig({0x78, 0xEA});
+		rig.Step(Regs(0, 0, 0, kX));
+		rig.GetBus().SetIrq(Bus::kIrqCartridge, true);
+		CHECK(rig.Continue() == 6);
+		CHECK(rig.GetState().pc == 0xA000);
+		CHECK(rig.GetBus().Read(0x01FB) == (kX | kI));
+	}
+	SECTION("The line is wired-OR") {
+		CpuRig rig({0xEA});
+		auto& bus = rig.GetBus();
+		bus.SetIrq(Bus::kIrqCartridge, true);
+		bus.SetIrq(Bus::kIrqApuDmc, true);
+		bus.SetIrq(Bus::kIrqCartridge, false);
+		CHECK(bus.GetInterruptCycle() == 0);
+		bus.SetIrq(Bus::kIrqApuDmc, false);
+		CHECK(bus.GetInterruptCycle() > 0);
+	}
+}
+
+TEST_CASE("APU IRQs reach the CPU", "[cpu]") {
+	auto machine = std::make_unique<Machine>();
+	REQUIRE(machine->LoadRom(testing::IrqProgram()));
+	machine->RunFrame();
+	// The handler counts IRQs in $02; the one byte DMC sample alone ends
+	// every 8 * 54 cycles
+	const auto cycles = machine->GetCpu().GetCycle();
+	CHECK(machine->GetBus().Read(0x02) >= cycles / (8 * 54));
+}
+
+TEST_CASE("Unofficial opcodes", "[cpu]") {
+	SECTION("LAX loads A and X") {
+		CpuRig rig({0xA7, 0x10});
+		rig.GetBus().Write(0x10, 0x80);
+		rig.Step(Regs(0, 0, 0, kX));
+		CHECK(rig.GetState().acc == 0x80);
+		CHECK(rig.GetState().x == 0x80);
+		CHECK(rig.GetState().status == (kX | kN));
+	}
+	SECTION("SAX stores A & X without touching flags") {
+		CpuRig rig({0x87, 0x10});
+		rig.Step(Regs(0xF0, 0x3C, 0, kX | kZ));
+		CHECK(rig.GetBus().Read(0x10) == 0x30);
+		CHECK(rig.GetState().status == (kX | kZ));
+	}
+	SECTION("DCP decrements then compares") {
+		CpuRig rig({0xC7, 0x10});
+		rig.GetBus().Write(0x10, 0x11);
+		rig.Step(Regs(0x10, 0, 0, kX));
+		CHECK(rig.GetBus().Read(0x10) == 0x10);
+		CHECK(rig.GetState().status == (kX | kZ | kC));
+	}
+	SECTION("DCP of zero compares against $FF") {
+		CpuRig rig({0xC7, 0x10});
+		rig.GetBus().Write(0x10, 0x00);
+		rig.Step(Regs(0x10, 0, 0, kX));
+		CHECK(rig.GetBus().Read(0x10) == 0xFF);
+		CHECK(rig.GetState().status == kX);
+	}
+	SECTION("ISC increments then subtracts") {
+		CpuRig rig({0xE7, 0x10});
+		rig.GetBus().Write(0x10, 0x01);
+		rig.Step(Regs(0x05, 0, 0, kX | kC));
+		CHECK(rig.GetBus().Read(0x10) == 0x02);
+		CHECK(rig.GetState().acc == 0x03);
+		CHECK(rig.GetState().status == (kX | kC));
+	}
+	SECTION("SLO shifts left then ORs") {
+		CpuRig rig({0x07, 0x10});
+		rig.GetBus().Write(0x10, 0x81);
+		rig.Step(Regs(0x01, 0, 0, kX));
+		CHECK(rig.GetBus().Read(0x10) == 0x02);
+		CHECK(rig.GetState().acc == 0x03);
+		CHECK(rig.GetState().status == (kX | kC));
+	}
+	SECTION("RLA rotates left then ANDs") {
+		CpuRig rig({0x27, 0x10});
+		rig.GetBus().Write(0x10, 0x80);
+		rig.Step(Regs(0xFF, 0, 0, kX | kC));
+		CHECK(rig.GetBus().Read(0x10) == 0x01);
+		CHECK(rig.GetState().acc == 0x01);
+		CHECK(rig.GetState().status == (kX | kC));
+	}
+	SECTION("SRE shifts right then EORs") {
+		CpuRig rig({0x47, 0x10});
+		rig.GetBus().Write(0x10, 0x03);
+		rig.Step(Regs(0x01, 0, 0, kX));
+		CHECK(rig.GetBus().Read(0x10) == 0x01);
+		CHECK(rig.GetState().acc == 0x00);
+		CHECK(rig.GetState().status == (kX | kZ | kC));
+	}
+	SECTION("RRA rotates right then adds with the new carry") {
+		CpuRig rig({0x67, 0x10});
+		rig.GetBus().Write(0x10, 0x03);
+		rig.Step(Regs(0x10, 0, 0, kX));
+		CHECK(rig.GetBus().Read(0x10) == 0x01);
+		CHECK(rig.GetState().acc == 0x12);
+		CHECK(rig.GetState().status == kX);
+	}
+}
@@ -0,0 +1,187 @@
+#include <catch2/catch.hpp>
+
+#include "nes/differential.h"
+#include "nes/jit.h"
+#include "nes/lockstep.h"
+#include "nes/machine.h"
+
+#include "programs.h"
+
+#include <tfm/tinyformat.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace nes;
+using namespace nes::testing;
+
+namespace {
+
+constexpr uint64_t kCycles = 10 * 29781; // about ten frames
+
+// One CPU cycle and its three PPU dots, no idle loop skipping
+void TickCycle(Machine& machine) {
+	auto& ppu = machine.GetPpu();
+	ppu.Tick();
+	ppu.Tick();
+	ppu.Tick();
+	machine.GetCpu().Tick();
+}
+
+bool SameState(const CpuState& a, const CpuState& b) {
+	return a.pc == b.pc && a.acc == b.acc && a.x == b.x && a.y == b.y &&
+		a.stackPtr == b.stackPtr && a.status == b.status && a.cycle == b.cycle;
+}
+
+std::string ToString(const CpuState& s) {
+	return tfm::format("PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%d",
+			   s.pc, s.acc, s.x, s.y, s.status, s.stackPtr, s.cycle);
+}
+
+bool SameRam(Machine& a, Machine& b) {
+	return memcmp(a.GetBus().GetRamData(), b.GetBus().GetRamData(), 0x800) == 0;
+}
+
+bool SameFrame(Machine& a, Machine& b) {
+	const size_t size = sizeof(RGBA) * kScreenColCount * kScreenRowCount;
+	return memcmp(a.GetOwnFramebuffers()[a.GetPpu().GetActiveFramebufferId()],
+		      b.GetOwnFramebuffers()[b.GetPpu().GetActiveFramebufferId()], size) == 0;
+}
+
+std::vector<std::pair<std::string, std::vector<uint8_t>>> Programs() {
+	return {
+		{"alu", AluProgram()},
+		{"memory", MemoryProgram()},
+		{"call", CallProgram()},
+		{"game", GameProgram()},
+		{"irq", IrqProgram()},
+	};
+}
+
+} // namespace
+
+TEST_CASE("JIT matches the interpreter at every instruction boundary", "[differential][jit]") {
+	if (!Jit::IsSupported()) {
+		WARN("JIT not supported on this host");
+		return;
+	}
+
+	for (const auto& [name, rom] : Programs()) {
+		CAPTURE(name);
+		auto ref = std::make_unique<Machine>();
+		auto jit = std::make_unique<Machine>();
+		REQUIRE(ref->LoadRom(rom));
+		REQUIRE(jit->LoadRom(rom));
+		jit->GetCpu().SetJitEnabled(true);
+
+		// Native blocks retire several instructions per boundary, the
+		// interpreter has to be at a boundary at the same cycle
+		for (uint64_t i = 0; i < kCycles; ++i) {
+			TickCycle(*ref);
+			TickCycle(*jit);
+			if (jit->GetCpu().GetCyclesLeft() != 0) {
+				continue;
+			}
+			const auto expected = ref->GetCpu().GetState();
+			const auto actual = jit->GetCpu().GetState();
+			if (ref->GetCpu().GetCyclesLeft() != 0 || !SameState(expected, actual) || !SameRam(*ref, *jit)) {
+				FAIL("diverged at cycle " << i << "\n  interpreter " << ToString(expected)
+				     << "\n  jit         " << ToString(actual));
+			}
+		}
+	}
+}
+
+TEST_CASE("Lockstep lanes match scalar machines", "[differential][lockstep]") {
+	constexpr size_t kLanes = LockstepCpu::kLaneCount;
+	std::array<std::unique_ptr<Machine>, kLanes> refs;
+	std::array<std::unique_ptr<Machine>, kLanes> lanes;
+	std::array<Machine*, kLanes> lanePtrs;
+	for (size_t i = 0; i < kLanes; ++i) {
+		refs[i] = std::make_unique<Machine>();
+		lanes[i] = std::make_unique<Machine>();
+		REQUIRE(refs[i]->LoadRom(GameProgram()));
+		REQUIRE(lanes[i]->LoadRom(GameProgram()));
+		// Different scroll seeds make the lanes' data diverge
+		refs[i]->GetBus().Write(0x01, i * 17);
+		lanes[i]->GetBus().Write(0x01, i * 17);
+		lanePtrs[i] = lanes[i].get();
+	}
+	LockstepCpu lockstep(lanePtrs);
+
+	for (uint64_t i = 0; i < kCycles; ++i) {
+		lockstep.Tick();
+		for (size_t lane = 0; lane < kLanes; ++lane) {
+			TickCycle(*refs[lane]);
+			if (refs[lane]->GetCpu().GetCyclesLeft() != 0) {
+				continue;
+			}
+			const auto expected = refs[lane]->GetCpu().GetState();
+			const auto actual = lockstep.GetLaneState(lane);
+			if (!SameState(expected, actual)) {
+				FAIL("lane " << lane << " diverged at cycle " << i << "\n  scalar   "
+				     << ToString(expected) << "\n  lockstep " << ToString(actual));
+			}
+		}
+	}
+	CHECK(lockstep.GetStats().vectorInstructions > 0);
+}
+
+TEST_CASE("Idle loop skipping does not change any frame", "[differential][idle]") {
+	auto programs = Programs();
+	programs.push_back({"ppu_fixture", PpuFixtureProgram()});
+	for (const auto& [name, rom] : programs) {
+		CAPTURE(name);
+		auto ref = std::make_unique<Machine>();
+		auto skip = std::make_unique<Machine>();
+		REQUIRE(ref->LoadRom(rom));
+		REQUIRE(skip->LoadRom(rom));
+		ref->SetIdleLoopSkipping(false);
+		skip->SetIdleLoopSkipping(true);
+
+		for (int frame = 0; frame < 10; ++frame) {
+			CAPTURE(frame);
+			ref->RunFrame();
+			skip->RunFrame();
+			const auto expected = ref->GetCpu().GetState();
+			const auto actual = skip->GetCpu().GetState();
+			INFO("no skip " << ToString(expected) << "\nskip    " << ToString(actual));
+			REQUIRE(SameState(expected, actual));
+			REQUIRE(ref->GetCpu().GetCyclesLeft() == skip->GetCpu().GetCyclesLeft());
+			REQUIRE(SameRam(*ref, *skip));
+			REQUIRE(SameFrame(*ref, *skip));
+		}
+	}
+}
+
+TEST_CASE("Differential runner compares backends", "[differential][runner]") {
+	DifferentialRunner::Options options;
+	options.a = {"interpreter"};
+	options.b = {"idle", false, true};
+	options.frames = 10;
+
+	SECTION("Matching backends") {
+		for (auto granularity : {DifferentialRunner::Granularity::kInstruction,
+					 DifferentialRunner::Granularity::kFrame}) {
+			options.granularity = granularity;
+			const auto res = DifferentialRunner(options).Run("game", GameProgram());
+			INFO(res.report);
+			CHECK(res.loaded);
+			CHECK_FALSE(res.diverged);
+			CHECK(res.frames == 10);
+			CHECK(res.comparisons > 0);
+		}
+	}
+	SECTION("First divergence is reported") {
+		options.b.setup = [](Machine& machine) {
+			machine.GetBus().Write(0x0200, 0x01); // copied to $0201 by the loop
+		};
+		const auto res = DifferentialRunner(options).Run("memory", MemoryProgram());
+		CHECK(res.diverged);
+		CHECK(res.frames == 0);
+		CHECK(res.report.find("RAM differs") != std::string::npos);
+	}
+}
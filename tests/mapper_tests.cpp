@@ -0,0 +1,289 @@
+#include <catch2/catch.hpp>
+
+#include "nes/machine.h"
+
+#include <memory>
+#include <vector>
+
+using namespace nes;
+
+namespace {
+
+constexpr uint8_t kInesMapper4 = 0x40;
+
+// 128KB PRG and 32KB CHR, every 8KB PRG bank and 1KB CHR bank filled with
+// its own number
+std::vector<uint8_t> Mmc3Image() {
+	std::vector<uint8_t> rom = {'N', 'E', 'S', 0x1A, 8, 4, kInesMapper4, 0,
+				    0, 0, 0, 0, 0, 0, 0, 0};
+	for (int bank = 0; bank < 16; ++bank) {
+		rom.insert(rom.end(), 0x2000, (uint8_t)bank);
+	}
+	for (int bank = 0; bank < 32; ++bank) {
+		rom.insert(rom.end(), 0x0400, (uint8_t)bank);
+	}
+	return rom;
+}
+
+// prgBanks 16KB and chrBanks 8KB banks, each byte holding its bank's
+// number; no CHR banks means CHR RAM
+std::vector<uint8_t> DiscreteImage(uint8_t mapperId, uint8_t prgBanks, uint8_t chrBanks) {
+	std::vector<uint8_t> rom = {'N', 'E', 'S', 0x1A, prgBanks, chrBanks,
+				    (uint8_t)(mapperId << 4), (uint8_t)(mapperId & 0xF0),
+				    0, 0, 0, 0, 0, 0, 0, 0};
+	for (int bank = 0; bank < prgBanks; ++bank) {
+		rom.insert(rom.end(), 0x4000, (uint8_t)bank);
+	}
+	for (int bank = 0; bank < chrBanks; ++bank) {
+		rom.insert(rom.end(), 0x2000, (uint8_t)bank);
+	}
+	return rom;
+}
+
+// MMC1 registers are loaded serially, one bit per write, LSB first
+void WriteMmc1(Bus& bus, uint16_t addr, uint8_t val) {
+	for (int bit = 0; bit < 5; ++bit) {
+		bus.Write(addr, (val >> bit) & 0x01);
+	}
+}
+
+std::unique_ptr<Machine> LoadMmc3() {
+	auto machine = std::make_unique<Machine>();
+	REQUIRE(machine->LoadRom(Mmc3Image()));
+	return machine;
+}
+
+void TickPpuTo(Ppu2C02& ppu, uint32_t dotIdx) {
+	while (ppu.GetDotIndex() != dotIdx) {
+		ppu.Tick();
+	}
+}
+
+} // namespace
+
+TEST_CASE("MMC1 switches 16KB and 32KB PRG banks", "[mapper]") {
+	auto machine = std::make_unique<Machine>();
+	auto& bus = machine->GetBus();
+	REQUIRE(machine->LoadRom(DiscreteImage(1, 8, 1)));
+
+	// Powers up in mode 3, the last bank fixed at $C000
+	CHECK(bus.Read(0x8000) == 0);
+	CHECK(bus.Read(0xC000) == 7);
+	WriteMmc1(bus, 0xE000, 0x03);
+	CHECK(bus.Read(0x8000) == 3);
+	CHECK(bus.Read(0xFFFF) == 7);
+	CHECK(bus.GetPrgBankId(0x8000) == 3);
+	CHECK(bus.GetPrgBankId(0xC000) == 7);
+
+	// Mode 2 fixes the first bank at $8000
+	WriteMmc1(bus, 0x8000, 0x08);
+	CHECK(bus.Read(0x8000) == 0);
+	CHECK(bus.Read(0xC000) == 3);
+	WriteMmc1(bus, 0x8000, 0x0E);
+	CHECK(bus.Read(0x8000) == 3);
+	CHECK(bus.Read(0xC000) == 7);
+
+	// Modes 0 and 1 switch 32KB, ignoring the low bit
+	WriteMmc1(bus, 0x8000, 0x00);
+	WriteMmc1(bus, 0xE000, 0x05);
+	CHECK(bus.Read(0x8000) == 4);
+	CHECK(bus.Read(0xC000) == 5);
+	CHECK(bus.GetPrgBankId(0xC000) == 5);
+
+	// A write with bit 7 set returns to mode 3
+	bus.Write(0x8000, 0x80);
+	CHECK(bus.Read(0x8000) == 5);
+	CHECK(bus.Read(0xC000) == 7);
+
+	// PRG RAM ignores writes while disabled
+	bus.Write(0x6000, 0x42);
+	WriteMmc1(bus, 0xE000, 0x15);
+	bus.Write(0x6000, 0x24);
+	WriteMmc1(bus, 0xE000, 0x05);
+	CHECK(bus.Read(0x6000) == 0x42);
+}
+
+TEST_CASE("MMC1 switches 8KB and 4KB CHR banks", "[mapper]") {
+	auto machine = std::make_unique<Machine>();
+	auto& bus = machine->GetBus();
+	// Eight 4KB banks, each pair holding its 8KB bank number
+	REQUIRE(machine->LoadRom(DiscreteImage(1, 2, 4)));
+
+	// Mode 0 switches 8KB, ignoring the low bit
+	CHECK(bus.ReadChr(0x1FFF) == 0);
+	WriteMmc1(bus, 0xA000, 0x05);
+	CHECK(bus.ReadChr(0x0000) == 2);
+	CHECK(bus.ReadChr(0x1000) == 2);
+
+	// Mode 1 switches each 4KB half
+	WriteMmc1(bus, 0x8000, 0x1C);
+	WriteMmc1(bus, 0xA000, 0x03);
+	WriteMmc1(bus, 0xC000, 0x06);
+	CHECK(bus.ReadChr(0x0FFF) == 1);
+	CHECK(bus.ReadChr(0x1000) == 3);
+
+	// Banks past the end wrap
+	WriteMmc1(bus, 0xC000, 0x0E);
+	CHECK(bus.ReadChr(0x1000) == 3);
+}
+
+TEST_CASE("MMC3 maps 8KB PRG and 1KB CHR windows", "[mapper]") {
+	auto machine = LoadMmc3();
+	auto& bus = machine->GetBus();
+
+	// The last two windows default to the last two banks
+	CHECK(bus.Read(0x8000) == 0);
+	CHECK(bus.Read(0xA000) == 1);
+	CHECK(bus.Read(0xC000) == 14);
+	CHECK(bus.Read(0xFFFF) == 15);
+
+	bus.Write(0x8000, 0x06);
+	bus.Write(0x8001, 0x03);
+	CHECK(bus.Read(0x8000) == 3);
+	bus.Write(0x8000, 0x46); // PRG mode 1
+	CHECK(bus.Read(0x8000) == 14);
+	CHECK(bus.Read(0xC000) == 3);
+	CHECK(bus.GetPrgBankId(0xC000) == 3);
+
+	// R0 selects a 2KB bank, ignoring its low bit
+	bus.Write(0x8000, 0x00);
+	bus.Write(0x8001, 0x05);
+	bus.Write(0x8000, 0x02);
+	bus.Write(0x8001, 0x09);
+	CHECK(bus.ReadChr(0x0000) == 4);
+	CHECK(bus.ReadChr(0x07FF) == 5);
+	CHECK(bus.ReadChr(0x1000) == 9);
+	bus.Write(0x8000, 0x80); // CHR mode 1 swaps the pattern tables
+	CHECK(bus.ReadChr(0x0000) == 9);
+	CHECK(bus.ReadChr(0x1400) == 5);
+
+	// PRG RAM can be write protected
+	bus.Write(0x6000, 0x42);
+	bus.Write(0xA001, 0xC0);
+	bus.Write(0x6000, 0x24);
+	CHECK(bus.Read(0x6000) == 0x42);
+}
+
+TEST_CASE("MMC3 counts rendered lines at the predicted A12 rise", "[mapper]") {
+	auto machine = LoadMmc3();
+	auto& bus = machine->GetBus();
+	auto& ppu = machine->GetPpu();
+
+	bus.Write(0xC000, 10); // latch
+	bus.Write(0xC001, 0x00); // reload
+	bus.Write(0xE001, 0x00); // enable
+	bus.Write(0x2000, 0x08); // background at $0000, sprites at $1000
+	bus.Write(0x2001, 0x18);
+
+	// Reloaded on line 0, reaches zero on line 10 with the sprite fetches
+	TickPpuTo(ppu, 10 * kScanlineColCount + 259);
+	CHECK_FALSE(bus.IsCartridgeIrqPending());
+	CHECK(bus.IsCartridgeIrqDueNextScanline());
+	CHECK(bus.GetCyclesUntilPpuEvent() == 0);
+	ppu.Tick();
+	CHECK(bus.IsCartridgeIrqPending());
+	CHECK(bus.GetInterruptCycle() == 0); // drives the CPU's IRQ line
+
+	bus.Write(0xE000, 0x00); // acknowledge and disable
+	CHECK_FALSE(bus.IsCartridgeIrqPending());
+	CHECK(bus.GetInterruptCycle() != 0);
+	bus.Write(0xE001, 0x00);
+	TickPpuTo(ppu, 21 * kScanlineColCount + 260);
+	CHECK(bus.IsCartridgeIrqPending());
+
+	// No clocks with both tables at $1000 or while rendering is off
+	bus.Write(0xE000, 0x00);
+	bus.Write(0xE001, 0x00);
+	bus.Write(0x2000, 0x18);
+	TickPpuTo(ppu, 33 * kScanlineColCount + 324);
+	bus.Write(0x2000, 0x08);
+	bus.Write(0x2001, 0x00);
+	TickPpuTo(ppu, 100 * kScanlineColCount);
+	CHECK_FALSE(bus.IsCartridgeIrqPending());
+
+	// The background at $1000 rises with the next line's tile fetches
+	bus.Write(0x2000, 0x10);
+	bus.Write(0x2001, 0x18);
+	TickPpuTo(ppu, 100 * kScanlineColCount + 324); // reloaded from zero
+	CHECK_FALSE(bus.IsCartridgeIrqPending());
+	TickPpuTo(ppu, 110 * kScanlineColCount + 323);
+	CHECK_FALSE(bus.IsCartridgeIrqPending());
+	ppu.Tick();
+	CHECK(bus.IsCartridgeIrqPending());
+}
+
+TEST_CASE("Discrete logic boards switch banks through their latch", "[mapper]") {
+	auto machine = std::make_unique<Machine>();
+	auto& bus = machine->GetBus();
+
+	// Writes go to bytes holding their bank's number, bus conflicts AND
+	// the value with them
+	SECTION("UxROM switches $8000 and fixes the last bank") {
+		REQUIRE(machine->LoadRom(DiscreteImage(2, 8, 0)));
+		CHECK(bus.Read(0x8000) == 0);
+		CHECK(bus.Read(0xC000) == 7);
+		bus.Write(0xC000, 0x03);
+		CHECK(bus.Read(0x8000) == 3);
+		CHECK(bus.GetPrgBankId(0x8000) == 3);
+		bus.Write(0x8000, 0x05);
+		CHECK(bus.Read(0xBFFF) == 1);
+		CHECK(bus.Read(0xFFFF) == 7);
+	}
+	SECTION("CNROM switches 8KB of CHR") {
+		REQUIRE(machine->LoadRom(DiscreteImage(3, 2, 4)));
+		CHECK(bus.ReadChr(0x0000) == 0);
+		bus.Write(0xC000, 0x03);
+		CHECK(bus.ReadChr(0x1FFF) == 1);
+		CHECK(bus.Read(0x8000) == 0);
+		CHECK(bus.Read(0xC000) == 1);
+	}
+	SECTION("AxROM switches all 32KB") {
+		REQUIRE(machine->LoadRom(DiscreteImage(7, 8, 0)));
+		CHECK(bus.Read(0xC000) == 1);
+		bus.Write(0xC000, 0x03);
+		CHECK(bus.Read(0x8000) == 2);
+		CHECK(bus.Read(0xC000) == 3);
+	}
+	SECTION("Color Dreams has no bus conflicts") {
+		REQUIRE(machine->LoadRom(DiscreteImage(11, 8, 16)));
+		bus.Write(0x8000, 0x52);
+		CHECK(bus.Read(0x8000) == 4);
+		CHECK(bus.Read(0xFFFF) == 5);
+		CHECK(bus.ReadChr(0x0000) == 5);
+	}
+	SECTION("GxROM takes CHR from the low bits") {
+		REQUIRE(machine->LoadRom(DiscreteImage(66, 8, 4)));
+		bus.Write(0xC000, 0x11);
+		CHECK(bus.ReadChr(0x0000) == 1);
+		CHECK(bus.Read(0x8000) == 0);
+		CHECK(bus.Read(0xC000) == 1);
+	}
+	SECTION("CHR RAM is written through the PPU") {
+		for (uint8_t mapperId : {0, 1, 2, 4}) {
+			CAPTURE(mapperId);
+			REQUIRE(machine->LoadRom(DiscreteImage(mapperId, 8, 0)));
+			bus.Write(0x2000, 0x00); // increment by 1
+			bus.Write(0x2006, 0x10);
+			bus.Write(0x2006, 0x20);
+			bus.Write(0x2007, 0xAB);
+			bus.Write(0x2007, 0xCD);
+			CHECK(bus.ReadChr(0x1020) == 0xAB);
+			CHECK(bus.ReadChr(0x1021) == 0xCD);
+			bus.Write(0x2006, 0x10);
+			bus.Write(0x2006, 0x20);
+			bus.Read(0x2007); // fills the read buffer
+			CHECK(bus.Read(0x2007) == 0xAB);
+		}
+	}
+	SECTION("32KB boards reject 16KB images") {
+		CHECK_FALSE(machine->LoadRom(DiscreteImage(7, 1, 0)));
+		CHECK_FALSE(machine->LoadRom(DiscreteImage(66, 1, 1)));
+		CHECK(machine->LoadRom(DiscreteImage(3, 1, 1))); // CNROM mirrors
+	}
+	SECTION("MMC boards reject images without enough PRG banks") {
+		CHECK_FALSE(machine->LoadRom(DiscreteImage(1, 0, 1)));
+		CHECK_FALSE(machine->LoadRom(DiscreteImage(4, 0, 1)));
+		CHECK(machine->LoadRom(DiscreteImage(1, 1, 1)));
+		CHECK(machine->LoadRom(DiscreteImage(4, 1, 1))); // 16KB is two 8KB banks
+	}
+}
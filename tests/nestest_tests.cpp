@@ -0,0 +1,111 @@
+#include <catch2/catch.hpp>
+
+#include "nes/machine.h"
+
+#include <tfm/tinyformat.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace nes;
+
+namespace {
+
+// nestest.nes and nestest.log are not distributed with the sources. They
+// are looked up in $NES_TEST_ROM_DIR, then in tests/roms.
+std::filesystem::path GetRomDir() {
+	if (const char* dir = std::getenv("NES_TEST_ROM_DIR")) {
+		return dir;
+	}
+#ifdef NES_TEST_ROM_DIR
+	return NES_TEST_ROM_DIR;
+#else
+	return "tests/roms";
+#endif
+}
+
+struct LogLine {
+	uint16_t pc = 0;
+	uint8_t acc = 0;
+	uint8_t x = 0;
+	uint8_t y = 0;
+	uint8_t status = 0;
+	uint8_t stackPtr = 0;
+	uint64_t cycle = 0;
+};
+
+uint32_t ParseField(const std::string& line, const char* key, int base) {
+	const auto pos = line.find(key);
+	REQUIRE(pos != std::string::npos);
+	return std::stoul(line.substr(pos + strlen(key)), nullptr, base);
+}
+
+LogLine ParseLine(const std::string& line) {
+	LogLine res;
+	res.pc = std::stoul(line.substr(0, 4), nullptr, 16);
+	res.acc = ParseField(line, "A:", 16);
+	res.x = ParseField(line, "X:", 16);
+	res.y = ParseField(line, "Y:", 16);
+	res.status = ParseField(line, "P:", 16);
+	res.stackPtr = ParseField(line, "SP:", 16);
+	res.cycle = ParseField(line, "CYC:", 10);
+	return res;
+}
+
+} // namespace
+
+// Automated mode: start at $C000 and compare registers before every
+// instruction with the reference log. CYC is checked against the summed
+// instruction costs.
+TEST_CASE("nestest matches the golden log", "[cpu][nestest]") {
+	const auto dir = GetRomDir();
+	std::ifstream romFile(dir / "nestest.nes", std::ios::binary);
+	std::ifstream log(dir / "nestest.log");
+	if (!romFile || !log) {
+		WARN("nestest.nes/nestest.log not found in " << dir << ", set NES_TEST_ROM_DIR");
+		return;
+	}
+	const std::vector<uint8_t> rom{std::istreambuf_iterator<char>(romFile), {}};
+
+	auto machine = std::make_unique<Machine>();
+	REQUIRE(machine->LoadRom(rom));
+	auto& cpu = machine->GetCpu();
+	cpu.SetState({0xC000, 0, 0, 0, 0xFD, 0x24, 7});
+
+	uint64_t cycle = 7;
+	size_t lineNo = 0;
+	std::string line;
+	while (std::getline(log, line)) {
+		++lineNo;
+		if (line.empty()) {
+			continue;
+		}
+		const auto expected = ParseLine(line);
+		const auto s = cpu.GetState();
+		const auto actual = tfm::format("%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%d",
+						s.pc, s.acc, s.x, s.y, s.status, s.stackPtr, cycle);
+		const auto wanted = tfm::format("%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%d",
+						expected.pc, expected.acc, expected.x, expected.y,
+						expected.status, expected.stackPtr, expected.cycle);
+		if (actual != wanted) {
+			FAIL("line " << lineNo << ": " << line << "\n  got " << actual);
+		}
+
+		cpu.Tick();
+		const auto cost = cpu.GetCyclesLeft();
+		cycle += cost;
+		for (int i = 0; i < cost; ++i) {
+			cpu.Tick();
+		}
+	}
+
+	// Result codes of the official and unofficial opcode passes
+	CHECK(machine->GetBus().Read(0x02, true) == 0x00);
+	CHECK(machine->GetBus().Read(0x03, true) == 0x00);
+}
@@ -0,0 +1,181 @@
+#include <catch2/catch.hpp>
+
+#include "nes/machine.h"
+
+#include "programs.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+using namespace nes;
+using namespace nes::testing;
+
+namespace {
+
+// FNV-1a over the last completed picture
+uint64_t HashFrame(Machine& machine) {
+	const auto* frame = machine.GetOwnFramebuffers()[machine.GetPpu().GetActiveFramebufferId()];
+	const auto* bytes = reinterpret_cast<const uint8_t*>(frame);
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < sizeof(RGBA) * kScreenColCount * kScreenRowCount; ++i) {
+		hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+// Luma of a rendered pixel; nothing drawn shows kBlankColorIdx
+uint8_t PixelLuma(RGBA px) {
+	if (px.a == 0) {
+		return kLumaPalette[kBlankColorIdx];
+	}
+	for (size_t i = 0; i < kColorPalette.size(); ++i) {
+		const auto c = kColorPalette[i];
+		if (c.r == px.r && c.g == px.g && c.b == px.b) {
+			return kLumaPalette[i];
+		}
+	}
+	FAIL("pixel outside the palette");
+	return 0;
+}
+
+// Third picture of the PPU fixture, the first one that writes pixel (0, 0)
+std::unique_ptr<Machine> RenderFixture(Ppu2C02::ObservationFormat format,
+				       std::array<std::vector<uint8_t>, 2>& out) {
+	auto machine = std::make_unique<Machine>();
+	REQUIRE(machine->LoadRom(PpuFixtureProgram()));
+	if (format != Ppu2C02::ObservationFormat::kRGBA) {
+		for (auto& buffer : out) {
+			buffer.assign(Ppu2C02::GetObservationSize(format), 0xAA);
+		}
+		machine->GetPpu().SetObservationOutput(format, {out[0].data(), out[1].data()});
+	}
+	WritePpuFixture(machine->GetBus());
+	for (int i = 0; i < 3; ++i) {
+		machine->RunFrame();
+	}
+	return machine;
+}
+
+std::vector<uint64_t> RunFrames(Machine& machine, int frames) {
+	std::vector<uint64_t> res;
+	for (int i = 0; i < frames; ++i) {
+		machine.RunFrame();
+		res.push_back(HashFrame(machine));
+	}
+	return res;
+}
+
+} // namespace
+
+// Golden hashes pin the current renderer output. When a rendering change
+// is intended, check the pictures and update the values.
+TEST_CASE("Static fixture renders the reference picture", "[ppu]") {
+	auto machine = std::make_unique<Machine>();
+	REQUIRE(machine->LoadRom(PpuFixtureProgram()));
+	WritePpuFixture(machine->GetBus());
+
+	const auto hashes = RunFrames(*machine, 4);
+	// Background layers are drawn at the start of a frame, so the first
+	// picture is empty. Odd frames skip dot 0 and leave pixel (0, 0) of
+	// one framebuffer unwritten, hence two alternating hashes.
+	CHECK(hashes[1] == 0x19FA0EB3D546CC22ull);
+	CHECK(hashes[2] == 0x8333A5362CF83D17ull);
+	CHECK(hashes[3] == hashes[1]);
+}
+
+TEST_CASE("Game program frames match the reference hashes", "[ppu]") {
+	auto machine = std::make_unique<Machine>();
+	REQUIRE(machine->LoadRom(GameProgram()));
+
+	const auto hashes = RunFrames(*machine, 8);
+	const std::vector<uint64_t> expected = {
+		0xCD3D81A7020D2325ull, 0x7665B0996F452724ull, 0xE8DF209E01E2F494ull, 0x8763EC3BBD552FC4ull,
+		0x85D8026D00D2A644ull, 0xCFE9A5F2CA8DAFA4ull, 0x08DD3D422E913B34ull, 0xD7CE6ED1D79D82C4ull,
+	};
+	CHECK(hashes == expected);
+}
+
+TEST_CASE("Rendering is deterministic across machines", "[ppu]") {
+	auto a = std::make_unique<Machine>();
+	auto b = std::make_unique<Machine>();
+	REQUIRE(a->LoadRom(GameProgram()));
+	REQUIRE(b->LoadRom(GameProgram()));
+	CHECK(RunFrames(*a, 4) == RunFrames(*b, 4));
+}
+
+TEST_CASE("Observation buffers have the documented sizes", "[ppu][observation]") {
+	using Format = Ppu2C02::ObservationFormat;
+	CHECK(Ppu2C02::GetObservationSize(Format::kRGBA) == 256 * 240 * 4);
+	CHECK(Ppu2C02::GetObservationSize(Format::kLumaHalf) == 128 * 120);
+	CHECK(Ppu2C02::GetObservationSize(Format::kLuma84) == 84 * 84);
+	CHECK(Ppu2C02::GetObservationSize(Format::kPaletteIndexHalf) == 128 * 120);
+}
+
+TEST_CASE("Reduced observations match a downsampled RGBA frame", "[ppu][observation]") {
+	using Format = Ppu2C02::ObservationFormat;
+	constexpr int kCols = kScreenColCount;
+	constexpr int kRows = kScreenRowCount;
+
+	std::array<std::vector<uint8_t>, 2> unused;
+	auto reference = RenderFixture(Format::kRGBA, unused);
+	const auto* rgba = reference->GetOwnFramebuffers()[reference->GetPpu().GetActiveFramebufferId()];
+	std::vector<uint8_t> luma(kCols * kRows);
+	for (int i = 0; i < kCols * kRows; ++i) {
+		luma[i] = PixelLuma(rgba[i]);
+	}
+
+	std::array<std::vector<uint8_t>, 2> out;
+	SECTION("kLumaHalf averages 2x2 blocks, rounding to nearest") {
+		auto machine = RenderFixture(Format::kLumaHalf, out);
+		const auto& frame = out[machine->GetPpu().GetActiveFramebufferId()];
+		int mismatches = 0;
+		for (int y = 0; y < kRows / 2; ++y) {
+			for (int x = 0; x < kCols / 2; ++x) {
+				const int i = 2 * y * kCols + 2 * x;
+				const int expected = (luma[i] + luma[i + 1] + luma[i + kCols] +
+						      luma[i + kCols + 1] + 2) / 4;
+				mismatches += frame[y * (kCols / 2) + x] != expected;
+			}
+		}
+		CHECK(mismatches == 0);
+	}
+	SECTION("kLuma84 averages each area bin, rounding to nearest") {
+		auto machine = RenderFixture(Format::kLuma84, out);
+		const auto& frame = out[machine->GetPpu().GetActiveFramebufferId()];
+		int mismatches = 0;
+		for (int by = 0; by < 84; ++by) {
+			for (int bx = 0; bx < 84; ++bx) {
+				const int y0 = by * kRows / 84, y1 = (by + 1) * kRows / 84;
+				const int x0 = bx * kCols / 84, x1 = (bx + 1) * kCols / 84;
+				uint32_t sum = 0;
+				for (int y = y0; y < y1; ++y) {
+					for (int x = x0; x < x1; ++x) {
+						sum += luma[y * kCols + x];
+					}
+				}
+				const uint32_t n = (y1 - y0) * (x1 - x0);
+				mismatches += frame[by * 84 + bx] != (sum + n / 2) / n;
+			}
+		}
+		CHECK(mismatches == 0);
+	}
+	SECTION("kPaletteIndexHalf samples the top left pixel of each block") {
+		auto machine = RenderFixture(Format::kPaletteIndexHalf, out);
+		const auto& frame = out[machine->GetPpu().GetActiveFramebufferId()];
+		int mismatches = 0;
+		for (int y = 0; y < kRows / 2; ++y) {
+			for (int x = 0; x < kCols / 2; ++x) {
+				const auto px = rgba[2 * y * kCols + 2 * x];
+				const auto idx = frame[y * (kCols / 2) + x];
+				REQUIRE(idx < kColorPalette.size());
+				const auto c = kColorPalette[idx];
+				const bool same = px.a == 0
+					? idx == kBlankColorIdx
+					: c.r == px.r && c.g == px.g && c.b == px.b;
+				mismatches += !same;
+			}
+		}
+		CHECK(mismatches == 0);
+	}
+}
@@ -0,0 +1,156 @@
+#include <catch2/catch.hpp>
+
+#include "nes/vecenv.h"
+
+#include "programs.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+using namespace nes;
+using namespace nes::testing;
+
+namespace {
+
+constexpr size_t kFrameSize = kScreenColCount * kScreenRowCount * sizeof(RGBA);
+
+// VecEnv loads from disk, GameProgram() increments $01 in every NMI
+std::string WriteGameRom() {
+	const auto path = std::filesystem::temp_directory_path() / "nes_vecenv_game.nes";
+	const auto rom = GameProgram();
+	std::ofstream out(path, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(rom.data()), rom.size());
+	return path.string();
+}
+
+VecEnv::Config GameConfig() {
+	VecEnv::Config config;
+	config.romPath = WriteGameRom();
+	config.envCount = 2;
+	config.frameSkip = 4;
+	config.threadCount = 1;
+	return config;
+}
+
+struct Batch {
+	std::vector<uint8_t> frames;
+	std::vector<float> rewards;
+	std::vector<uint8_t> dones;
+
+	Batch(const VecEnv& env)
+	: frames(env.GetEnvCount() * env.GetObservationSize())
+	, rewards(env.GetEnvCount())
+	, dones(env.GetEnvCount()) {}
+
+	std::span<const uint8_t> Frame(const VecEnv& env, size_t idx) const {
+		return {frames.data() + idx * env.GetObservationSize(), env.GetObservationSize()};
+	}
+};
+
+void Step(VecEnv& env, Batch& batch) {
+	const std::vector<uint8_t> actions(env.GetEnvCount(), 0);
+	env.Step(actions, batch.frames.data(), batch.rewards.data(), batch.dones.data());
+}
+
+bool SameFrames(std::span<const uint8_t> a, std::span<const uint8_t> b) {
+	return std::equal(a.begin(), a.end(), b.begin(), b.end());
+}
+
+} // namespace
+
+TEST_CASE("Machine reset matches a new machine", "[vecenv]") {
+	auto reused = std::make_unique<Machine>();
+	auto fresh = std::make_unique<Machine>();
+	REQUIRE(reused->LoadRom(GameProgram()));
+	REQUIRE(fresh->LoadRom(GameProgram()));
+	for (int i = 0; i < 5; ++i) {
+		reused->RunFrame();
+	}
+	reused->Reset();
+
+	for (int i = 0; i < 3; ++i) {
+		reused->RunFrame();
+		fresh->RunFrame();
+		CHECK(reused->GetBus().GetRamHash() == fresh->GetBus().GetRamHash());
+		CHECK(reused->GetCpu().GetState().pc == fresh->GetCpu().GetState().pc);
+		const auto id = fresh->GetPpu().GetActiveFramebufferId();
+		CHECK(reused->GetPpu().GetActiveFramebufferId() == id);
+		CHECK(memcmp(reused->GetOwnFramebuffers()[id], fresh->GetOwnFramebuffers()[id],
+			     kFrameSize) == 0);
+	}
+}
+
+TEST_CASE("VecEnv episodes are deterministic for a seed", "[vecenv]") {
+	auto config = GameConfig();
+	VecEnv env(config);
+	REQUIRE(env.Load());
+	Batch first(env);
+	Batch again(env);
+
+	const std::vector<uint64_t> seeds = {7, 7};
+	env.Reset(seeds, first.frames.data());
+	CHECK(SameFrames(first.Frame(env, 0), first.Frame(env, 1)));
+	std::vector<std::vector<uint8_t>> episode;
+	for (int i = 0; i < 3; ++i) {
+		Step(env, first);
+		CHECK(SameFrames(first.Frame(env, 0), first.Frame(env, 1)));
+		episode.push_back(first.frames);
+	}
+
+	// Resetting the same machines replays the episode
+	env.Reset(seeds, again.frames.data());
+	for (int i = 0; i < 3; ++i) {
+		Step(env, again);
+		CHECK(SameFrames(again.frames, episode[i]));
+	}
+}
+
+TEST_CASE("VecEnv steps pool frames and reward RAM deltas until done", "[vecenv]") {
+	auto config = GameConfig();
+	config.envCount = 1;
+	config.frameSkip = 2;
+	config.maxNoopFrames = 0;
+	config.maxEpisodeFrames = 4;
+	config.rewards = {{0x01, 0.5f}};
+	VecEnv env(config);
+	REQUIRE(env.Load());
+	REQUIRE(env.GetObservationSize() == kFrameSize);
+	Batch batch(env);
+	const std::vector<uint64_t> seeds = {1};
+	env.Reset(seeds, batch.frames.data());
+	const auto resetFrame = batch.frames;
+
+	// Reference: one reset frame, then the two frames of the first step
+	auto machine = std::make_unique<Machine>();
+	REQUIRE(machine->LoadRom(GameProgram()));
+	machine->RunFrame();
+	const uint8_t counter = machine->GetBus().Read(0x01, true);
+	std::vector<uint8_t> pooled(kFrameSize, 0);
+	for (int i = 0; i < 2; ++i) {
+		machine->RunFrame();
+		const auto id = machine->GetPpu().GetActiveFramebufferId();
+		const auto* frame = reinterpret_cast<const uint8_t*>(machine->GetOwnFramebuffers()[id]);
+		std::transform(pooled.begin(), pooled.end(), frame, pooled.begin(),
+			       [](uint8_t a, uint8_t b) { return std::max(a, b); });
+	}
+	const auto delta = static_cast<int>(machine->GetBus().Read(0x01, true)) - counter;
+	REQUIRE(delta > 0);
+
+	Step(env, batch);
+	CHECK(SameFrames(batch.frames, pooled));
+	CHECK(batch.rewards[0] == 0.5f * delta);
+	CHECK(batch.dones[0] == 0);
+
+	Step(env, batch);
+	CHECK(batch.dones[0] == 1);
+
+	// The step after done only resets
+	Step(env, batch);
+	CHECK(batch.dones[0] == 0);
+	CHECK(batch.rewards[0] == 0.f);
+	CHECK(SameFrames(batch.frames, resetFrame));
+}